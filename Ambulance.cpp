@@ -5,8 +5,10 @@ using namespace std;
 Ambulance::Ambulance(int ambId, int loc) {
     id = ambId;
     location = loc;
+    station = loc;
     status = "AVAILABLE";
     assignedIncidentId = -1;
+    observer = nullptr;
 }
 
 int Ambulance::getId() const { 
@@ -17,6 +19,10 @@ int Ambulance::getLocation() const {
     return location; 
 }
 
+int Ambulance::getStation() const {
+    return station;
+}
+
 std::string Ambulance::getStatus() const { 
     return status; 
 }
@@ -32,15 +38,29 @@ bool Ambulance::isAvailable() const {
 void Ambulance::dispatchTo(int incidentId) {
     assignedIncidentId = incidentId;
     status = "BUSY";
+    if (observer)
+        observer->onStatusChanged(*this);
 }
 
 void Ambulance::setAvailable() {
     assignedIncidentId = -1;
     status = "AVAILABLE";
+    if (observer)
+        observer->onStatusChanged(*this);
 }
 
 void Ambulance::setLocation(int loc) {
     location = loc;
+    if (observer)
+        observer->onStatusChanged(*this);
+}
+
+void Ambulance::setStation(int loc) {
+    station = loc;
+}
+
+void Ambulance::setObserver(AmbulanceObserver* obs) {
+    observer = obs;
 }
 
 void Ambulance::display() const {
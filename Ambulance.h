@@ -4,17 +4,30 @@
 #include <string>
 using namespace std;
 
+class Ambulance;
+
+class AmbulanceObserver {
+public:
+    virtual ~AmbulanceObserver() {}
+    virtual void onStatusChanged(const Ambulance &amb) = 0; // availability or location changed
+    virtual void onRemoved(const Ambulance &amb) = 0;       // unit is about to be deleted
+};
+// Lets coverage tracking and similar bookkeeping follow dispatches without polling
+
 class Ambulance {
     int id;
     int location;
+    int station; // home base the unit returns to after a call
     string status;
     int assignedIncidentId;
+    AmbulanceObserver* observer;
     
 public:
     Ambulance(int ambId, int loc);
     
     int getId() const;
     int getLocation() const;
+    int getStation() const;
     string getStatus() const;
     int getAssignedIncident() const;
     
@@ -23,6 +36,8 @@ public:
     void dispatchTo(int incidentId);
     void setAvailable();
     void setLocation(int loc);
+    void setStation(int loc);
+    void setObserver(AmbulanceObserver* obs);
     
     void display() const;
 };
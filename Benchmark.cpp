@@ -0,0 +1,568 @@
+#include "Benchmark.h"
+#include "Graph.h"
+#include "ContractionHierarchy.h"
+#include "RouteOverlay.h"
+#include "HubLabels.h"
+#include "CompressedGraph.h"
+#include "ShardedRouter.h"
+#include "SharedMap.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <climits>
+#include <thread>
+#include <cstdio>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+using namespace std;
+
+static double msSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static int startCacheMisses() {
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+// Counts last level cache misses of this thread from now on, -1 when the CPU counters are
+// unavailable (other systems, virtual machines, perf_event_paranoid)
+
+static long long stopCacheMisses(int counter) {
+    long long misses = -1;
+#ifdef __linux__
+    if (counter < 0)
+        return -1;
+    if (read(counter, &misses, sizeof(misses)) != sizeof(misses))
+        misses = -1;
+    close(counter);
+#endif
+    return misses;
+}
+
+vector<QueueTiming> benchmarkQueues(Graph &graph, int queries, unsigned seed) {
+    vector<QueueTiming> timings;
+    vector<int> nodes = graph.getAllNodes();
+    if (nodes.empty() || queries <= 0)
+        return timings;
+
+    // the same random pairs for every queue
+    mt19937 rng(seed);
+    vector<pair<int, int>> pairs;
+    for (int i = 0; i < queries; i++)
+        pairs.push_back({nodes[rng() % nodes.size()], nodes[rng() % nodes.size()]});
+
+    QueueKind kinds[] = {QUEUE_BINARY_HEAP, QUEUE_DIAL, QUEUE_RADIX_HEAP};
+    const char *names[] = {"Binary heap", "Dial buckets", "Radix heap"};
+
+    for (int k = 0; k < 3; k++) {
+        graph.setQueueKind(kinds[k]);
+        QueueTiming t;
+        t.name = names[k];
+        t.checksum = 0;
+
+        auto start = chrono::steady_clock::now();
+        for (auto &p : pairs)
+            t.checksum += graph.dijkstra(p.first, p.second);
+        t.pointToPointMs = msSince(start) / queries;
+
+        start = chrono::steady_clock::now();
+        for (auto &p : pairs)
+            t.checksum += graph.dijkstraAt(p.first, p.second, 8 * 60);
+        t.timedMs = msSince(start) / queries;
+
+        start = chrono::steady_clock::now();
+        for (auto &p : pairs) {
+            vector<int> dist = graph.distancesFrom(p.first);
+            for (int d : dist)
+                if (d != INT_MAX)
+                    t.checksum += d;
+        }
+        t.oneToAllMs = msSince(start) / queries;
+
+        timings.push_back(t);
+    }
+
+    graph.setQueueKind(QUEUE_AUTO);
+    return timings;
+}
+// Runs the same queries with every search queue, leaves the graph choosing automatically again
+
+void printQueueTimings(const vector<QueueTiming> &timings) {
+    cout << "\nSearch Queue Benchmark (average ms per query)\n";
+    cout << "Queue          Point-to-point    Timed  One-to-all  Checksum\n";
+    cout << fixed << setprecision(3);
+    for (auto &t : timings) {
+        cout << left << setw(15) << t.name << right
+             << setw(14) << t.pointToPointMs
+             << setw(9) << t.timedMs
+             << setw(12) << t.oneToAllMs
+             << "  " << t.checksum << endl;
+    }
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+vector<ParallelTiming> benchmarkParallelOneToAll(Graph &graph, int queries, unsigned seed, double &sequentialMs) {
+    vector<ParallelTiming> timings;
+    sequentialMs = 0;
+    vector<int> nodes = graph.getAllNodes();
+    if (nodes.empty() || queries <= 0)
+        return timings;
+
+    mt19937 rng(seed);
+    vector<int> sources;
+    for (int i = 0; i < queries; i++)
+        sources.push_back(nodes[rng() % nodes.size()]);
+
+    vector<vector<int>> expected;
+    auto start = chrono::steady_clock::now();
+    for (int src : sources)
+        expected.push_back(graph.distancesFrom(src));
+    sequentialMs = msSince(start) / queries;
+
+    int cores = max(1u, thread::hardware_concurrency());
+    for (int threads = 1; ; threads = min(threads * 2, cores)) {
+        ParallelTiming t;
+        t.threads = threads;
+        t.identical = true;
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < queries; i++)
+            if (graph.distancesFromParallel(sources[i], threads) != expected[i])
+                t.identical = false;
+        t.ms = msSince(start) / queries;
+        t.speedup = sequentialMs / t.ms;
+        timings.push_back(t);
+
+        if (threads == cores)
+            break;
+    }
+    return timings;
+}
+// Times delta-stepping at 1, 2, 4... threads up to the core count against distancesFrom
+
+void printParallelTimings(const vector<ParallelTiming> &timings, double sequentialMs) {
+    cout << "\nParallel One-to-All Benchmark (sequential: " << fixed << setprecision(3)
+         << sequentialMs << " ms per search)\n";
+    cout << "Threads        ms  Speedup  Same answers\n";
+    for (auto &t : timings) {
+        cout << setw(7) << t.threads
+             << setw(10) << t.ms
+             << setw(8) << t.speedup << "x"
+             << "  " << (t.identical ? "yes" : "NO") << endl;
+    }
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+TableTiming benchmarkStationTables(Graph &graph, int sources, unsigned seed) {
+    TableTiming t = {sources, 0, 0, 0, PHAST_LANES, true};
+    vector<int> nodes = graph.getAllNodes();
+    if (nodes.empty() || sources <= 0)
+        return t;
+
+    mt19937 rng(seed);
+    vector<int> stations;
+    for (int i = 0; i < sources; i++)
+        stations.push_back(nodes[rng() % nodes.size()]);
+
+    vector<vector<int>> expected;
+    auto start = chrono::steady_clock::now();
+    for (int st : stations)
+        expected.push_back(graph.distancesFrom(st));
+    t.dijkstraMs = msSince(start);
+
+    ContractionHierarchy ch(graph);
+    start = chrono::steady_clock::now();
+    ch.build();
+    t.buildMs = msSince(start);
+
+    start = chrono::steady_clock::now();
+    vector<vector<int>> tables = ch.distancesFromMany(stations);
+    t.phastMs = msSince(start);
+    t.identical = tables == expected;
+    return t;
+}
+// Full distance tables for random stations, repeated Dijkstra against PHAST on a fresh hierarchy
+
+void printTableTiming(const TableTiming &t) {
+    cout << "\nStation Table Benchmark (" << t.sources << " stations, " << t.lanes << " per sweep)\n";
+    cout << fixed << setprecision(1);
+    cout << "Repeated Dijkstra: " << t.dijkstraMs << " ms\n";
+    cout << "PHAST sweeps:      " << t.phastMs << " ms (hierarchy built once in " << t.buildMs << " ms)\n";
+    cout << "Same answers:      " << (t.identical ? "yes" : "NO") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+OverlayTiming benchmarkOverlay(Graph &liveGraph, int queries, int changes, unsigned seed) {
+    OverlayTiming t = {0, 0, 0, changes, 0, 0, 0, 0, true};
+    vector<int> nodes = liveGraph.getAllNodes();
+    if (nodes.empty() || queries <= 0 || liveGraph.getEdgeCount() == 0)
+        return t;
+
+    // the road changes go to a copy, the live map, its listeners and the state log never see them
+    Graph graph(liveGraph);
+    graph.setVerbose(false);
+    RouteOverlay overlay(graph);
+    auto start = chrono::steady_clock::now();
+    overlay.build();
+    t.buildMs = msSince(start);
+    t.levels = overlay.getLevelCount();
+    t.cells = overlay.getCellCount(1);
+
+    // traffic swaps travel times between random roads
+    mt19937 rng(seed);
+    vector<pair<int, int>> updates;
+    for (int i = 0; i < changes; i++) {
+        int id = rng() % graph.getEdgeCount();
+        updates.push_back({id, graph.getRoad(rng() % graph.getEdgeCount()).weight});
+    }
+    graph.applyWeightUpdates(updates);
+    t.recomputed = overlay.customize();
+    t.customizeMs = overlay.getLastCustomizeMs();
+
+    for (int i = 0; i < queries; i++) {
+        int a = nodes[rng() % nodes.size()];
+        int b = nodes[rng() % nodes.size()];
+
+        start = chrono::steady_clock::now();
+        int fast = overlay.query(a, b);
+        t.overlayMs += msSince(start);
+
+        start = chrono::steady_clock::now();
+        int plain = graph.dijkstraWithBlocked(a, b);
+        t.dijkstraMs += msSince(start);
+
+        if (fast != plain)
+            t.identical = false;
+    }
+    t.overlayMs /= queries;
+    t.dijkstraMs /= queries;
+    return t;
+}
+// Overlay build, incremental customization after a batch of road changes, then queries
+// checked against dijkstraWithBlocked
+
+void printOverlayTiming(const OverlayTiming &t) {
+    cout << "\nRoute Overlay Benchmark (" << t.levels << " levels, " << t.cells << " level 1 cells)\n";
+    cout << fixed << setprecision(1);
+    cout << "Partition + customization: " << t.buildMs << " ms\n";
+    cout << "After " << t.changes << " road changes:   " << t.customizeMs << " ms (" << t.recomputed << " cells recomputed)\n";
+    cout << setprecision(3);
+    cout << "Overlay query:             " << t.overlayMs << " ms\n";
+    cout << "dijkstraWithBlocked:       " << t.dijkstraMs << " ms\n";
+    cout << "Same answers:              " << (t.identical ? "yes" : "NO") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+OracleTiming benchmarkHubLabels(Graph &graph, const HubLabels &labels, int queries, unsigned seed) {
+    OracleTiming t = {0, 0, 0, 0, true};
+    vector<int> nodes = graph.getAllNodes();
+    if (nodes.empty() || queries <= 0)
+        return t;
+
+    mt19937 rng(seed);
+    vector<pair<int, int>> pairs;
+    for (int i = 0; i < queries; i++)
+        pairs.push_back({nodes[rng() % nodes.size()], nodes[rng() % nodes.size()]});
+
+    vector<int> expected;
+    auto start = chrono::steady_clock::now();
+    for (auto &p : pairs)
+        expected.push_back(graph.dijkstraWithBlocked(p.first, p.second));
+    t.dijkstraUs = msSince(start) * 1000 / queries;
+
+    // lookups are far too quick to time one by one, so the pairs are run through many times
+    const int rounds = 1000;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (auto &p : pairs)
+            t.checksum += labels.query(p.first, p.second);
+    t.lookups = queries * rounds;
+    t.labelUs = msSince(start) * 1000 / t.lookups;
+
+    for (int i = 0; i < queries; i++)
+        if (labels.query(pairs[i].first, pairs[i].second) != expected[i])
+            t.identical = false;
+    return t;
+}
+// Random point-to-point ETAs from the labels against dijkstraWithBlocked
+
+void printOracleTiming(const OracleTiming &t) {
+    cout << "\nDistance Oracle Benchmark (" << t.lookups << " lookups)\n";
+    cout << fixed << setprecision(3);
+    cout << "Hub label lookup:    " << t.labelUs << " us\n";
+    cout << "dijkstraWithBlocked: " << t.dijkstraUs << " us\n";
+    cout << "Same answers:        " << (t.identical ? "yes" : "NO") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+LayoutTiming benchmarkNodeOrder(Graph &graph, int queries, unsigned seed) {
+    LayoutTiming t = {0, 0, -1, -1, true};
+    vector<int> nodes = graph.getAllNodes();
+    if (nodes.empty() || queries <= 0)
+        return t;
+
+    // the same map with nodes numbered in random order, as an arbitrary map file gives them
+    mt19937 rng(seed);
+    vector<int> shuffled = nodes;
+    shuffle(shuffled.begin(), shuffled.end(), rng);
+    Graph scattered;
+    scattered.setVerbose(false);
+    for (int id : shuffled)
+        scattered.addNode(id);
+    for (int id = 0; id < graph.getEdgeCount(); id++) {
+        Road r = graph.getRoad(id);
+        scattered.addEdge(r.src, r.dest, r.weight);
+        if (graph.isRoadBlocked(r.src, r.dest))
+            scattered.markRoadBlocked(r.src, r.dest);
+    }
+
+    vector<int> sources;
+    for (int i = 0; i < queries; i++)
+        sources.push_back(nodes[rng() % nodes.size()]);
+
+    // one-to-all searches touch the whole adjacency; the checksum weights every distance by its
+    // node ID, so it only matches if each distance still lands on the right node
+    auto run = [&](double &ms, long long &misses) {
+        vector<int> ids = scattered.getAllNodes();
+        long long checksum = 0;
+        int counter = startCacheMisses();
+        auto start = chrono::steady_clock::now();
+        for (int s : sources) {
+            vector<int> dist = scattered.distancesFrom(s);
+            for (size_t v = 0; v < ids.size(); v++)
+                if (dist[v] != INT_MAX)
+                    checksum += (long long)dist[v] * (ids[v] % 1000 + 1);
+        }
+        ms = msSince(start) / queries;
+        misses = stopCacheMisses(counter);
+        return checksum;
+    };
+
+    long long before = run(t.scatteredMs, t.scatteredMisses);
+    scattered.reorderNodes();
+    long long after = run(t.reorderedMs, t.reorderedMisses);
+    t.identical = before == after;
+    return t;
+}
+// One-to-all searches on a randomly numbered copy of the map, before and after renumbering it
+
+void printLayoutTiming(const LayoutTiming &t) {
+    cout << "\nNode Order Benchmark (one-to-all searches)\n";
+    cout << fixed << setprecision(2);
+    cout << "Random numbering:      " << t.scatteredMs << " ms";
+    if (t.scatteredMisses >= 0)
+        cout << ", " << t.scatteredMisses << " cache misses";
+    cout << "\nReverse Cuthill-McKee: " << t.reorderedMs << " ms";
+    if (t.reorderedMisses >= 0)
+        cout << ", " << t.reorderedMisses << " cache misses";
+    cout << endl;
+    if (t.scatteredMisses < 0)
+        cout << "(cache miss counters are not available on this system)\n";
+    cout << "Same answers:          " << (t.identical ? "yes" : "NO") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+CompressionTiming benchmarkCompressed(Graph &graph, int queries, unsigned seed) {
+    CompressionTiming t = {graph.getEdgeCount(), (int)sizeof(ERS_COMPRESSED_WEIGHT), 0, 0, 0, 0, 0, 0, true};
+    vector<int> nodes = graph.getAllNodes();
+    if (nodes.empty() || t.roads == 0 || queries <= 0)
+        return t;
+
+    CompactMap packed(graph);
+    auto start = chrono::steady_clock::now();
+    packed.build();
+    t.buildMs = msSince(start);
+    t.clamped = packed.getClampedCount();
+    t.adjacencyBytes = (double)graph.getMemoryBytes() / t.roads;
+    t.compressedBytes = packed.getBytesPerRoad();
+
+    mt19937 rng(seed);
+    vector<int> sources;
+    for (int i = 0; i < queries; i++)
+        sources.push_back(nodes[rng() % nodes.size()]);
+
+    vector<vector<int>> expected;
+    start = chrono::steady_clock::now();
+    for (int s : sources)
+        expected.push_back(graph.distancesFrom(s));
+    t.adjacencyMs = msSince(start) / queries;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; i++)
+        if (packed.distancesFrom(sources[i]) != expected[i])
+            t.identical = false;
+    t.compressedMs = msSince(start) / queries;
+    return t;
+}
+// Same one-to-all searches on the adjacency lists and on the packed copy of the map
+
+void printCompressionTiming(const CompressionTiming &t) {
+    cout << "\nCompressed Map Benchmark (" << t.roads << " roads, " << t.weightBytes << "-byte road times)\n";
+    cout << fixed << setprecision(2);
+    cout << "Adjacency lists: " << t.adjacencyBytes << " bytes per road, " << t.adjacencyMs << " ms per one-to-all\n";
+    cout << "Compressed:      " << t.compressedBytes << " bytes per road, " << t.compressedMs
+         << " ms per one-to-all (built in " << t.buildMs << " ms)\n";
+    if (t.clamped > 0)
+        cout << t.clamped << " roads too long for the weight type, their times were capped\n";
+    cout << "Same answers:    " << (t.identical ? "yes" : "NO") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+ShardTiming benchmarkSharded(Graph &liveGraph, int regions, int queries, int changes, unsigned seed) {
+    ShardTiming t = {regions, changes, 0, 0, 0, 0, true};
+    vector<int> nodes = liveGraph.getAllNodes();
+    if (nodes.empty() || regions < 1 || queries <= 0 || liveGraph.getEdgeCount() == 0)
+        return t;
+
+    // workers and road changes work from a copy, the live map and its listeners never see them
+    Graph graph(liveGraph);
+    graph.setVerbose(false);
+    ShardedRouter router(graph, regions);
+    cout << "Starting " << regions << " region workers..." << endl;
+    if (!router.start("/proc/self/exe")) {
+        t.identical = false;
+        return t;
+    }
+    router.display();
+
+    // same traffic swaps as the overlay benchmark
+    mt19937 rng(seed);
+    vector<pair<int, int>> updates;
+    for (int i = 0; i < changes; i++) {
+        int id = rng() % graph.getEdgeCount();
+        updates.push_back({id, graph.getRoad(rng() % graph.getEdgeCount()).weight});
+    }
+    graph.applyWeightUpdates(updates);
+    auto start = chrono::steady_clock::now();
+    t.forwarded = router.refresh();
+    t.refreshMs = msSince(start);
+
+    for (int i = 0; i < queries; i++) {
+        int a = nodes[rng() % nodes.size()];
+        int b = nodes[rng() % nodes.size()];
+
+        start = chrono::steady_clock::now();
+        int sharded = router.query(a, b);
+        t.shardedMs += msSince(start);
+
+        start = chrono::steady_clock::now();
+        int plain = graph.dijkstraWithBlocked(a, b);
+        t.dijkstraMs += msSince(start);
+
+        if (sharded != plain)
+            t.identical = false;
+    }
+    t.shardedMs /= queries;
+    t.dijkstraMs /= queries;
+    return t; // the workers are stopped when the router goes
+}
+// Queries through the region worker processes checked against dijkstraWithBlocked in this one
+
+void printShardTiming(const ShardTiming &t) {
+    cout << "\nSharded Routing Benchmark (" << t.regions << " region processes)\n";
+    cout << fixed << setprecision(1);
+    cout << "After " << t.changes << " road changes:   " << t.refreshMs << " ms (" << t.forwarded << " sent to region workers)\n";
+    cout << setprecision(3);
+    cout << "Sharded query:             " << t.shardedMs << " ms\n";
+    cout << "dijkstraWithBlocked:       " << t.dijkstraMs << " ms\n";
+    cout << "Same answers:              " << (t.identical ? "yes" : "NO") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+SharedMapTiming benchmarkSharedMap(Graph &graph, int readers, int queries, int closures, unsigned seed) {
+    SharedMapTiming t = {readers, closures, 0, 0, graph.getMemoryBytes(), 0, 0, 0, 0, 0, true};
+    vector<int> nodes = graph.getAllNodes();
+    if (nodes.empty() || readers <= 0 || queries <= 0)
+        return t;
+
+    // what every console does today: its own copy of the map from the file
+    string copyFile = "shared_map_check.txt";
+    graph.saveToFile(copyFile);
+    Graph copy;
+    copy.setVerbose(false);
+    auto start = chrono::steady_clock::now();
+    copy.loadFromFile(copyFile);
+    t.loadMs = msSince(start);
+    remove(copyFile.c_str());
+
+    const string name = "/ers_map_benchmark";
+    start = chrono::steady_clock::now();
+    if (!SharedMap::publish(graph, name)) {
+        t.identical = false;
+        return t;
+    }
+    t.publishMs = msSince(start);
+
+    vector<MapReaderReport> reports = runMapReaders("/proc/self/exe", name, readers, queries, closures, seed);
+    SharedMap check;
+    if (check.attach(name))
+        t.segmentBytes = check.getBytes();
+    check.detach();
+    SharedMap::remove(name);
+
+    for (int i = 0; i < (int)reports.size(); i++) {
+        const MapReaderReport &r = reports[i];
+        t.attachMs += r.attachMs / reports.size();
+        t.queryMs += r.queryMs / reports.size();
+        t.privateKb += r.privateKb / (long long)reports.size();
+        t.pssKb += r.pssKb / (long long)reports.size();
+
+        // the same work here, each reader's closures applied to a search without touching the map
+        vector<pair<int, int>> pairs;
+        vector<int> closedRoads;
+        drawMapReaderWork(nodes.size(), graph.getEdgeCount(), queries, closures, seed + i, pairs, closedRoads);
+        long long expected = 0;
+        for (auto &q : pairs) {
+            int time = graph.distancesWithClosures({nodes[q.first]}, closedRoads)[q.second];
+            if (time != INT_MAX)
+                expected += time;
+        }
+        if (!r.ok || r.checksum != expected)
+            t.identical = false;
+    }
+    if ((int)reports.size() != readers)
+        t.identical = false;
+    return t;
+}
+// Publishes the map once, runs reader processes on it at the same time, each with its own
+// closures, and checks their answers against searches on the live map
+
+void printSharedMapTiming(const SharedMapTiming &t) {
+    cout << "\nShared Map Benchmark (" << t.readers << " reader processes, " << t.closures << " closures each)\n";
+    cout << fixed << setprecision(1);
+    cout << "Own copy per process:  " << t.adjacencyBytes / 1024 << " KB, loadFromFile " << t.loadMs << " ms\n";
+    cout << "Shared segment:        " << t.segmentBytes / 1024 << " KB once, published in " << t.publishMs << " ms\n";
+    cout << setprecision(3);
+    cout << "Attach:                " << t.attachMs << " ms\n";
+    cout << "Query:                 " << t.queryMs << " ms\n";
+    cout << "Each reader process:   " << t.privateKb << " KB private, " << t.pssKb << " KB proportional share\n";
+    cout << "Same answers:          " << (t.identical ? "yes" : "NO") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
@@ -0,0 +1,118 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <vector>
+#include <string>
+using namespace std;
+
+class Graph;
+class HubLabels;
+
+struct QueueTiming {
+    string name;
+    double pointToPointMs; // average dijkstra query
+    double timedMs;        // average dijkstraAt query at 08:00
+    double oneToAllMs;     // average distancesFrom
+    long long checksum;    // sum of all answers, must match between queues
+};
+
+struct ParallelTiming {
+    int threads;
+    double ms;       // average delta-stepping one-to-all search
+    double speedup;  // against the sequential distancesFrom
+    bool identical;  // every distance matched distancesFrom
+};
+
+struct TableTiming {
+    int sources;
+    double dijkstraMs;     // one distancesFrom per source
+    double buildMs;        // contraction hierarchy preprocessing
+    double phastMs;        // all sources through the PHAST sweeps
+    int lanes;             // sources per sweep
+    bool identical;
+};
+
+struct OverlayTiming {
+    int levels;
+    int cells;             // level 1 cells
+    double buildMs;        // partition plus full customization
+    int changes;           // roads given a new travel time
+    int recomputed;        // cells the incremental customization redid
+    double customizeMs;
+    double overlayMs;      // average overlay query
+    double dijkstraMs;     // average dijkstraWithBlocked query
+    bool identical;
+};
+
+struct OracleTiming {
+    int lookups;
+    double labelUs;        // average hub label lookup
+    double dijkstraUs;     // average dijkstraWithBlocked query
+    long long checksum;    // sum of all lookups
+    bool identical;
+};
+
+struct LayoutTiming {
+    double scatteredMs;         // average query with nodes numbered in random order
+    double reorderedMs;         // same queries after reorderNodes
+    long long scatteredMisses;  // hardware cache misses, -1 when the counters are unavailable
+    long long reorderedMisses;
+    bool identical;
+};
+
+struct CompressionTiming {
+    int roads;
+    int weightBytes;          // size of the compressed weight type
+    double adjacencyBytes;    // per road, adjacency lists with their road records and lookups
+    double compressedBytes;   // per road, packed arcs and shared road records
+    double buildMs;
+    double adjacencyMs;       // average distancesFrom
+    double compressedMs;      // average one-to-all search on the packed arcs
+    int clamped;              // roads longer than the weight type holds
+    bool identical;
+};
+
+struct ShardTiming {
+    int regions;
+    int changes;           // roads given a new travel time before the queries
+    int forwarded;         // of those, roads inside a region, sent to its worker
+    double refreshMs;      // forwarding plus the new tables of the regions touched
+    double shardedMs;      // average query through the region workers
+    double dijkstraMs;     // average dijkstraWithBlocked query
+    bool identical;
+};
+
+struct SharedMapTiming {
+    int readers;
+    int closures;               // roads each reader closes for itself only
+    long long segmentBytes;     // the published map, shared by every reader
+    double publishMs;
+    long long adjacencyBytes;   // what each process holds after loading the map itself
+    double loadMs;              // loadFromFile of the same map
+    double attachMs;            // average over the readers
+    double queryMs;
+    long long privateKb;        // average per reader
+    long long pssKb;
+    bool identical;
+};
+
+vector<QueueTiming> benchmarkQueues(Graph &graph, int queries, unsigned seed);
+void printQueueTimings(const vector<QueueTiming> &timings);
+vector<ParallelTiming> benchmarkParallelOneToAll(Graph &graph, int queries, unsigned seed, double &sequentialMs);
+void printParallelTimings(const vector<ParallelTiming> &timings, double sequentialMs);
+TableTiming benchmarkStationTables(Graph &graph, int sources, unsigned seed);
+void printTableTiming(const TableTiming &t);
+OverlayTiming benchmarkOverlay(Graph &graph, int queries, int changes, unsigned seed);
+void printOverlayTiming(const OverlayTiming &t);
+OracleTiming benchmarkHubLabels(Graph &graph, const HubLabels &labels, int queries, unsigned seed);
+void printOracleTiming(const OracleTiming &t);
+LayoutTiming benchmarkNodeOrder(Graph &graph, int queries, unsigned seed);
+void printLayoutTiming(const LayoutTiming &t);
+CompressionTiming benchmarkCompressed(Graph &graph, int queries, unsigned seed);
+void printCompressionTiming(const CompressionTiming &t);
+ShardTiming benchmarkSharded(Graph &graph, int regions, int queries, int changes, unsigned seed);
+void printShardTiming(const ShardTiming &t);
+SharedMapTiming benchmarkSharedMap(Graph &graph, int readers, int queries, int closures, unsigned seed);
+void printSharedMapTiming(const SharedMapTiming &t);
+
+#endif
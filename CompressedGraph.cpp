@@ -0,0 +1,280 @@
+#include "CompressedGraph.h"
+#include "Graph.h"
+#include "SearchQueue.h"
+#include "Trace.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+using namespace std;
+
+static inline void putVarint(vector<unsigned char> &out, unsigned value) {
+    while (value >= 0x80) {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+// 7 bits per byte, high bit set on every byte but the last, small numbers take one byte
+
+static inline unsigned getVarint(const unsigned char* &p) {
+    unsigned value = *p++;
+    if (value < 0x80)
+        return value; // the usual case for neighbours close in the node order
+    value &= 0x7f;
+    for (int shift = 7;; shift += 7) {
+        unsigned byte = *p++;
+        value |= (byte & 0x7f) << shift;
+        if (byte < 0x80)
+            return value;
+    }
+}
+
+static inline unsigned zigzag(int v) {
+    return ((unsigned)v << 1) ^ (unsigned)(v >> 31);
+}
+// Signed deltas as unsigned, -1 -> 1, 1 -> 2, -2 -> 3 ..., so small ones of either sign stay small
+
+static inline int unzigzag(unsigned v) {
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+template <class Weight>
+CompressedGraph<Weight>::CompressedGraph(Graph &g) : graph(g) {
+    seenVersion = -1;
+    maxStored = 0;
+    clamped = 0;
+    buildSeconds = 0;
+    listenerHandle = graph.addChangeListener([this](const vector<int> &changedRoads) {
+        if (seenVersion == -1 || (int)weights.size() != graph.getEdgeCount())
+            return; // not built, or roads were added, build() has to run again anyway
+        for (int id : changedRoads) {
+            weights[id] = encode(id);
+            if (weights[id] != CLOSED)
+                maxStored = max(maxStored, (int)weights[id]);
+        }
+        if (graph.getVersion() == seenVersion + 1)
+            seenVersion = graph.getVersion(); // nothing else happened since the last batch
+    });
+}
+// A new time or a closure only rewrites that road's shared record, the arcs stay as they are
+
+template <class Weight>
+CompressedGraph<Weight>::~CompressedGraph() {
+    graph.removeChangeListener(listenerHandle);
+}
+
+template <class Weight>
+Weight CompressedGraph<Weight>::encode(int edgeId) const {
+    Road r = graph.getRoad(edgeId);
+    if (graph.isRoadBlocked(r.src, r.dest))
+        return CLOSED;
+    return (Weight)min<long long>(r.weight, CLOSED - 1);
+}
+
+template <class Weight>
+void CompressedGraph<Weight>::build() {
+    TRACE_SPAN("compressed", "build");
+    auto start = chrono::steady_clock::now();
+
+    nodeIds = graph.getAllNodes();
+    int n = nodeIds.size();
+    positionOf.clear();
+    for (int i = 0; i < n; i++)
+        positionOf.push_back({nodeIds[i], i});
+    sort(positionOf.begin(), positionOf.end());
+
+    // arcs of every node, gathered from the road records: (neighbour position, edge ID)
+    int m = graph.getEdgeCount();
+    vector<unsigned> degree(n + 1, 0);
+    vector<pair<int, int>> ends(m);
+    for (int id = 0; id < m; id++) {
+        Road r = graph.getRoad(id);
+        ends[id] = {positionOfNode(r.src), positionOfNode(r.dest)};
+        degree[ends[id].first]++;
+        degree[ends[id].second]++;
+    }
+    vector<unsigned> first(n + 1, 0);
+    for (int i = 0; i < n; i++)
+        first[i + 1] = first[i] + degree[i];
+    vector<pair<int, int>> list(first[n]);
+    vector<unsigned> fill(first.begin(), first.end() - 1);
+    for (int id = 0; id < m; id++) {
+        list[fill[ends[id].first]++] = {ends[id].second, id};
+        list[fill[ends[id].second]++] = {ends[id].first, id};
+    }
+
+    // neighbours sorted so each is a small step from the last; with the node order from
+    // reorderNodes the first one is close to the node itself too
+    arcs.clear();
+    offset.assign(n + 1, 0);
+    for (int u = 0; u < n; u++) {
+        offset[u] = arcs.size();
+        sort(list.begin() + first[u], list.begin() + first[u + 1]);
+
+        int lastNode = u, lastRoad = 0;
+        for (unsigned a = first[u]; a < first[u + 1]; a++) {
+            putVarint(arcs, zigzag(list[a].first - lastNode));
+            putVarint(arcs, zigzag(list[a].second - lastRoad));
+            lastNode = list[a].first;
+            lastRoad = list[a].second;
+        }
+    }
+    offset[n] = arcs.size();
+    arcs.shrink_to_fit();
+
+    weights.assign(m, 0);
+    maxStored = 0;
+    clamped = 0;
+    for (int id = 0; id < m; id++) {
+        weights[id] = encode(id);
+        if (graph.getRoad(id).weight >= (long long)CLOSED)
+            clamped++;
+        if (weights[id] != CLOSED)
+            maxStored = max(maxStored, (int)weights[id]);
+    }
+
+    seenVersion = graph.getVersion();
+    buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (clamped > 0)
+        cout << clamped << " roads are longer than the compressed weight type holds, their times are capped\n";
+}
+// Packs the current map; the node order is kept, so results line up with getAllNodes()
+
+template <class Weight>
+bool CompressedGraph<Weight>::isStale() const {
+    return seenVersion != graph.getVersion() || (int)weights.size() != graph.getEdgeCount() ||
+           (int)nodeIds.size() != graph.getNodeCount();
+}
+// Road changes are followed, a reload, a renumbering or new roads need build() again
+
+template <class Weight>
+int CompressedGraph<Weight>::positionOfNode(int nodeId) const {
+    auto it = lower_bound(positionOf.begin(), positionOf.end(), make_pair(nodeId, INT_MIN));
+    if (it == positionOf.end() || it->first != nodeId)
+        return -1;
+    return it->second;
+}
+
+template <class Weight>
+template <class Body>
+auto CompressedGraph<Weight>::withQueue(Body body) const {
+    if (maxStored <= DIAL_MAX_WEIGHT) {
+        DialQueue pq(maxStored);
+        return body(pq);
+    }
+    RadixHeapQueue pq;
+    return body(pq);
+}
+// Same choice as the Graph searches make: Dial's buckets for small road times
+
+template <class Weight>
+int CompressedGraph<Weight>::shortestTime(int start, int end) const {
+    int s = positionOfNode(start);
+    int e = positionOfNode(end);
+    if (s == -1 || e == -1)
+        return INT_MAX;
+
+    return withQueue([&](auto &pq) {
+        vector<int> dist(nodeIds.size(), INT_MAX);
+        dist[s] = 0;
+        pq.push(0, s);
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int d = top.first;
+            int u = top.second;
+            if (u == e)
+                return d;
+            if (d > dist[u])
+                continue;
+
+            // one pass over the node's bytes, no per-node allocation to chase
+            const unsigned char* p = arcs.data() + offset[u];
+            const unsigned char* stop = arcs.data() + offset[u + 1];
+            int v = u, road = 0;
+            while (p < stop) {
+                v += unzigzag(getVarint(p));
+                road += unzigzag(getVarint(p));
+                Weight w = weights[road];
+                if (w == CLOSED)
+                    continue;
+                if (d + (int)w < dist[v]) {
+                    dist[v] = d + w;
+                    pq.push(d + w, v);
+                }
+            }
+        }
+        return INT_MAX;
+    });
+}
+// Dijkstra on the packed arcs avoiding closed roads, static times like dijkstraWithBlocked
+
+template <class Weight>
+vector<int> CompressedGraph<Weight>::distancesFrom(int source) const {
+    TRACE_SPAN_ARG("compressed", "distances_from", source);
+    vector<int> dist(nodeIds.size(), INT_MAX);
+    int s = positionOfNode(source);
+    if (s == -1)
+        return dist;
+
+    withQueue([&](auto &pq) {
+        dist[s] = 0;
+        pq.push(0, s);
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int d = top.first;
+            int u = top.second;
+            if (d > dist[u])
+                continue;
+
+            const unsigned char* p = arcs.data() + offset[u];
+            const unsigned char* stop = arcs.data() + offset[u + 1];
+            int v = u, road = 0;
+            while (p < stop) {
+                v += unzigzag(getVarint(p));
+                road += unzigzag(getVarint(p));
+                Weight w = weights[road];
+                if (w == CLOSED)
+                    continue;
+                if (d + (int)w < dist[v]) {
+                    dist[v] = d + w;
+                    pq.push(d + w, v);
+                }
+            }
+        }
+        return 0;
+    });
+    return dist;
+}
+// One-to-all like Graph::distancesFrom, in the node order of the last build
+
+template <class Weight>
+long long CompressedGraph<Weight>::getBytes() const {
+    return (long long)arcs.capacity() + offset.capacity() * sizeof(unsigned) +
+           weights.capacity() * sizeof(Weight) + nodeIds.capacity() * sizeof(int) +
+           positionOf.capacity() * sizeof(pair<int, int>);
+}
+
+template <class Weight>
+double CompressedGraph<Weight>::getBytesPerRoad() const {
+    return weights.empty() ? 0 : (double)getBytes() / weights.size();
+}
+// Everything, node ID lookup included, divided over the roads
+
+template <class Weight>
+int CompressedGraph<Weight>::getClampedCount() const {
+    return clamped;
+}
+
+template <class Weight>
+double CompressedGraph<Weight>::getBuildSeconds() const {
+    return buildSeconds;
+}
+
+template class CompressedGraph<unsigned char>;
+template class CompressedGraph<unsigned short>;
+template class CompressedGraph<unsigned int>;
+// The weight types that can be picked, compiled here once
@@ -0,0 +1,56 @@
+#ifndef COMPRESSED_GRAPH_H
+#define COMPRESSED_GRAPH_H
+
+#include <vector>
+#include <type_traits>
+using namespace std;
+
+class Graph;
+
+#ifndef ERS_COMPRESSED_WEIGHT
+#define ERS_COMPRESSED_WEIGHT unsigned short // road times up to 65534 min, 2 bytes per road
+#endif
+
+template <class Weight>
+class CompressedGraph {
+    static_assert(is_unsigned<Weight>::value, "road times are stored as unsigned integers");
+
+    Graph &graph;
+    int listenerHandle;
+    long long seenVersion;      // graph version the weights were last brought up to
+
+    vector<int> nodeIds;        // position -> node ID, getAllNodes order at build time
+    vector<pair<int, int>> positionOf; // (node ID, position) sorted by ID
+    vector<unsigned> offset;    // position -> first byte of its arcs, offset[n] = stream size
+    vector<unsigned char> arcs; // per node: neighbour position and edge ID deltas as varints
+    vector<Weight> weights;     // one per road by edge ID, CLOSED while blocked
+    int maxStored;              // largest stored time, sizes Dial's buckets
+    int clamped;                // roads longer than Weight can hold, stored as the largest time
+    double buildSeconds;
+
+    static const Weight CLOSED = (Weight)~(Weight)0;
+
+    int positionOfNode(int nodeId) const;
+    Weight encode(int edgeId) const;
+    template <class Body> auto withQueue(Body body) const;
+
+public:
+    CompressedGraph(Graph &g);
+    ~CompressedGraph();
+
+    void build();
+    bool isStale() const;
+    int shortestTime(int start, int end) const;
+    vector<int> distancesFrom(int source) const;
+
+    long long getBytes() const;
+    double getBytesPerRoad() const;
+    int getClampedCount() const;
+    double getBuildSeconds() const;
+};
+
+typedef CompressedGraph<ERS_COMPRESSED_WEIGHT> CompactMap;
+// The weight type is picked when compiling, e.g. -DERS_COMPRESSED_WEIGHT="unsigned char"
+// for maps whose roads all take under 255 minutes
+
+#endif
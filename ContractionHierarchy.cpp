@@ -0,0 +1,311 @@
+#include "ContractionHierarchy.h"
+#include "Graph.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <queue>
+#include <unordered_map>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static const int UNREACHED = INT_MAX / 4; // leaves room to add a road time without overflowing
+static const int WITNESS_LIMIT = 100;     // nodes a witness search may settle before giving up
+
+ContractionHierarchy::ContractionHierarchy(Graph &g) : graph(g) {
+    stale = true;
+    buildSeconds = 0;
+    shortcuts = 0;
+    listenerHandle = graph.addChangeListener([this](const vector<int> &) {
+        stale = true; // any road change can change the shortcuts
+    });
+}
+
+ContractionHierarchy::~ContractionHierarchy() {
+    graph.removeChangeListener(listenerHandle);
+}
+
+void ContractionHierarchy::build() {
+    auto start = chrono::steady_clock::now();
+
+    nodeIds = graph.getAllNodes();
+    int n = nodeIds.size();
+    unordered_map<int, int> index;
+    for (int i = 0; i < n; i++)
+        index[nodeIds[i]] = i;
+
+    // working copy of the open roads, parallel roads merged into the fastest one
+    vector<vector<pair<int, int>>> adj(n); // node -> (neighbour, time) among nodes not yet contracted
+    auto link = [&](int a, int b, int w) {
+        for (auto &e : adj[a])
+            if (e.first == b) {
+                if (w < e.second) {
+                    e.second = w;
+                    for (auto &back : adj[b])
+                        if (back.first == a)
+                            back.second = w;
+                }
+                return false;
+            }
+        adj[a].push_back({b, w});
+        adj[b].push_back({a, w});
+        return true;
+    };
+    for (int id = 0; id < graph.getEdgeCount(); id++) {
+        Road r = graph.getRoad(id);
+        if (r.src != r.dest && !graph.isRoadBlocked(r.src, r.dest))
+            link(index[r.src], index[r.dest], r.weight);
+    }
+
+    vector<char> contracted(n, 0);
+    vector<int> removedNeighbours(n, 0);
+    vector<int> dist(n, INT_MAX);
+    vector<int> touched;
+
+    // bounded Dijkstra from u that does not pass through skip, used to look for witness paths
+    auto witness = [&](int u, int skip, int limit) {
+        for (int t : touched)
+            dist[t] = INT_MAX;
+        touched.clear();
+
+        priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
+        dist[u] = 0;
+        touched.push_back(u);
+        pq.push({0, u});
+        int settled = 0;
+        while (!pq.empty() && settled < WITNESS_LIMIT) {
+            auto top = pq.top();
+            pq.pop();
+            if (top.first > dist[top.second])
+                continue;
+            if (top.first > limit)
+                break;
+            settled++;
+            for (auto &e : adj[top.second]) {
+                if (e.first == skip || contracted[e.first])
+                    continue;
+                int nd = top.first + e.second;
+                if (nd < dist[e.first]) {
+                    if (dist[e.first] == INT_MAX)
+                        touched.push_back(e.first);
+                    dist[e.first] = nd;
+                    pq.push({nd, e.first});
+                }
+            }
+        }
+    };
+
+    // shortcuts contracting v would need, added for real when apply is set
+    auto contract = [&](int v, bool apply) {
+        int needed = 0;
+        auto &nbrs = adj[v];
+        for (size_t i = 0; i < nbrs.size(); i++) {
+            if (i + 1 == nbrs.size())
+                break;
+            int u = nbrs[i].first;
+            int longest = 0;
+            for (size_t j = i + 1; j < nbrs.size(); j++)
+                longest = max(longest, nbrs[i].second + nbrs[j].second);
+
+            witness(u, v, longest);
+            for (size_t j = i + 1; j < nbrs.size(); j++) {
+                int via = nbrs[i].second + nbrs[j].second;
+                if (dist[nbrs[j].first] <= via)
+                    continue; // a path around v is just as fast
+                needed++;
+                if (apply && link(u, nbrs[j].first, via))
+                    shortcuts++;
+            }
+        }
+        return needed;
+    };
+
+    auto priority = [&](int v) {
+        return 2 * (contract(v, false) - (int)adj[v].size()) + removedNeighbours[v];
+    };
+
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> order;
+    for (int v = 0; v < n; v++)
+        order.push({priority(v), v});
+
+    shortcuts = 0;
+    vector<vector<pair<int, int>>> up(n); // node -> more important neighbours when it was contracted
+    vector<int> rank(n);
+    int next = 0;
+    while (!order.empty()) {
+        int v = order.top().second;
+        order.pop();
+
+        // lazy update: the priority may have grown since it was queued
+        int p = priority(v);
+        if (!order.empty() && p > order.top().first) {
+            order.push({p, v});
+            continue;
+        }
+
+        contract(v, true);
+        rank[v] = next++;
+        contracted[v] = 1;
+        for (auto &e : adj[v]) {
+            up[v].push_back(e);
+            removedNeighbours[e.first]++;
+            auto &back = adj[e.first];
+            for (size_t k = 0; k < back.size(); k++)
+                if (back[k].first == v) {
+                    back[k] = back.back();
+                    back.pop_back();
+                    break;
+                }
+        }
+        adj[v].clear();
+    }
+
+    // lay the upward arcs out in sweep order, most important node first
+    position.assign(n, 0);
+    for (int v = 0; v < n; v++)
+        position[v] = n - 1 - rank[v];
+
+    vector<int> byPosition(n);
+    for (int v = 0; v < n; v++)
+        byPosition[position[v]] = v;
+
+    upStart.assign(n + 1, 0);
+    upHead.clear();
+    upWeight.clear();
+    for (int p = 0; p < n; p++) {
+        upStart[p] = upHead.size();
+        for (auto &e : up[byPosition[p]]) {
+            upHead.push_back(position[e.first]);
+            upWeight.push_back(e.second);
+        }
+    }
+    upStart[n] = upHead.size();
+
+    stale = false;
+    buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+// Contracts nodes least important first (few shortcuts, few contracted neighbours), adding a
+// shortcut between two neighbours only when no witness path around the node is as fast
+// Only open roads with their static times are used, any road change makes it stale
+
+void ContractionHierarchy::upwardSearch(int source, vector<int> &dist, vector<int> &touched) const {
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
+    dist[source] = 0;
+    touched.push_back(source);
+    pq.push({0, source});
+
+    while (!pq.empty()) {
+        auto top = pq.top();
+        pq.pop();
+        if (top.first > dist[top.second])
+            continue;
+
+        // upward arcs are stored at the less important end, so walk them from there
+        for (int a = upStart[top.second]; a < upStart[top.second + 1]; a++) {
+            int to = upHead[a];
+            int nd = top.first + upWeight[a];
+            if (nd < dist[to]) {
+                if (dist[to] == UNREACHED)
+                    touched.push_back(to);
+                dist[to] = nd;
+                pq.push({nd, to});
+            }
+        }
+    }
+}
+// Dijkstra over upward arcs only, by sweep position, reaches a small part of the map
+
+void ContractionHierarchy::sweep(vector<int> &lanes) const {
+    int n = position.size();
+    for (int p = 0; p < n; p++) {
+        int *mine = &lanes[(size_t)p * PHAST_LANES];
+        for (int a = upStart[p]; a < upStart[p + 1]; a++) {
+            const int *from = &lanes[(size_t)upHead[a] * PHAST_LANES];
+            int w = upWeight[a];
+#if defined(__AVX512F__)
+            __m512i d = _mm512_add_epi32(_mm512_loadu_si512(from), _mm512_set1_epi32(w));
+            _mm512_storeu_si512(mine, _mm512_min_epi32(d, _mm512_loadu_si512(mine)));
+#elif defined(__AVX2__)
+            __m256i d = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)from), _mm256_set1_epi32(w));
+            _mm256_storeu_si256((__m256i *)mine, _mm256_min_epi32(d, _mm256_loadu_si256((const __m256i *)mine)));
+#else
+            for (int k = 0; k < PHAST_LANES; k++)
+                mine[k] = min(mine[k], from[k] + w);
+#endif
+        }
+    }
+}
+// PHAST downward sweep: every node, most important first, takes the best of its more important
+// neighbours plus the arc time, for all lanes at once (min-plus over PHAST_LANES sources)
+
+vector<vector<int>> ContractionHierarchy::distancesFromMany(const vector<int> &sources) {
+    if (stale)
+        build();
+
+    int n = nodeIds.size();
+    unordered_map<int, int> index;
+    for (int i = 0; i < n; i++)
+        index[nodeIds[i]] = i;
+
+    vector<vector<int>> result;
+    vector<int> lanes((size_t)n * PHAST_LANES);
+    vector<int> dist(n, UNREACHED);
+    vector<int> touched;
+
+    for (size_t first = 0; first < sources.size(); first += PHAST_LANES) {
+        int batch = min((size_t)PHAST_LANES, sources.size() - first);
+        fill(lanes.begin(), lanes.end(), UNREACHED);
+
+        for (int k = 0; k < batch; k++) {
+            auto it = index.find(sources[first + k]);
+            if (it == index.end())
+                continue;
+
+            upwardSearch(position[it->second], dist, touched);
+            for (int p : touched) {
+                lanes[(size_t)p * PHAST_LANES + k] = dist[p];
+                dist[p] = UNREACHED;
+            }
+            touched.clear();
+        }
+
+        sweep(lanes);
+
+        for (int k = 0; k < batch; k++) {
+            vector<int> out(n);
+            for (int v = 0; v < n; v++) {
+                int d = lanes[(size_t)position[v] * PHAST_LANES + k];
+                out[v] = d >= UNREACHED ? INT_MAX : d;
+            }
+            result.push_back(out);
+        }
+    }
+    return result;
+}
+// One distance array per source, same as distancesFrom for each of them (getAllNodes order,
+// INT_MAX when unreachable), computed PHAST_LANES sources per sweep
+
+vector<int> ContractionHierarchy::getOrder() {
+    if (stale)
+        build();
+
+    vector<int> order(nodeIds.size());
+    for (size_t v = 0; v < nodeIds.size(); v++)
+        order[position[v]] = nodeIds[v];
+    return order;
+}
+// Node IDs most important first, a good hub order for other speed-up techniques
+
+bool ContractionHierarchy::isStale() const {
+    return stale;
+}
+
+int ContractionHierarchy::getShortcutCount() const {
+    return shortcuts;
+}
+
+double ContractionHierarchy::getBuildSeconds() const {
+    return buildSeconds;
+}
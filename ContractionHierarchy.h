@@ -0,0 +1,45 @@
+#ifndef CONTRACTION_HIERARCHY_H
+#define CONTRACTION_HIERARCHY_H
+
+#include <vector>
+using namespace std;
+
+class Graph;
+
+#if defined(__AVX512F__)
+const int PHAST_LANES = 16; // sources per sweep, one 512-bit register of distances
+#elif defined(__AVX2__)
+const int PHAST_LANES = 8;  // one 256-bit register
+#else
+const int PHAST_LANES = 8;  // plain loop, the compiler may still vectorize it
+#endif
+
+class ContractionHierarchy {
+    Graph &graph;
+    int listenerHandle;
+    bool stale;
+    double buildSeconds;
+    int shortcuts;
+
+    vector<int> nodeIds;      // getAllNodes order, the order results come back in
+    vector<int> position;     // node index -> sweep position, most important node first
+    vector<int> upStart;      // sweep position -> first upward arc, upStart[n] = arc count
+    vector<int> upHead;       // sweep position of the more important end of each arc
+    vector<int> upWeight;
+
+    void upwardSearch(int source, vector<int> &dist, vector<int> &touched) const;
+    void sweep(vector<int> &lanes) const;
+
+public:
+    ContractionHierarchy(Graph &g);
+    ~ContractionHierarchy();
+
+    void build();
+    bool isStale() const;
+    vector<vector<int>> distancesFromMany(const vector<int> &sources);
+    vector<int> getOrder();
+    int getShortcutCount() const;
+    double getBuildSeconds() const;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include "Coverage.h"
+#include "Graph.h"
+#include "ResourceManager.h"
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+CoverageMap::CoverageMap(Graph &g, ResourceManager &r, int budgetMinutes)
+    : graph(g), rm(r) {
+    budget = budgetMinutes;
+    uncovered = 0;
+    listenerHandle = graph.addChangeListener([this](const vector<int> &roads) {
+        onRoadsChanged(roads);
+    });
+    rm.setObserver(this);
+    rebuild();
+}
+
+CoverageMap::~CoverageMap() {
+    rm.setObserver(nullptr);
+    graph.removeChangeListener(listenerHandle);
+}
+
+void CoverageMap::rebuild() {
+    nodeIds = graph.getAllNodes();
+    slot.clear();
+    for (int i = 0; i < (int)nodeIds.size(); i++)
+        slot[nodeIds[i]] = i;
+    builtLayout = graph.getLayoutVersion();
+
+    coverCount.assign(nodeIds.size(), 0);
+    uncovered = nodeIds.size();
+    reach.clear();
+    reachFrom.clear();
+
+    for (auto amb : rm.getAllAmbulances())
+        if (amb->isAvailable())
+            addUnit(*amb);
+}
+// Recomputes everything from scratch, needed only when the map itself is replaced
+
+bool CoverageMap::relayoutIfNeeded() {
+    if (builtLayout == graph.getLayoutVersion())
+        return false;
+    rebuild();
+    return true;
+}
+// A reload or a renumbering never calls us by itself, so the next event notices it instead
+
+void CoverageMap::addUnit(const Ambulance &amb) {
+    vector<int> &slots = reach[amb.getId()];
+    for (int node : graph.isochrone(amb.getLocation(), budget)) {
+        auto it = slot.find(node);
+        if (it == slot.end())
+            continue;
+
+        slots.push_back(it->second);
+        if (coverCount[it->second]++ == 0)
+            uncovered--;
+    }
+    sort(slots.begin(), slots.end());
+    reachFrom[amb.getId()] = amb.getLocation();
+}
+// Counts one more available unit on every node of its isochrone
+
+void CoverageMap::removeUnit(int ambId) {
+    auto it = reach.find(ambId);
+    if (it == reach.end())
+        return;
+
+    for (int s : it->second)
+        if (--coverCount[s] == 0)
+            uncovered++;
+
+    reach.erase(it);
+    reachFrom.erase(ambId);
+}
+// Takes back exactly what addUnit counted, even if roads changed in between
+
+void CoverageMap::onStatusChanged(const Ambulance &amb) {
+    if (relayoutIfNeeded())
+        return; // the rebuild already counted this unit as it is now
+
+    auto from = reachFrom.find(amb.getId());
+    bool tracked = from != reachFrom.end();
+
+    if (amb.isAvailable() && tracked && from->second == amb.getLocation())
+        return; // nothing moved
+    if (!amb.isAvailable() && !tracked)
+        return; // busy unit moving around
+
+    removeUnit(amb.getId());
+    if (amb.isAvailable())
+        addUnit(amb);
+}
+// Called on dispatchTo, setAvailable and setLocation, only the changed unit is recomputed
+
+void CoverageMap::onRemoved(const Ambulance &amb) {
+    removeUnit(amb.getId());
+}
+
+void CoverageMap::onRoadsChanged(const vector<int> &roads) {
+    if (relayoutIfNeeded())
+        return;
+
+    vector<int> touched; // slots at either end of a changed road
+    for (int id : roads) {
+        if (id >= graph.getEdgeCount())
+            continue;
+        Road r = graph.getRoad(id);
+        for (int node : {r.src, r.dest}) {
+            auto it = slot.find(node);
+            if (it != slot.end())
+                touched.push_back(it->second);
+        }
+    }
+
+    // a road can only change what a unit reaches if the unit already reaches one of its ends
+    vector<int> affected;
+    for (auto &unit : reach) {
+        for (int s : touched) {
+            if (binary_search(unit.second.begin(), unit.second.end(), s)) {
+                affected.push_back(unit.first);
+                break;
+            }
+        }
+    }
+
+    for (int ambId : affected) {
+        Ambulance* amb = rm.findAmbulanceById(ambId);
+        removeUnit(ambId);
+        if (amb && amb->isAvailable())
+            addUnit(*amb);
+    }
+}
+// Road closures, reopenings and weight changes recompute only the units near the change
+
+int CoverageMap::getCoverCount(int node) const {
+    auto it = slot.find(node);
+    if (it == slot.end())
+        return 0;
+    return coverCount[it->second];
+}
+
+int CoverageMap::getUncoveredCount() const {
+    return uncovered;
+}
+
+vector<int> CoverageMap::getUncoveredNodes() const {
+    vector<int> list;
+    for (int i = 0; i < (int)coverCount.size(); i++)
+        if (coverCount[i] == 0)
+            list.push_back(nodeIds[i]);
+    return list;
+}
+
+int CoverageMap::getBudget() const {
+    return budget;
+}
+
+void CoverageMap::display() const {
+    cout << "\nCoverage (" << budget << " min)\n";
+    cout << "Covered: " << nodeIds.size() - uncovered << "/" << nodeIds.size() << endl;
+
+    if (uncovered > 0) {
+        cout << "Uncovered: ";
+        int shown = 0;
+        for (int node : getUncoveredNodes()) {
+            if (shown++ == 20) {
+                cout << "...";
+                break;
+            }
+            cout << node << " ";
+        }
+        cout << endl;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <vector>
+#include <unordered_map>
+#include "Ambulance.h"
+using namespace std;
+
+class Graph;
+class ResourceManager;
+
+class CoverageMap : public AmbulanceObserver {
+    Graph &graph;
+    ResourceManager &rm;
+    int budget;                            // minutes a unit must reach a node within
+    int listenerHandle;
+
+    vector<int> nodeIds;                   // slot -> node ID
+    unordered_map<int, int> slot;          // node ID -> slot
+    vector<int> coverCount;                // available units covering each slot
+    unordered_map<int, vector<int>> reach; // ambulance ID -> sorted slots it covers
+    unordered_map<int, int> reachFrom;     // ambulance ID -> location its reach was computed at
+    int uncovered;
+    long long builtLayout;                 // graph layout the slots were taken from
+
+    bool relayoutIfNeeded();
+    void addUnit(const Ambulance &amb);
+    void removeUnit(int ambId);
+    void onRoadsChanged(const vector<int> &roads);
+
+public:
+    CoverageMap(Graph &g, ResourceManager &r, int budgetMinutes);
+    ~CoverageMap();
+
+    void onStatusChanged(const Ambulance &amb) override;
+    void onRemoved(const Ambulance &amb) override;
+
+    void rebuild();
+    int getCoverCount(int node) const;
+    int getUncoveredCount() const;
+    vector<int> getUncoveredNodes() const;
+    int getBudget() const;
+    void display() const;
+};
+
+#endif
@@ -0,0 +1,581 @@
+#include "DispatchServer.h"
+#include "Graph.h"
+#include "ResourceManager.h"
+#include "Incident.h"
+#include "StateLog.h"
+#include "ThreadPool.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "utils.h"
+#include <iostream>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+static const int EVENT_BATCH = 256;
+static const int READ_CHUNK = 16384;
+static const size_t MAX_LINE = 4096;             // longer requests close the connection
+static const int MAX_PIPELINE = 256;             // requests one connection may have in flight
+static const size_t MAX_PENDING_OUTPUT = 1 << 20; // stop reading from a client that doesn't read its replies
+static const int MAX_NEAREST = 10;
+
+static const char* VERB_NAMES[VERB_COUNT] = {"REPORT", "NEAREST", "ROUTE", "DISPATCH", "COMPLETE", "ROAD"};
+static const char* VERB_LABELS[VERB_COUNT] = {"report", "nearest", "route", "dispatch", "complete", "road"};
+
+static int stopFd = -1; // eventfd the signal handler rings
+
+static void onStopSignal(int) {
+    unsigned long long one = 1;
+    if (stopFd != -1 && write(stopFd, &one, sizeof(one)) < 0) {
+        // nothing to do inside a signal handler, the next signal tries again
+    }
+}
+
+static long long nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+DispatchServer::DispatchServer(Graph &g, ResourceManager &r, IncidentQueue &q, StateLog* log, int threadCount)
+    : graph(g), rm(r), incidents(q), journal(log), threads(threadCount),
+      listenFd(-1), epollFd(-1), wakeFd(-1), nextConnId(1), pool(nullptr), stopping(false) {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP); // a stream of queries can't starve a dispatch
+    pthread_rwlock_init(&stateLock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    MetricsRegistry &metrics = MetricsRegistry::instance();
+    for (int v = 0; v < VERB_COUNT; v++)
+        latency[v] = &metrics.histogram("ers_server_request_seconds", string("verb=\"") + VERB_LABELS[v] + "\"",
+                                        "Time from reading a request to queueing its reply");
+    connected = &metrics.gauge("ers_server_connections", "", "Open client connections");
+}
+
+DispatchServer::~DispatchServer() {
+    if (listenFd != -1)
+        close(listenFd);
+    if (!unixPath.empty())
+        unlink(unixPath.c_str());
+    pthread_rwlock_destroy(&stateLock);
+}
+
+bool DispatchServer::listenOn(int fd) {
+    if (listen(fd, SOMAXCONN) == -1 || !setNonBlocking(fd)) {
+        cout << "Listen failed: " << strerror(errno) << endl;
+        close(fd);
+        return false;
+    }
+    if (listenFd != -1)
+        close(listenFd);
+    listenFd = fd;
+    return true;
+}
+
+bool DispatchServer::listenUnix(const string &path) {
+    sockaddr_un addr = {};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cout << "Socket path too long\n";
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str()); // left over from a server that didn't shut down cleanly
+    if (fd == -1 || bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        cout << "Bind failed: " << strerror(errno) << endl;
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+
+    unixPath = path;
+    return listenOn(fd);
+}
+
+bool DispatchServer::listenTcp(int port) {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // local dispatch consoles only
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    if (fd == -1 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+        bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        cout << "Bind failed: " << strerror(errno) << endl;
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+    return listenOn(fd);
+}
+
+void DispatchServer::run() {
+    if (listenFd == -1) {
+        cout << "Not listening\n";
+        return;
+    }
+
+    // thousands of clients need thousands of descriptors
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    epollFd = epoll_create1(0);
+    wakeFd = eventfd(0, EFD_NONBLOCK);
+    stopFd = eventfd(0, EFD_NONBLOCK);
+    for (int fd : {listenFd, wakeFd, stopFd}) {
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    struct sigaction stopAction = {}, oldInt, oldTerm;
+    stopAction.sa_handler = onStopSignal;
+    sigemptyset(&stopAction.sa_mask);
+    sigaction(SIGINT, &stopAction, &oldInt);
+    sigaction(SIGTERM, &stopAction, &oldTerm);
+
+    pool = new ThreadPool(threads);
+    stopping = false;
+    changeThread = thread(&DispatchServer::changeLoop, this);
+    cout << "Dispatch server ready (" << pool->size() << " query threads), Ctrl+C stops it" << endl;
+
+    epoll_event events[EVENT_BATCH];
+    bool running = true;
+    while (running) {
+        int n = epoll_wait(epollFd, events, EVENT_BATCH, -1);
+        if (n == -1 && errno != EINTR)
+            break;
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptAll();
+            } else if (fd == wakeFd) {
+                unsigned long long count;
+                if (read(wakeFd, &count, sizeof(count)) > 0)
+                    sendReplies();
+            } else if (fd == stopFd) {
+                running = false;
+            } else if (conns.count(fd)) {
+                if ((events[i].events & (EPOLLHUP | EPOLLERR)) && conns[fd].peerClosed)
+                    closeConnection(fd); // gone both ways, its replies can't be delivered
+                else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    readFrom(fd);
+                if (conns.count(fd) && (events[i].events & EPOLLOUT))
+                    flush(fd);
+            }
+        }
+    }
+
+    cout << "Stopping dispatch server..." << endl;
+    {
+        lock_guard<mutex> guard(changeLock);
+        stopping = true;
+    }
+    changeWake.notify_one();
+    changeThread.join();   // changes already accepted are applied and logged
+    pool->waitAll();
+    delete pool;
+    pool = nullptr;
+    replies.clear();
+
+    vector<int> open;
+    for (auto &c : conns)
+        open.push_back(c.first);
+    for (int fd : open)
+        closeConnection(fd);
+
+    sigaction(SIGINT, &oldInt, nullptr);
+    sigaction(SIGTERM, &oldTerm, nullptr);
+    close(stopFd);
+    stopFd = -1;
+    close(wakeFd);
+    close(epollFd);
+    close(listenFd);
+    listenFd = -1;
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+        unixPath.clear();
+    }
+}
+// Event loop on the calling thread: it only moves bytes, queries go to the thread pool
+// and changes to a single change thread, replies come back through wakeFd
+
+void DispatchServer::acceptAll() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+            return; // EAGAIN: accepted everyone waiting, other errors: try again on the next event
+
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // fails harmlessly on Unix sockets
+
+        Connection &conn = conns[fd];
+        conn = {nextConnId++, "", "", 0, 0, 0, false, EPOLLIN};
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+        connected->add(1);
+    }
+}
+
+void DispatchServer::readFrom(int fd) {
+    Connection &conn = conns[fd];
+    char buffer[READ_CHUNK];
+    ssize_t got = read(fd, buffer, sizeof(buffer));
+
+    if (got == 0 || (got == -1 && errno != EAGAIN && errno != EINTR)) {
+        conn.peerClosed = true;
+        if (got == -1 || (conn.inFlight == 0 && conn.outSent == conn.out.size())) {
+            closeConnection(fd);
+            return;
+        }
+        updateInterest(fd, conn); // finish the replies first
+        return;
+    }
+    if (got < 0)
+        return;
+
+    conn.in.append(buffer, got);
+    size_t start = 0, end;
+    while ((end = conn.in.find('\n', start)) != string::npos) {
+        handleLine(fd, conn, conn.in.substr(start, end - start));
+        start = end + 1;
+    }
+    conn.in.erase(0, start);
+
+    if (conn.in.size() > MAX_LINE) {
+        closeConnection(fd);
+        return;
+    }
+    flush(fd);
+}
+// One read per readiness event, so a busy client can't hold up the others
+
+void DispatchServer::handleLine(int fd, Connection &conn, const string &line) {
+    string text = line;
+    if (!text.empty() && text.back() == '\r')
+        text.pop_back();
+    if (text.empty())
+        return;
+
+    ServerRequest req;
+    req.fd = fd;
+    req.connId = conn.id;
+    req.received = nowNs();
+    for (auto &w : split(text, ' '))
+        if (!w.empty())
+            req.words.push_back(w);
+
+    if (req.words.empty())
+        return;
+    if (req.words.size() < 2) {
+        conn.out += req.words[0] + " ERR missing request\n";
+        return;
+    }
+    int verb = 0;
+    while (verb < VERB_COUNT && req.words[1] != VERB_NAMES[verb])
+        verb++;
+    if (verb == VERB_COUNT) {
+        conn.out += req.words[0] + " ERR unknown request\n";
+        return;
+    }
+    req.verb = (RequestVerb)verb;
+
+    // changes keep their order, a query sent after a change waits for it so it sees the result
+    bool change = req.verb == VERB_REPORT || req.verb == VERB_DISPATCH ||
+                  req.verb == VERB_COMPLETE || req.verb == VERB_ROAD;
+    conn.inFlight++;
+    if (change || conn.changesInFlight > 0) {
+        conn.changesInFlight++;
+        {
+            lock_guard<mutex> guard(changeLock);
+            changes.push_back(req);
+        }
+        changeWake.notify_one();
+    } else {
+        pool->submit([this, req] {
+            pthread_rwlock_rdlock(&stateLock);
+            string result = execute(req);
+            pthread_rwlock_unlock(&stateLock);
+            post(req, false, result);
+        });
+    }
+}
+// Requests are "tag VERB args...", replies "tag OK ..." or "tag ERR reason", so a client can
+// pipeline many requests and match the replies, which may come back in a different order
+
+string DispatchServer::execute(const ServerRequest &req) {
+    TRACE_SPAN_ARG("server", VERB_LABELS[req.verb], req.connId);
+    const vector<string> &w = req.words;
+
+    try {
+        switch (req.verb) {
+            case VERB_REPORT: {
+                if (w.size() < 4)
+                    return "ERR usage: REPORT node priority [description]";
+                int node = stoi(w[2]);
+                string pri = w[3];
+                for (char &c : pri)
+                    c = toupper(c);
+                if (pri != "HIGH" && pri != "MEDIUM" && pri != "LOW")
+                    return "ERR priority must be HIGH, MEDIUM or LOW";
+                if (!graph.hasNode(node))
+                    return "ERR unknown location";
+
+                string desc;
+                for (int i = 4; i < (int)w.size(); i++)
+                    desc += (i > 4 ? " " : "") + w[i];
+                return "OK " + to_string(incidents.addIncident(node, pri, desc)->getId());
+            }
+
+            case VERB_NEAREST: {
+                if (w.size() < 3)
+                    return "ERR usage: NEAREST node [count]";
+                int node = stoi(w[2]);
+                int k = w.size() >= 4 ? max(1, min(MAX_NEAREST, stoi(w[3]))) : 1;
+                if (!graph.hasNode(node))
+                    return "ERR unknown location";
+
+                auto units = rm.findKNearest(node, k, graph);
+                if (units.empty())
+                    return "ERR no unit available";
+                string out = "OK";
+                for (auto &u : units)
+                    out += " " + to_string(u.amb->getId()) + ":" + to_string(u.eta);
+                return out;
+            }
+
+            case VERB_ROUTE: {
+                if (w.size() < 4)
+                    return "ERR usage: ROUTE from to";
+                int from = stoi(w[2]), to = stoi(w[3]);
+                vector<int> route;
+                int eta = graph.findRoute(from, to, currentMinuteOfDay(), route);
+                if (eta == INT_MAX)
+                    return "ERR no route";
+
+                string out = "OK " + to_string(eta) + " " + to_string(from);
+                int at = from;
+                for (int id : route) { // edge IDs to the places driven through
+                    Road r = graph.getRoad(id);
+                    at = r.src == at ? r.dest : r.src;
+                    out += " " + to_string(at);
+                }
+                return out;
+            }
+
+            case VERB_DISPATCH: {
+                if (w.size() < 4)
+                    return "ERR usage: DISPATCH unit incident";
+                int ambId = stoi(w[2]), incId = stoi(w[3]);
+                Ambulance* amb = rm.findAmbulanceById(ambId);
+                if (!amb)
+                    return "ERR unknown unit";
+                if (!amb->isAvailable())
+                    return "ERR unit busy";
+
+                for (auto inc : incidents.getAllIncidents()) {
+                    if (inc->getId() != incId)
+                        continue;
+                    if (inc->isResolved())
+                        return "ERR incident already resolved";
+                    rm.dispatchAmbulance(ambId, incId, inc->getLocation());
+                    return "OK";
+                }
+                return "ERR unknown incident";
+            }
+
+            case VERB_COMPLETE: {
+                if (w.size() < 3)
+                    return "ERR usage: COMPLETE unit";
+                Ambulance* amb = rm.findAmbulanceById(stoi(w[2]));
+                if (!amb)
+                    return "ERR unknown unit";
+                if (amb->isAvailable())
+                    return "ERR unit not on a call";
+
+                int incId = amb->getAssignedIncident();
+                rm.completeAssignment(amb->getId());
+                incidents.resolveIncident(incId);
+                return "OK " + to_string(incId);
+            }
+
+            case VERB_ROAD: {
+                if (w.size() < 5)
+                    return "ERR usage: ROAD src dest minutes|BLOCK|OPEN";
+                int src = stoi(w[2]), dest = stoi(w[3]);
+                if (graph.getEdgeId(src, dest) == -1)
+                    return "ERR unknown road";
+
+                if (w[4] == "BLOCK") {
+                    graph.markRoadBlocked(src, dest);
+                } else if (w[4] == "OPEN") {
+                    graph.markRoadOpen(src, dest);
+                } else {
+                    int minutes = stoi(w[4]);
+                    if (minutes < 0)
+                        return "ERR minutes must not be negative";
+                    graph.updateEdgeWeight(src, dest, minutes);
+                }
+                return "OK";
+            }
+
+            default:
+                return "ERR unknown request";
+        }
+    } catch (const exception &) { // stoi on something that isn't a number
+        return "ERR bad number";
+    }
+}
+// Runs one request, the caller holds stateLock (shared for queries, alone for changes)
+
+void DispatchServer::changeLoop() {
+    while (true) {
+        deque<ServerRequest> batch;
+        {
+            unique_lock<mutex> guard(changeLock);
+            changeWake.wait(guard, [this] { return stopping || !changes.empty(); });
+            if (changes.empty())
+                return; // stopping and nothing left
+            batch.swap(changes);
+        }
+
+        vector<string> results;
+        pthread_rwlock_wrlock(&stateLock);
+        for (auto &req : batch)
+            results.push_back(execute(req));
+        pthread_rwlock_unlock(&stateLock);
+
+        if (journal)
+            journal->commit(); // one flush covers everything that queued up meanwhile
+
+        for (int i = 0; i < (int)batch.size(); i++)
+            post(batch[i], true, results[i]);
+    }
+}
+// Changes that arrive while a batch is applied or flushed form the next batch,
+// so under load many dispatches share one disk flush and replies only go out once it is done
+
+void DispatchServer::post(const ServerRequest &req, bool change, const string &result) {
+    ServerReply reply = {req.fd, req.connId, req.verb, change, req.words[0] + " " + result + "\n", req.received};
+    bool first;
+    {
+        lock_guard<mutex> guard(replyLock);
+        first = replies.empty();
+        replies.push_back(move(reply));
+    }
+
+    unsigned long long one = 1;
+    if (first && write(wakeFd, &one, sizeof(one)) < 0) {
+        // the counter can't overflow in practice, the loop is woken anyway
+    }
+}
+// Only the first reply of a batch rings the event loop, it takes the whole batch at once
+
+void DispatchServer::sendReplies() {
+    vector<ServerReply> ready;
+    {
+        lock_guard<mutex> guard(replyLock);
+        ready.swap(replies);
+    }
+
+    long long now = nowNs();
+    vector<int> touched;
+    for (auto &reply : ready) {
+        latency[reply.verb]->record(now - reply.received);
+
+        auto it = conns.find(reply.fd);
+        if (it == conns.end() || it->second.id != reply.connId)
+            continue; // the client left before its reply was ready
+
+        Connection &conn = it->second;
+        conn.inFlight--;
+        if (reply.change)
+            conn.changesInFlight--;
+        conn.out += reply.line;
+        touched.push_back(reply.fd);
+    }
+
+    for (int fd : touched)
+        if (conns.count(fd))
+            flush(fd);
+}
+
+void DispatchServer::flush(int fd) {
+    Connection &conn = conns[fd];
+    while (conn.outSent < conn.out.size()) {
+        ssize_t sent = send(fd, conn.out.data() + conn.outSent, conn.out.size() - conn.outSent, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            if (sent == -1 && (errno == EAGAIN || errno == EINTR))
+                break; // socket full, EPOLLOUT tells us when to go on
+            closeConnection(fd);
+            return;
+        }
+        conn.outSent += sent;
+    }
+
+    if (conn.outSent == conn.out.size()) {
+        conn.out.clear();
+        conn.outSent = 0;
+    } else if (conn.outSent > READ_CHUNK) {
+        conn.out.erase(0, conn.outSent);
+        conn.outSent = 0;
+    }
+
+    if (conn.peerClosed && conn.inFlight == 0 && conn.out.empty()) {
+        closeConnection(fd);
+        return;
+    }
+    updateInterest(fd, conn);
+}
+
+void DispatchServer::updateInterest(int fd, Connection &conn) {
+    unsigned want = 0;
+    if (!conn.peerClosed && conn.inFlight < MAX_PIPELINE && conn.out.size() - conn.outSent < MAX_PENDING_OUTPUT)
+        want |= EPOLLIN;
+    if (conn.outSent < conn.out.size())
+        want |= EPOLLOUT;
+
+    if (want != conn.events) {
+        epoll_event ev = {};
+        ev.events = want;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+        conn.events = want;
+    }
+}
+// Backpressure: a client with too many requests in flight or too many unread replies isn't read from
+
+void DispatchServer::closeConnection(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    conns.erase(fd);
+    connected->add(-1);
+}
@@ -0,0 +1,103 @@
+#ifndef DISPATCH_SERVER_H
+#define DISPATCH_SERVER_H
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <pthread.h>
+using namespace std;
+
+class Graph;
+class ResourceManager;
+class IncidentQueue;
+class StateLog;
+class ThreadPool;
+class Histogram;
+class Gauge;
+
+enum RequestVerb { VERB_REPORT, VERB_NEAREST, VERB_ROUTE, VERB_DISPATCH, VERB_COMPLETE, VERB_ROAD, VERB_COUNT };
+
+struct ServerRequest {
+    int fd;                 // connection it came from
+    long long connId;       // tells a reused fd apart from the connection that sent it
+    RequestVerb verb;
+    vector<string> words;   // tag, verb, arguments
+    long long received;     // steady clock nanoseconds when the line was read
+};
+
+struct ServerReply {
+    int fd;
+    long long connId;
+    RequestVerb verb;
+    bool change;            // came through the change queue
+    string line;            // full response line, tag first
+    long long received;
+};
+
+class DispatchServer {
+    struct Connection {
+        long long id;
+        string in;          // bytes read, not yet a full line
+        string out;         // responses not written yet
+        size_t outSent;     // part of out already written
+        int inFlight;       // requests handed to workers, no reply yet
+        int changesInFlight;
+        bool peerClosed;    // the client is done sending, close once every reply is out
+        unsigned events;    // epoll interest currently registered
+    };
+
+    Graph &graph;
+    ResourceManager &rm;
+    IncidentQueue &incidents;
+    StateLog* journal;      // every change is on disk before its reply goes out when set
+    int threads;
+
+    int listenFd;
+    int epollFd;
+    int wakeFd;             // eventfd, workers ring it when replies are ready
+    string unixPath;        // removed again on shutdown
+    unordered_map<int, Connection> conns;
+    long long nextConnId;
+
+    pthread_rwlock_t stateLock; // queries share it, changes take it alone, waiting changes go first
+    ThreadPool* pool;           // queries run here
+
+    mutex changeLock;
+    condition_variable changeWake;
+    deque<ServerRequest> changes;   // applied one at a time, in arrival order
+    bool stopping;
+    thread changeThread;
+
+    mutex replyLock;
+    vector<ServerReply> replies;    // finished work for the event loop to send
+
+    Histogram* latency[VERB_COUNT];
+    Gauge* connected;
+
+    bool listenOn(int fd);
+    void acceptAll();
+    void readFrom(int fd);
+    void handleLine(int fd, Connection &conn, const string &line);
+    void sendReplies();
+    void flush(int fd);
+    void updateInterest(int fd, Connection &conn);
+    void closeConnection(int fd);
+
+    string execute(const ServerRequest &req);
+    void changeLoop();
+    void post(const ServerRequest &req, bool change, const string &result);
+
+public:
+    DispatchServer(Graph &g, ResourceManager &r, IncidentQueue &q, StateLog* log, int threadCount = 0);
+    ~DispatchServer();
+
+    bool listenUnix(const string &path);
+    bool listenTcp(int port);
+    void run();
+};
+
+#endif
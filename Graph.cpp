@@ -1,61 +1,201 @@
 #include "Graph.h"
 #include "utils.h"
+#include "ThreadPool.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstdlib>
+#include <thread>
 
 using namespace std;
 
-Graph::Graph() {}
+Graph::Graph() {
+    version = 0;
+    layoutVersion = 0;
+    maxWeight = 0;
+    queueKind = QUEUE_AUTO;
+    verbose = true;
+}
+
+Graph::Graph(const Graph &other)
+    : adj(other.adj), nodes(other.nodes), nodeIndex(other.nodeIndex), blockedRoads(other.blockedRoads),
+      roadBlocked(other.roadBlocked), roads(other.roads), roadIds(other.roadIds), profiles(other.profiles),
+      version(other.version), layoutVersion(other.layoutVersion), maxWeight(other.maxWeight), queueKind(other.queueKind), verbose(other.verbose) {}
+// A working copy of the map for simulations and benchmarks; the change listeners (state log,
+// coverage, reassigner...) stay with the original, so nothing done to the copy reaches them
 
 void Graph::addNode(int nodeId) {
-    if (find(nodes.begin(), nodes.end(), nodeId) == nodes.end()) {
+    if (nodeIndex.find(nodeId) == nodeIndex.end()) {
+        nodeIndex[nodeId] = nodes.size();
         nodes.push_back(nodeId);
+        adj.push_back({});
+        layoutVersion++;
     }
-} // adds a new location to map, avoid  duplicates using find()
+} // adds a new location to map, avoid duplicates using the node index
 
 void Graph::addEdge(int src, int dest, int weight) {
     addNode(src);
     addNode(dest);
 
-    adjList[src].push_back({dest, weight}); // adds road from src to dest
-    adjList[dest].push_back({src, weight}); // adds road from dest to src
+    int s = nodeIndex[src];
+    int d = nodeIndex[dest];
+
+    Road road;
+    road.src = src;
+    road.dest = dest;
+    road.weight = weight;
+    road.profile = -1;
+    int id = roads.size();
+
+    road.srcSlot = adj[s].size();
+    adj[s].push_back({d, weight, id}); // adds road from src to dest
+    road.destSlot = adj[d].size();
+    adj[d].push_back({s, weight, id}); // adds road from dest to src
+
+    roads.push_back(road);
+    maxWeight = max(maxWeight, weight);
+    roadBlocked.push_back(isRoadBlocked(src, dest));
+    roadIds.insert({{min(src, dest), max(src, dest)}, id}); // keeps the first ID if the road is duplicated
 }
-// Adds a bidirectional road between two locations
+// Adds a bidirectional road between two locations and gives it the next edge ID
 
 void Graph::updateEdgeWeight(int src, int dest, int newWeight) {
-    bool found = false;
+    int id = getEdgeId(src, dest);
 
-    for (auto &n : adjList[src]) { // Update src→dest direction
-        if (n.first == dest) {
-            n.second = newWeight;
-            found = true;
-            break;
-        }
+    if (id != -1 && applyWeightUpdates({{id, newWeight}}) == 1) {
+        if (verbose)
+            cout << "Road updated\n";
+    } else {
+        cout << "Road not found\n";
+    }
+}
+
+int Graph::applyWeightUpdates(const vector<pair<int, int>> &updates) {
+    TRACE_SPAN("graph", "apply_weight_updates");
+    vector<int> changed;
+    changed.reserve(updates.size());
+
+    for (auto &u : updates) {
+        int id = u.first;
+        int w = u.second;
+        if (id < 0 || id >= (int)roads.size() || w < 0)
+            continue; // skip unknown roads and invalid weights
+
+        Road &r = roads[id];
+        r.weight = w;
+        maxWeight = max(maxWeight, w);
+        adj[nodeIndex[r.src]][r.srcSlot].weight = w;   // src->dest direction
+        adj[nodeIndex[r.dest]][r.destSlot].weight = w; // dest->src direction
+        changed.push_back(id);
     }
 
-    for (auto &n : adjList[dest]) { // Update dest→src direction
-        if (n.first == src) {
-            n.second = newWeight;
-            break;
+    if (changed.empty())
+        return 0;
+
+    int applied = changed.size();
+    sort(changed.begin(), changed.end()); // a feed may touch the same road several times per batch
+    changed.erase(unique(changed.begin(), changed.end()), changed.end());
+    notifyListeners(changed);
+    return applied;
+}
+// Applies a batch of (edge ID, new weight) changes in one pass
+// Every road is reached directly through its slots, no adjacency scans and no output per road
+// Listeners hear about the batch once, returns how many updates were applied
+
+int Graph::getEdgeId(int src, int dest) const {
+    auto it = roadIds.find({min(src, dest), max(src, dest)});
+    if (it == roadIds.end())
+        return -1;
+    return it->second;
+} // Returns the edge ID of the road between two locations, -1 if there is none
+
+vector<int> Graph::getEdgeIds(int src, int dest) const {
+    vector<int> ids;
+    int s = indexOf(src);
+    int d = indexOf(dest);
+    if (s == -1 || d == -1)
+        return ids;
+
+    for (auto &arc : adj[s])
+        if (arc.to == d)
+            ids.push_back(arc.road);
+    return ids;
+}
+// Every road between two locations, duplicates included, the roads markRoadBlocked closes
+
+int Graph::getEdgeCount() const {
+    return roads.size();
+}
+
+Road Graph::getRoad(int edgeId) const {
+    return roads[edgeId];
+}
+
+int Graph::addChangeListener(RoadChangeListener listener) {
+    listeners.push_back(listener);
+    return listeners.size() - 1;
+}
+// Caches and preprocessed routing data register here to learn about changed roads
+// Returns a handle for removeChangeListener
+
+void Graph::removeChangeListener(int handle) {
+    if (handle >= 0 && handle < (int)listeners.size())
+        listeners[handle] = nullptr; // keep the slot so other handles stay valid
+}
+
+long long Graph::getVersion() const {
+    return version;
+}
+
+long long Graph::getLayoutVersion() const {
+    return layoutVersion;
+}
+// Changes whenever getAllNodes would answer differently; road changes leave it alone, so
+// anything kept by node position checks this rather than waiting for a listener call
+
+void Graph::notifyListeners(const vector<int> &changedRoads) {
+    version++;
+    for (auto &listener : listeners)
+        if (listener)
+            listener(changedRoads);
+}
+
+void Graph::setPairBlocked(int src, int dest, bool blocked) {
+    int s = indexOf(src);
+    int d = indexOf(dest);
+    if (s == -1 || d == -1)
+        return;
+
+    vector<int> changed;
+    for (auto &arc : adj[s]) {
+        if (arc.to == d) { // every road between the pair, duplicates included
+            roadBlocked[arc.road] = blocked;
+            changed.push_back(arc.road);
         }
     }
 
-    if (found)
-        cout << "Road updated\n";
-    else
-        cout << "Road not found\n";
+    if (!changed.empty())
+        notifyListeners(changed);
 }
+// Keeps roadBlocked in step with blockedRoads and tells listeners which roads changed
 
 void Graph::markRoadBlocked(int src, int dest) {
+    TRACE_SPAN("graph", "block_road");
     blockedRoads[{min(src, dest), max(src, dest)}] = true; // mark road as blocked in both directions
-    cout << "Road blocked\n";
+    setPairBlocked(src, dest, true);
+    if (verbose)
+        cout << "Road blocked\n";
 }
 
 
 void Graph::markRoadOpen(int src, int dest) {
+    TRACE_SPAN("graph", "open_road");
     blockedRoads.erase({min(src, dest), max(src, dest)});
-    cout << "Road opened\n";
+    setPairBlocked(src, dest, false);
+    if (verbose)
+        cout << "Road opened\n";
 }
 
 bool Graph::isRoadBlocked(int src, int dest) const {
@@ -63,111 +203,847 @@ bool Graph::isRoadBlocked(int src, int dest) const {
 }
 // Checks if road is blocked returns: true if road is in blockedRoads map
 
+int Graph::indexOf(int nodeId) const {
+    auto it = nodeIndex.find(nodeId);
+    if (it == nodeIndex.end())
+        return -1;
+    return it->second;
+} // Internal index of a node ID, -1 if the node is not on the map
+
+int Graph::maxRoadTime(bool timed) const {
+    if (!timed)
+        return maxWeight;
+    return (int)((long long)maxWeight * profiles.maxPercent() / 100) + 1; // +1 for rounding
+}
+// No road can take longer than this, with traffic when timed
+
+QueueKind Graph::chooseQueue(bool timed) const {
+    if (queueKind != QUEUE_AUTO)
+        return queueKind;
+    if (maxRoadTime(timed) <= DIAL_MAX_WEIGHT)
+        return QUEUE_DIAL;
+    return QUEUE_RADIX_HEAP;
+}
+// Small integer road times suit Dial's buckets, the radix heap copes with any size
+
+void Graph::setQueueKind(QueueKind kind) {
+    queueKind = kind;
+}
+// Forces one queue for every search, QUEUE_AUTO goes back to choosing by road times
+
+template <class Body>
+auto Graph::withQueue(bool timed, Body body) {
+    switch (chooseQueue(timed)) {
+        case QUEUE_DIAL: {
+            DialQueue pq(maxRoadTime(timed));
+            return body(pq);
+        }
+        case QUEUE_RADIX_HEAP: {
+            RadixHeapQueue pq;
+            return body(pq);
+        }
+        default: {
+            BinaryHeapQueue pq;
+            return body(pq);
+        }
+    }
+}
+// Runs a search body with the chosen queue, every search goes through here
+
+bool Graph::hasNode(int nodeId) const {
+    return indexOf(nodeId) != -1;
+}
+
+int Graph::getNodeCount() const {
+    return nodes.size();
+}
+
+long long Graph::getMemoryBytes() const {
+    const long long ALLOC = 16;        // bookkeeping malloc keeps next to every block
+    const long long HASH_NODE = 16;    // next pointer and the (ID, index) pair
+    const long long TREE_NODE = 32;    // colour, parent and two child pointers
+
+    long long bytes = adj.capacity() * sizeof(vector<Arc>);
+    for (auto &list : adj)
+        if (list.capacity() > 0)
+            bytes += list.capacity() * sizeof(Arc) + ALLOC;
+    bytes += nodes.capacity() * sizeof(int);
+    bytes += nodeIndex.bucket_count() * sizeof(void*) + nodeIndex.size() * (HASH_NODE + ALLOC);
+    bytes += roads.capacity() * sizeof(Road) + roadBlocked.capacity();
+    bytes += roadIds.size() * (TREE_NODE + sizeof(pair<const pair<int, int>, int>) + ALLOC);
+    bytes += blockedRoads.size() * (TREE_NODE + sizeof(pair<const pair<int, int>, bool>) + ALLOC);
+    return bytes;
+}
+// Estimate of what the map structures take, allocator overhead included (profiles not counted)
 
 vector<pair<int, int>> Graph::getNeighbors(int node) {
-    return adjList[node];
+    vector<pair<int, int>> list;
+    int idx = indexOf(node);
+    if (idx == -1)
+        return list;
+
+    for (auto &arc : adj[idx])
+        list.push_back({nodes[arc.to], arc.weight});
+    return list;
 } // Returns all roads connected to a node
 
 vector<int> Graph::getAllNodes() {
     return nodes;
 }
 
+void Graph::reorderNodes() {
+    int n = nodes.size();
+    if (n < 2)
+        return;
+
+    vector<int> byDegree(n);
+    for (int v = 0; v < n; v++)
+        byDegree[v] = v;
+    stable_sort(byDegree.begin(), byDegree.end(), [&](int a, int b) {
+        return adj[a].size() < adj[b].size();
+    });
+
+    vector<int> order;
+    order.reserve(n);
+    vector<char> placed(n, 0);
+    vector<int> level(n, -1); // scratch for finding a start node
+    vector<int> next;
+
+    for (int seed : byDegree) {
+        if (placed[seed])
+            continue;
+
+        // start from the far end of the component, found by a BFS from its lowest degree node
+        vector<int> reached = {seed};
+        level[seed] = 0;
+        for (size_t i = 0; i < reached.size(); i++)
+            for (auto &arc : adj[reached[i]])
+                if (level[arc.to] == -1) {
+                    level[arc.to] = level[reached[i]] + 1;
+                    reached.push_back(arc.to);
+                }
+        int start = reached.back();
+        for (int v : reached)
+            level[v] = -1;
+
+        // Cuthill-McKee: BFS taking each node's new neighbours lowest degree first
+        size_t first = order.size();
+        order.push_back(start);
+        placed[start] = 1;
+        for (size_t i = first; i < order.size(); i++) {
+            next.clear();
+            for (auto &arc : adj[order[i]])
+                if (!placed[arc.to]) {
+                    placed[arc.to] = 1;
+                    next.push_back(arc.to);
+                }
+            stable_sort(next.begin(), next.end(), [&](int a, int b) {
+                return adj[a].size() < adj[b].size();
+            });
+            order.insert(order.end(), next.begin(), next.end());
+        }
+    }
+    reverse(order.begin(), order.end());
+
+    vector<int> newIndex(n);
+    for (int i = 0; i < n; i++)
+        newIndex[order[i]] = i;
+
+    // adjacency lists move whole, so the slots kept in every Road stay valid
+    vector<vector<Arc>> newAdj(n);
+    vector<int> newNodes(n);
+    for (int v = 0; v < n; v++) {
+        for (auto &arc : adj[v])
+            arc.to = newIndex[arc.to];
+        newAdj[newIndex[v]].swap(adj[v]);
+        newNodes[newIndex[v]] = nodes[v];
+        nodeIndex[nodes[v]] = newIndex[v];
+    }
+    adj.swap(newAdj);
+    nodes.swap(newNodes);
+    version++;
+    layoutVersion++; // anything kept by internal index (getAllNodes order) is out of date
+}
+// Reverse Cuthill-McKee renumbering: roads mostly join nodes with nearby indexes, so a search
+// touches neighbouring memory instead of jumping around in whatever order the file listed them
+// Node IDs are untouched, only the getAllNodes order (and so the distancesFrom layout) changes
+
 int Graph::dijkstra(int start, int end) {
+    return search(start, end, false, -1);
+}
+
+int Graph::dijkstraWithBlocked(int start, int end) {
+    return search(start, end, true, -1);
+}
+
+int Graph::dijkstraAt(int start, int end, int departMinute) {
+    return search(start, end, true, departMinute);
+}
+// Time-dependent Dijkstra: same search as dijkstraWithBlocked, but every road is priced
+// with its traffic profile at the time we would reach it when leaving at departMinute
+
+int Graph::findRoute(int start, int end, int departMinute, vector<int> &route) {
+    return search(start, end, true, departMinute, &route);
+}
+// Same search as dijkstraAt, also fills route with the edge IDs driven, in order
+// (departMinute -1 uses the static weights)
+
+struct SearchMetrics {
+    const char* kind;
+    Histogram &latency;
+    Counter &settled;
+    Counter &relaxed;
+    Counter &pushes;
+};
+
+static SearchMetrics makeSearchMetrics(const char* kind) {
+    MetricsRegistry &registry = MetricsRegistry::instance();
+    string label = "kind=\"" + string(kind) + "\"";
+    return {kind,
+            registry.histogram("ers_search_seconds", label, "Point-to-point search time"),
+            registry.counter("ers_search_settled_nodes_total", label, "Nodes settled by point-to-point searches"),
+            registry.counter("ers_search_relaxed_edges_total", label, "Roads looked at by point-to-point searches"),
+            registry.counter("ers_search_heap_pushes_total", label, "Queue pushes by point-to-point searches")};
+}
+
+static SearchMetrics &searchMetrics(bool avoidBlocked, int departMinute) {
+    static SearchMetrics plain = makeSearchMetrics("dijkstra");
+    static SearchMetrics blocked = makeSearchMetrics("dijkstra_blocked");
+    static SearchMetrics timed = makeSearchMetrics("dijkstra_timed");
+    if (departMinute >= 0)
+        return timed;
+    return avoidBlocked ? blocked : plain;
+}
+// Looked up once, searches then only add to per-thread counters
+
+int Graph::search(int start, int end, bool avoidBlocked, int departMinute, vector<int> *route) {
+    SearchMetrics &metrics = searchMetrics(avoidBlocked, departMinute);
+    ScopedTimer timer(metrics.latency);
+    TRACE_SPAN_ARG("graph", metrics.kind, start);
+
+    if (route)
+        route->clear();
     if (start == end)
         return 0;
 
-    // like a to do list values will be pushed and sorted
-    // in <int, int> first int is distance, second is node id
-    priority_queue<pair<int, int>, // what we store
-                   vector<pair<int, int>>, // How to store it
-                   greater<pair<int, int>>> pq; // how to sort smallest first
-
-    map<int, int> dist; // map to store distances
-    for (int n : nodes)
-        dist[n] = INT_MAX; // Initialize all distances to infinity
-
-    dist[start] = 0; // Distance to start node is 0
-    pq.push({0, start});
-
-while (!pq.empty()) {
-    // 5. Take the CLOSEST place from to-do list
-    int currentDist = pq.top().first;   // Time to get here
-    int currentNode = pq.top().second;  // Where we are
-    pq.pop();  // Remove from to-do list
-    
-    // 6. Found destination? Return the time!
-    if (currentNode == end)
-        return currentDist;
-    
-    // 7. Skip if we found a better path already
-    if (currentDist > dist[currentNode])
-        continue;
-
-    // 8. Check all roads from current location
-    for (auto neighbor : adjList[currentNode]) {
-        int nextNode = neighbor.first;   // The neighbor
-        int roadTime = neighbor.second;  // Time to travel this road
-        
-        // 9. Calculate: time to current + time to neighbor
-        int totalTime = currentDist + roadTime;
-        
-        // 10. Is this FASTER than previous best?
-        if (totalTime < dist[nextNode]) {
-            // YES! Found a better route
-            dist[nextNode] = totalTime;           // Update diary
-            pq.push({totalTime, nextNode});       // Add to to-do list
+    int s = indexOf(start);
+    int e = indexOf(end);
+    if (s == -1 || e == -1)
+        return INT_MAX; // unknown places can't be reached
+
+    long long settled = 0, relaxed = 0, pushes = 1; // tallied here, added to the metrics once per search
+
+    // like a to do list, the queue hands out (distance, node index) smallest distance first
+    int result = withQueue(departMinute >= 0, [&](auto &pq) {
+        vector<int> dist(nodes.size(), INT_MAX); // Initialize all distances to infinity
+        vector<pair<int, int>> via; // (previous node, road) of each node, only kept when the route is wanted
+        if (route)
+            via.assign(nodes.size(), {-1, -1});
+
+        dist[s] = 0; // Distance to start node is 0
+        pq.push(0, s);
+
+        while (!pq.empty()) {
+            // Take the CLOSEST place from to-do list
+            pair<int, int> top = pq.pop();
+            int currentDist = top.first;   // Time to get here
+            int currentNode = top.second;  // Where we are
+
+            // Found destination? Return the time!
+            if (currentNode == e) {
+                if (route) {
+                    // walk back from the destination along the roads we came by
+                    for (int n = e; n != s; n = via[n].first)
+                        route->push_back(via[n].second);
+                    reverse(route->begin(), route->end());
+                }
+                return currentDist;
+            }
+
+            // Skip if we found a better path already
+            if (currentDist > dist[currentNode])
+                continue;
+            settled++;
+
+            // Check all roads from current location
+            for (auto &arc : adj[currentNode]) {
+                if (avoidBlocked && roadBlocked[arc.road])
+                    continue;
+                relaxed++;
+
+                // Time to travel this road, with traffic when a departure time is given
+                int roadTime = arc.weight;
+                if (departMinute >= 0)
+                    roadTime = getTravelTime(arc.road, departMinute + currentDist);
+
+                // Calculate: time to current + time to neighbor
+                int totalTime = currentDist + roadTime;
+
+                // Is this FASTER than previous best?
+                if (totalTime < dist[arc.to]) {
+                    dist[arc.to] = totalTime;           // Update diary
+                    pq.push(totalTime, arc.to);         // Add to to-do list
+                    pushes++;
+                    if (route)
+                        via[arc.to] = {currentNode, arc.road};
+                }
+            }
         }
+        // If loop ends without finding destination
+        return INT_MAX;  // Means "can't reach there"
+    });
+
+    metrics.settled.add(settled);
+    metrics.relaxed.add(relaxed);
+    metrics.pushes.add(pushes);
+    return result;
+}
+// Shared Dijkstra used by all the point-to-point searches
+// Distances are kept in a vector by internal index instead of a map keyed by node ID
+
+vector<pair<int, int>> Graph::nearestEnds(int from, const vector<int> &ends, int k, int departMinute, int maxTime, bool outbound) {
+    vector<pair<int, int>> best; // (travel time, end index), fastest first
+    int f = indexOf(from);
+    if (f == -1 || k <= 0)
+        return {};
+
+    unordered_map<int, vector<int>> endsAt; // internal index -> ends standing there
+    for (int i = 0; i < (int)ends.size(); i++) {
+        int e = indexOf(ends[i]);
+        if (e != -1)
+            endsAt[e].push_back(i);
     }
+
+    return withQueue(hasProfiles(), [&](auto &pq) { // profile lower bounds can exceed base times
+        vector<int> dist(nodes.size(), INT_MAX);
+        dist[f] = 0;
+        pq.push(0, f);
+
+        bool exact = !hasProfiles(); // without traffic the lower bound is the real time
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int currentDist = top.first;
+            int currentNode = top.second;
+
+            if (currentDist > maxTime)
+                break;
+            if ((int)best.size() == k && currentDist >= best.back().first)
+                break; // nobody further away can beat the k found
+
+            if (currentDist > dist[currentNode])
+                continue;
+
+            auto it = endsAt.find(currentNode);
+            if (it != endsAt.end()) {
+                int time = currentDist;
+                if (!exact) // confirm with real traffic, in the direction actually driven
+                    time = outbound ? search(from, nodes[currentNode], true, departMinute)
+                                    : search(nodes[currentNode], from, true, departMinute);
+
+                if (time <= maxTime) {
+                    for (int idx : it->second)
+                        best.push_back({time, idx});
+                    sort(best.begin(), best.end());
+                    if ((int)best.size() > k)
+                        best.resize(k);
+                }
+            }
+
+            for (auto &arc : adj[currentNode]) {
+                if (roadBlocked[arc.road])
+                    continue;
+
+                const Road &r = roads[arc.road];
+                int totalTime = currentDist + profiles.lowerBound(r.profile, r.weight);
+                if (totalTime < dist[arc.to]) {
+                    dist[arc.to] = totalTime;
+                    pq.push(totalTime, arc.to);
+                }
+            }
+        }
+
+        vector<pair<int, int>> ranked;
+        for (auto &b : best)
+            ranked.push_back({b.second, b.first});
+        return ranked;
+    });
 }
-// 11. If loop ends without finding destination
-return INT_MAX;  // Means "can't reach there"
+// One search from a single place over the fastest possible time of every road (roads are two-way),
+// so the ends are met in order of a lower bound on their travel time
+// With traffic profiles each end met is checked with a time-dependent search at departMinute,
+// and the search stops once no remaining end can beat the k-th best
+
+vector<pair<int, int>> Graph::nearestSources(const vector<int> &sources, int target, int k, int departMinute, int maxTime) {
+    TRACE_SPAN_ARG("graph", "nearest_sources", target);
+    return nearestEnds(target, sources, k, departMinute, maxTime, false);
 }
+// Sources that reach the target fastest, e.g. units for an incident
+// Returns up to k (source index, travel time) pairs, fastest first, none slower than maxTime
 
-int Graph::dijkstraWithBlocked(int start, int end) {
-    if (start == end)
+vector<pair<int, int>> Graph::nearestTargets(int source, const vector<int> &targets, int k, int departMinute, int maxTime) {
+    TRACE_SPAN_ARG("graph", "nearest_targets", source);
+    return nearestEnds(source, targets, k, departMinute, maxTime, true);
+}
+// Targets the source reaches fastest, e.g. hospitals for a patient, in one search instead of one per target
+// Returns up to k (target index, travel time) pairs, fastest first, none slower than maxTime
+
+vector<int> Graph::isochrone(int source, int budget, int departMinute) {
+    TRACE_SPAN_ARG("graph", "isochrone", source);
+    vector<int> reached;
+    int s = indexOf(source);
+    if (s == -1 || budget < 0)
+        return reached;
+
+    return withQueue(departMinute >= 0, [&](auto &pq) {
+        vector<int> dist(nodes.size(), INT_MAX);
+        dist[s] = 0;
+        pq.push(0, s);
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int currentDist = top.first;
+            int currentNode = top.second;
+
+            if (currentDist > budget)
+                break; // everything left is further than the budget
+
+            if (currentDist > dist[currentNode])
+                continue;
+
+            reached.push_back(nodes[currentNode]);
+
+            for (auto &arc : adj[currentNode]) {
+                if (roadBlocked[arc.road])
+                    continue;
+
+                int roadTime = arc.weight;
+                if (departMinute >= 0)
+                    roadTime = getTravelTime(arc.road, departMinute + currentDist);
+
+                int totalTime = currentDist + roadTime;
+                if (totalTime <= budget && totalTime < dist[arc.to]) {
+                    dist[arc.to] = totalTime;
+                    pq.push(totalTime, arc.to);
+                }
+            }
+        }
+        return reached;
+    });
+}
+// Bounded one-to-all search: every node reachable from source within budget minutes,
+// closest first, avoiding blocked roads (with traffic when a departure time is given)
+
+vector<int> Graph::distancesFrom(int source) {
+    TRACE_SPAN_ARG("graph", "distances_from", source);
+    vector<int> dist(nodes.size(), INT_MAX);
+    int s = indexOf(source);
+    if (s == -1)
+        return dist;
+
+    return withQueue(false, [&](auto &pq) {
+        dist[s] = 0;
+        pq.push(0, s);
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int currentDist = top.first;
+            int currentNode = top.second;
+
+            if (currentDist > dist[currentNode])
+                continue;
+
+            for (auto &arc : adj[currentNode]) {
+                if (roadBlocked[arc.road])
+                    continue;
+
+                int totalTime = currentDist + arc.weight;
+                if (totalTime < dist[arc.to]) {
+                    dist[arc.to] = totalTime;
+                    pq.push(totalTime, arc.to);
+                }
+            }
+        }
+        return dist;
+    });
+}
+// One-to-all Dijkstra avoiding blocked roads, result follows the getAllNodes() order
+// (INT_MAX for places that can't be reached)
+
+static vector<char> &closureMask(size_t roadCount) {
+    static thread_local vector<char> extraClosed;
+    if (extraClosed.size() != roadCount)
+        extraClosed.assign(roadCount, 0);
+    return extraClosed;
+}
+// The live closures are shared, only the extra ones are marked, in a mask each thread keeps
+// (callers set their roads and clear them again, so it is all zeros between calls)
+
+vector<int> Graph::distancesWithClosures(const vector<int> &sources, const vector<int> &closedRoads) {
+    TRACE_SPAN("graph", "distances_with_closures");
+    vector<int> dist(nodes.size(), INT_MAX);
+
+    vector<char> &extraClosed = closureMask(roads.size());
+    for (int id : closedRoads)
+        if (id >= 0 && id < (int)roads.size())
+            extraClosed[id] = 1;
+
+    withQueue(false, [&](auto &pq) {
+        for (int source : sources) {
+            int s = indexOf(source);
+            if (s != -1 && dist[s] != 0) {
+                dist[s] = 0;
+                pq.push(0, s);
+            }
+        }
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int currentDist = top.first;
+            int currentNode = top.second;
+
+            if (currentDist > dist[currentNode])
+                continue;
+
+            for (auto &arc : adj[currentNode]) {
+                if (roadBlocked[arc.road] || extraClosed[arc.road])
+                    continue;
+
+                int totalTime = currentDist + arc.weight;
+                if (totalTime < dist[arc.to]) {
+                    dist[arc.to] = totalTime;
+                    pq.push(totalTime, arc.to);
+                }
+            }
+        }
         return 0;
+    });
 
-    priority_queue<pair<int, int>,
-                   vector<pair<int, int>>,
-                   greater<pair<int, int>>> pq;
+    for (int id : closedRoads)
+        if (id >= 0 && id < (int)roads.size())
+            extraClosed[id] = 0;
+    return dist;
+}
+// Time from the nearest of several sources to every place, as if closedRoads were blocked too.
+// The graph itself is not changed, so any number of threads can try different closures at once.
 
-    map<int, int> dist;
-    for (int n : nodes)
-        dist[n] = INT_MAX;
+static const char CHECK_NONE = 0;    // not looked at, keeps its time
+static const char CHECK_PENDING = 1; // in the group being checked
+static const char CHECK_KEPT = 2;    // checked (or a source), kept its time
 
-    dist[start] = 0;
-    pq.push({0, start});
+vector<pair<int, int>> Graph::distanceChangesWithClosures(const vector<int> &sources, const vector<int> &baseline,
+                                                          const vector<int> &closedRoads) {
+    TRACE_SPAN("graph", "distance_changes_with_closures");
+    vector<pair<int, int>> changes;
+    if (baseline.size() != nodes.size())
+        return changes;
 
-    while (!pq.empty()) {
-        int currentDist = pq.top().first;
-        int currentNode = pq.top().second;
-        pq.pop();
+    vector<char> &extraClosed = closureMask(roads.size());
+    static thread_local vector<int> repaired; // new time of a place that lost its route, -1 = untouched
+    static thread_local vector<char> state;   // CHECK_NONE, CHECK_PENDING or CHECK_KEPT
+    if (repaired.size() != nodes.size()) {
+        repaired.assign(nodes.size(), -1);
+        state.assign(nodes.size(), CHECK_NONE);
+    }
+    vector<int> touched; // places whose state is reset at the end
+
+    for (int source : sources) {
+        int v = indexOf(source);
+        if (v != -1 && state[v] == CHECK_NONE) {
+            state[v] = CHECK_KEPT; // a source keeps its 0 whatever closes
+            touched.push_back(v);
+        }
+    }
 
-        if (currentNode == end)
-            return currentDist;
+    for (int id : closedRoads)
+        if (id >= 0 && id < (int)roads.size())
+            extraClosed[id] = 1;
+    auto open = [&](const Arc &arc) { return !roadBlocked[arc.road] && !extraClosed[arc.road]; };
+    auto tight = [&](int from, int weight, int to) {
+        return baseline[from] != INT_MAX && baseline[from] + weight == baseline[to];
+    };
 
-        if (currentDist > dist[currentNode])
+    // seeds and distances here don't move forward in small steps, so the plain heap is used
+    BinaryHeapQueue pq;
+    vector<int> lost;
+
+    // 1. a closed road matters only if a fastest route used it, its far end may have lost its route.
+    //    Places are checked nearest first, all places at the same time together with the ones
+    //    0-minute fastest roads lead to from them. One keeps its time if it still has a fastest
+    //    road in from a place outside the group that kept its time, or from a group member that
+    //    did; the others are lost and the places they led to are checked next.
+    for (int id : closedRoads) {
+        if (id < 0 || id >= (int)roads.size())
             continue;
+        int a = indexOf(roads[id].src), b = indexOf(roads[id].dest);
+        if (tight(a, roads[id].weight, b))
+            pq.push(baseline[b], b);
+        if (tight(b, roads[id].weight, a))
+            pq.push(baseline[a], a);
+    }
 
-        for (auto neighbor : adjList[currentNode]) {
-            int nextNode = neighbor.first;
-            int roadWeight = neighbor.second;
+    vector<int> group, keptNow;
+    auto join = [&](int v) {
+        if (state[v] == CHECK_NONE && repaired[v] == -1) {
+            state[v] = CHECK_PENDING;
+            touched.push_back(v);
+            group.push_back(v);
+        }
+    };
+    while (!pq.empty()) {
+        pair<int, int> first = pq.pop();
+        int time = first.first;
+        group.clear();
+        join(first.second);
+        while (!pq.empty()) {
+            pair<int, int> next = pq.pop();
+            if (next.first != time) {
+                pq.push(next.first, next.second); // belongs to a later group
+                break;
+            }
+            join(next.second);
+        }
+        for (size_t i = 0; i < group.size(); i++)
+            for (auto &arc : adj[group[i]])
+                if (arc.weight == 0 && tight(group[i], 0, arc.to))
+                    join(arc.to);
+
+        keptNow.clear();
+        for (int v : group) {
+            for (auto &arc : adj[v]) {
+                if (open(arc) && state[arc.to] != CHECK_PENDING && repaired[arc.to] == -1 &&
+                    tight(arc.to, arc.weight, v)) {
+                    state[v] = CHECK_KEPT;
+                    keptNow.push_back(v);
+                    break;
+                }
+            }
+        }
+        for (size_t i = 0; i < keptNow.size(); i++) {
+            int u = keptNow[i];
+            for (auto &arc : adj[u])
+                if (state[arc.to] == CHECK_PENDING && open(arc) && tight(u, arc.weight, arc.to)) {
+                    state[arc.to] = CHECK_KEPT;
+                    keptNow.push_back(arc.to);
+                }
+        }
 
-            if (isRoadBlocked(currentNode, nextNode))
+        for (int v : group) {
+            if (state[v] != CHECK_PENDING)
                 continue;
+            repaired[v] = INT_MAX;
+            lost.push_back(v);
+            for (auto &arc : adj[v])
+                if (tight(v, arc.weight, arc.to))
+                    pq.push(baseline[arc.to], arc.to);
+        }
+    }
+
+    // 2. Dijkstra over the lost places only, starting from the best way in from a place that kept its time
+    for (int v : lost) {
+        for (auto &arc : adj[v])
+            if (open(arc) && repaired[arc.to] == -1 && baseline[arc.to] != INT_MAX)
+                repaired[v] = min(repaired[v], baseline[arc.to] + arc.weight);
+        if (repaired[v] != INT_MAX)
+            pq.push(repaired[v], v);
+    }
 
-            int totalDist = currentDist + roadWeight;
+    while (!pq.empty()) {
+        pair<int, int> top = pq.pop();
+        int currentDist = top.first;
+        int currentNode = top.second;
+
+        if (currentDist > repaired[currentNode])
+            continue;
 
-            if (totalDist < dist[nextNode]) {
-                dist[nextNode] = totalDist;
-                pq.push({totalDist, nextNode});
+        for (auto &arc : adj[currentNode]) {
+            if (!open(arc) || repaired[arc.to] == -1)
+                continue;
+
+            int totalTime = currentDist + arc.weight;
+            if (totalTime < repaired[arc.to]) {
+                repaired[arc.to] = totalTime;
+                pq.push(totalTime, arc.to);
             }
         }
     }
-    return INT_MAX;
+
+    for (int v : lost) {
+        if (repaired[v] != baseline[v])
+            changes.push_back({v, repaired[v]});
+        repaired[v] = -1;
+    }
+    for (int v : touched)
+        state[v] = CHECK_NONE;
+    for (int id : closedRoads)
+        if (id >= 0 && id < (int)roads.size())
+            extraClosed[id] = 0;
+    return changes;
 }
+// Same answer as distancesWithClosures but as (position, new time) for only the places that change,
+// given the same sources and their times without the extra closures. Work grows with the places affected, not the map size.
+
+vector<int> Graph::distancesFromParallel(int source, int threads, int delta) {
+    TRACE_SPAN_ARG("graph", "distances_from_parallel", source);
+    vector<int> dist(nodes.size(), INT_MAX);
+    int s = indexOf(source);
+    if (s == -1)
+        return dist;
+
+    if (threads <= 0)
+        threads = max(1u, thread::hardware_concurrency());
+    if (delta <= 0)
+        delta = max(1, maxWeight / 4); // about one bucket per light road on a city grid
+    int T = threads;
+
+    // Every node belongs to thread index % T, only its owner writes its distance or buckets.
+    // Other threads send the owner (node, distance) requests through per pair buffers.
+    vector<vector<vector<int>>> buckets(T);               // [owner][bucket] -> nodes
+    vector<vector<vector<pair<int, int>>>> requests(T);   // [sender][owner] -> (node, distance)
+    vector<vector<int>> settled(T);                       // nodes each owner settled in this bucket
+    vector<int> expanded(nodes.size(), INT_MAX);          // distance a node was last expanded at
+    vector<char> inSettled(nodes.size(), 0);
+    vector<size_t> nextBucket(T);                         // smallest non-empty bucket of each owner
+    vector<char> moreWork(T);
+    for (auto &r : requests)
+        r.resize(T);
+
+    Barrier barrier(T);
+    dist[s] = 0;
+    buckets[s % T].push_back({s});
+
+    auto worker = [&](int self) {
+        TRACE_SPAN_ARG("graph", "delta_stepping_worker", self);
+        auto relaxOwn = [&]() {
+            // apply every request sent to this thread
+            for (int from = 0; from < T; from++) {
+                for (auto &req : requests[from][self]) {
+                    int v = req.first;
+                    if (req.second < dist[v]) {
+                        dist[v] = req.second;
+                        size_t b = req.second / delta;
+                        if (buckets[self].size() <= b)
+                            buckets[self].resize(b + 1);
+                        buckets[self][b].push_back(v);
+                    }
+                }
+                requests[from][self].clear();
+            }
+        };
+
+        auto sendRequests = [&](int u, bool light) {
+            for (auto &arc : adj[u]) {
+                if (roadBlocked[arc.road] || (arc.weight <= delta) != light)
+                    continue;
+                int nd = dist[u] + arc.weight;
+                if (nd < dist[arc.to])
+                    requests[self][arc.to % T].push_back({arc.to, nd});
+            }
+        };
+
+        size_t current = 0;
+        while (true) {
+            // everybody agrees on the smallest bucket that still has work
+            size_t mine = buckets[self].size();
+            for (size_t b = current; b < buckets[self].size(); b++)
+                if (!buckets[self][b].empty()) {
+                    mine = b;
+                    break;
+                }
+            nextBucket[self] = mine;
+            barrier.wait();
+            size_t next = SIZE_MAX;
+            for (int t = 0; t < T; t++)
+                if (nextBucket[t] < buckets[t].size())
+                    next = min(next, nextBucket[t]);
+            barrier.wait(); // nobody may change nextBucket until all have read it
+            if (next == SIZE_MAX)
+                break;
+            current = next;
+
+            // light roads can land back in the same bucket, so repeat until it stays empty
+            while (true) {
+                vector<int> frontier;
+                if (current < buckets[self].size())
+                    frontier.swap(buckets[self][current]);
+                for (int u : frontier) {
+                    if (dist[u] / delta != (int)current || expanded[u] == dist[u])
+                        continue; // moved to an earlier bucket, or already done at this distance
+                    expanded[u] = dist[u];
+                    if (!inSettled[u]) {
+                        inSettled[u] = 1;
+                        settled[self].push_back(u);
+                    }
+                    sendRequests(u, true);
+                }
+                barrier.wait();
+                relaxOwn();
+                moreWork[self] = current < buckets[self].size() && !buckets[self][current].empty();
+                barrier.wait();
+                bool again = false;
+                for (int t = 0; t < T; t++)
+                    again = again || moreWork[t];
+                barrier.wait(); // moreWork is rewritten in the next round
+                if (!again)
+                    break;
+            }
+
+            // heavy roads always leave the bucket, one pass over the settled nodes is enough
+            for (int u : settled[self]) {
+                inSettled[u] = 0;
+                sendRequests(u, false);
+            }
+            settled[self].clear();
+            barrier.wait();
+            relaxOwn();
+            current++;
+        }
+    };
+
+    vector<thread> helpers;
+    for (int t = 1; t < T; t++)
+        helpers.push_back(thread(worker, t));
+    worker(0);
+    for (auto &h : helpers)
+        h.join();
+    return dist;
+}
+// Parallel delta-stepping: nodes are grouped in buckets of delta minutes and a whole bucket
+// is expanded at once by all threads. Roads up to delta long (light) are relaxed until the
+// bucket stops changing, longer ones (heavy) once after it. Same answer as distancesFrom.
+
+int Graph::getTravelTime(int edgeId, int minuteOfDay) const {
+    const Road &r = roads[edgeId];
+    return profiles.travelTime(r.profile, r.weight, minuteOfDay);
+} // Returns the travel time of a road entered at the given minute of the day
+
+bool Graph::setRoadProfile(int edgeId, const vector<unsigned short> &percent) {
+    if (edgeId < 0 || edgeId >= (int)roads.size())
+        return false;
+
+    int id = profiles.addProfile(percent);
+    if (id == -1)
+        return false;
+
+    roads[edgeId].profile = id;
+    notifyListeners({edgeId});
+    return true;
+}
+// Attaches a daily profile to a road, identical profiles are stored only once
+
+bool Graph::hasProfiles() const {
+    return profiles.size() > 0;
+}
+
+const ProfileStore &Graph::getProfiles() const {
+    return profiles;
+}
+// Read-only, for SharedMap::publish
 
 void Graph::loadFromFile(const string &filename) {
+    static Histogram &loadTime = MetricsRegistry::instance().histogram("ers_load_seconds", "file=\"map\"", "Time to load a data file");
+    ScopedTimer timer(loadTime);
+    TRACE_SPAN("graph", "load_map");
     ifstream file(filename);
 
     if (!file.is_open()) {
@@ -187,10 +1063,72 @@ void Graph::loadFromFile(const string &filename) {
     }
 
     file.close();
-    cout << "Graph loaded\n";
+    reorderNodes();
+    if (verbose)
+        cout << "Graph loaded\n";
+}
+
+void Graph::loadProfilesFromFile(const string &filename) {
+    static Histogram &loadTime = MetricsRegistry::instance().histogram("ers_load_seconds", "file=\"profiles\"");
+    ScopedTimer timer(loadTime);
+    TRACE_SPAN("graph", "load_profiles");
+    ifstream file(filename);
+
+    if (!file.is_open()) {
+        cout << "File error\n";
+        return;
+    }
+
+    map<string, vector<unsigned short>> named; // profiles declared in this file
+    int assigned = 0;
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        auto parts = split(line, ' ');
+        if (parts.size() >= 3 && parts[0] == "profile") {
+            int count = parts.size() - 2;
+            if (PROFILE_BUCKETS % count != 0)
+                continue; // values must cover the day evenly (e.g. 24 hourly or 96 quarter hours)
+
+            vector<unsigned short> percent;
+            int repeat = PROFILE_BUCKETS / count;
+            bool valid = true;
+            for (int i = 2; i < (int)parts.size(); i++) {
+                int value = stoi(parts[i]);
+                if (value < MIN_PROFILE_PERCENT || value > MAX_PROFILE_PERCENT)
+                    valid = false; // checked before it is narrowed, -5 must not wrap to 65531
+                for (int k = 0; k < repeat; k++)
+                    percent.push_back(valid ? value : 0);
+            }
+            if (!valid) {
+                if (verbose)
+                    cout << "Profile " << parts[1] << " skipped, values must be " << MIN_PROFILE_PERCENT
+                         << "-" << MAX_PROFILE_PERCENT << "%\n";
+                continue;
+            }
+            named[parts[1]] = percent;
+        } else if (parts.size() >= 4 && parts[0] == "road") {
+            auto it = named.find(parts[3]);
+            if (it == named.end())
+                continue;
+
+            int id = getEdgeId(stoi(parts[1]), stoi(parts[2]));
+            if (id != -1 && setRoadProfile(id, it->second))
+                assigned++;
+        }
+    }
+
+    file.close();
+    if (verbose)
+        cout << "Profiles loaded (" << profiles.size() << " shared by "
+             << assigned << " roads, " << profiles.memoryBytes() << " bytes)\n";
 }
 
 void Graph::saveToFile(const string &filename) {
+    TRACE_SPAN("graph", "save_map");
     ofstream file(filename);
 
     if (!file.is_open()) {
@@ -200,22 +1138,63 @@ void Graph::saveToFile(const string &filename) {
 
     map<pair<int, int>, bool> done;
 
-    for (int n : nodes) {
-        for (auto nb : adjList[n]) {
-            int a = min(n, nb.first);
-            int b = max(n, nb.first);
+    for (auto &road : roads) { // edge ID order, the order the roads were loaded in
+        int a = min(road.src, road.dest);
+        int b = max(road.src, road.dest);
 
-            if (!done[{a, b}]) {
-                file << a << " " << b << " " << nb.second << endl;
-                done[{a, b}] = true;
-            }
+        if (!done[{a, b}]) {
+            file << a << " " << b << " " << road.weight << '\n';
+            done[{a, b}] = true;
         }
     }
 
     file.close();
-    cout << "Graph saved\n";
+    if (verbose)
+        cout << "Graph saved\n";
 }
 
+void Graph::generateTestMap(int rows, int cols) {
+    if (rows <= 0 || cols <= 0) {
+        cout << "Invalid size\n";
+        return;
+    }
+
+    clear();
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            int id = r * cols + c;
+            addNode(id);
+            if (c + 1 < cols)
+                addEdge(id, id + 1, 1 + rand() % 15);    // road to the east
+            if (r + 1 < rows)
+                addEdge(id, id + cols, 1 + rand() % 15); // road to the south
+        }
+    }
+
+    if (verbose)
+        cout << "Test map generated (" << nodes.size() << " nodes, " << roads.size() << " roads)\n";
+} // Builds a random grid city for load testing, node ID = row * cols + col
+
+void Graph::clear() {
+    adj.clear();
+    nodes.clear();
+    nodeIndex.clear();
+    blockedRoads.clear();
+    roadBlocked.clear();
+    roads.clear();
+    roadIds.clear();
+    profiles.clear();
+    maxWeight = 0;
+    version++;
+    layoutVersion++;
+}
+// Empties the map, change listeners stay registered
+
+void Graph::setVerbose(bool on) {
+    verbose = on;
+} // Turns routine messages off for bulk work such as simulations
+
 void Graph::display() {
     cout << "\nGraph\n";
     cout << "Nodes: " << nodes.size() << endl;
@@ -230,20 +1209,18 @@ void Graph::display() {
     cout << "Roads:\n";
 
     map<pair<int, int>, bool> shown; // Tracks which roads we've already shown
-    for (int n : nodes) {
-        for (auto nb : adjList[n]) {
-            int a = min(n, nb.first);
-            int b = max(n, nb.first);
-            // To normalize road representation, road 1-2 and Road 2-1 become the same: (1, 2), This prevents duplicates!
-
-            if (!shown[{a, b}]) { // // Haven't shown this road yet
-                cout << a << " <-> " << b << " (" << nb.second << ")";
-                if (isRoadBlocked(a, b))
-                    cout << " X";
-                cout << endl;
-
-                shown[{a, b}] = true;
-            }
+    for (auto &road : roads) { // edge ID order, the order roads were added in
+        int a = min(road.src, road.dest);
+        int b = max(road.src, road.dest);
+        // To normalize road representation, road 1-2 and Road 2-1 become the same: (1, 2), This prevents duplicates!
+
+        if (!shown[{a, b}]) { // // Haven't shown this road yet
+            cout << a << " <-> " << b << " (" << road.weight << ")";
+            if (isRoadBlocked(a, b))
+                cout << " X";
+            cout << endl;
+
+            shown[{a, b}] = true;
         }
     }
 }
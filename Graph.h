@@ -3,32 +3,110 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <queue>
 #include <climits>
 #include <string>
+#include <functional>
+#include "TrafficProfile.h"
+#include "SearchQueue.h"
 using namespace std;
 
+struct Road {
+    int src;
+    int dest;
+    int weight;
+    int srcSlot;  // position of this road inside the adjacency list of src
+    int destSlot; // position of this road inside the adjacency list of dest
+    int profile;  // shared traffic profile ID, -1 means the static weight all day
+};
+// One record per undirected road, its index in the roads vector is the stable edge ID
+
+struct Arc {
+    int to;     // internal index of the neighbour
+    int weight;
+    int road;   // edge ID
+};
+// One direction of a road inside the adjacency list
+
+typedef function<void(const vector<int> &changedRoads)> RoadChangeListener;
+// Called once per change batch with the IDs of every road that changed
+
 class Graph {
-    map<int, vector<pair<int, int>>> adjList;
-    vector<int> nodes;
+    vector<vector<Arc>> adj;             // indexed by internal node index
+    vector<int> nodes;                   // node ID of every internal index
+    unordered_map<int, int> nodeIndex;   // node ID -> internal index
     map<pair<int, int>, bool> blockedRoads;
+    vector<char> roadBlocked;            // same information by edge ID, read by the searches
+    vector<Road> roads;
+    map<pair<int, int>, int> roadIds;    // (min, max) node pair -> edge ID
+    ProfileStore profiles;
+    vector<RoadChangeListener> listeners;
+    long long version;                   // bumped once per change batch
+    long long layoutVersion;             // bumped when nodes are added, renumbered or cleared
+    int maxWeight;                       // largest base road time ever set, sizes Dial's buckets
+    QueueKind queueKind;
+    bool verbose;
+
+    void notifyListeners(const vector<int> &changedRoads);
+    void setPairBlocked(int src, int dest, bool blocked);
+    int indexOf(int nodeId) const;
+    int search(int start, int end, bool avoidBlocked, int departMinute, vector<int> *route = nullptr);
+    int maxRoadTime(bool timed) const;
+    vector<pair<int, int>> nearestEnds(int from, const vector<int> &ends, int k, int departMinute, int maxTime, bool outbound);
+    template <class Body> auto withQueue(bool timed, Body body);
 
 public:
     Graph();
+    Graph(const Graph &other);
+    Graph &operator=(const Graph &) = delete;
     void addNode(int nodeId);
     void addEdge(int src, int dest, int weight);
     void updateEdgeWeight(int src, int dest, int newWeight);
+    int applyWeightUpdates(const vector<pair<int, int>> &updates);
+    int getEdgeId(int src, int dest) const;
+    vector<int> getEdgeIds(int src, int dest) const;
+    int getEdgeCount() const;
+    Road getRoad(int edgeId) const;
+    int addChangeListener(RoadChangeListener listener);
+    void removeChangeListener(int handle);
+    long long getVersion() const;
+    long long getLayoutVersion() const;
     void markRoadBlocked(int src, int dest);
     void markRoadOpen(int src, int dest);
     bool isRoadBlocked(int src, int dest) const;
+    bool hasNode(int nodeId) const;
+    int getNodeCount() const;
+    long long getMemoryBytes() const;
     vector<pair<int, int>> getNeighbors(int node);
     vector<int> getAllNodes();
+    void reorderNodes();
     int dijkstra(int start, int end);
     int dijkstraWithBlocked(int start, int end);
+    int dijkstraAt(int start, int end, int departMinute);
+    int findRoute(int start, int end, int departMinute, vector<int> &route);
+    vector<pair<int, int>> nearestSources(const vector<int> &sources, int target, int k, int departMinute, int maxTime = INT_MAX);
+    vector<pair<int, int>> nearestTargets(int source, const vector<int> &targets, int k, int departMinute, int maxTime = INT_MAX);
+    vector<int> isochrone(int source, int budget, int departMinute = -1);
+    vector<int> distancesFrom(int source);
+    vector<int> distancesFromParallel(int source, int threads = 0, int delta = 0);
+    vector<int> distancesWithClosures(const vector<int> &sources, const vector<int> &closedRoads);
+    vector<pair<int, int>> distanceChangesWithClosures(const vector<int> &sources, const vector<int> &baseline,
+                                                      const vector<int> &closedRoads);
+    int getTravelTime(int edgeId, int minuteOfDay) const;
+    bool setRoadProfile(int edgeId, const vector<unsigned short> &percent);
+    bool hasProfiles() const;
+    const ProfileStore &getProfiles() const;
     void loadFromFile(const string &filename);
+    void loadProfilesFromFile(const string &filename);
     void saveToFile(const string &filename);
+    void generateTestMap(int rows, int cols);
+    void clear();
+    void setVerbose(bool on);
+    void setQueueKind(QueueKind kind);
+    QueueKind chooseQueue(bool timed) const;
     void display();
     void displayBlockedRoads();
 };
 
-#endif
\ No newline at end of file
+#endif
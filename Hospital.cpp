@@ -0,0 +1,223 @@
+#include "Hospital.h"
+#include "Graph.h"
+#include "TrafficProfile.h"
+#include "Trace.h"
+#include "utils.h"
+#include <iostream>
+#include <fstream>
+#include <climits>
+#include <algorithm>
+
+using namespace std;
+
+static const int TRANSPORT_CANDIDATES = 3; // units compared on total time when traffic changes the second leg
+
+Hospital::Hospital(int hospId, int loc, bool traumaCentre) {
+    id = hospId;
+    location = loc;
+    trauma = traumaCentre;
+}
+
+int Hospital::getId() const {
+    return id;
+}
+
+int Hospital::getLocation() const {
+    return location;
+}
+
+bool Hospital::isTraumaCentre() const {
+    return trauma;
+}
+
+void Hospital::display() const {
+    cout << "Hospital #" << id << ", Location: " << location << (trauma ? ", Trauma centre" : "") << endl;
+}
+
+HospitalDirectory::HospitalDirectory() {
+    verbose = true;
+}
+
+HospitalDirectory::~HospitalDirectory() {
+    for (auto h : hospitals)
+        delete h;
+    hospitals.clear();
+}
+
+void HospitalDirectory::addHospital(int id, int location, bool trauma) {
+    for (auto h : hospitals) {
+        if (h->getId() == id) {
+            cout << "Hospital already exists\n";
+            return;
+        }
+    }
+
+    hospitals.push_back(new Hospital(id, location, trauma));
+    if (verbose)
+        cout << "Hospital added\n";
+}
+
+void HospitalDirectory::generateTestHospitals(int count, Graph &graph) {
+    if (count <= 0) {
+        cout << "Invalid count\n";
+        return;
+    }
+
+    auto nodes = graph.getAllNodes();
+    if (nodes.empty()) {
+        cout << "No map loaded\n";
+        return;
+    }
+
+    int nextId = 0;
+    for (auto h : hospitals)
+        nextId = max(nextId, h->getId() + 1);
+
+    for (int i = 0; i < count; i++) // every third one is a trauma centre, the first always is
+        hospitals.push_back(new Hospital(nextId + i, nodes[rand() % nodes.size()], i % 3 == 0));
+
+    if (verbose)
+        cout << count << " test hospitals added\n";
+} // Adds hospitals at random places for load testing
+
+HospitalEta HospitalDirectory::nearestOf(int incidentLocation, bool traumaOnly, Graph &graph, int departMinute) {
+    vector<Hospital*> candidates;
+    vector<int> locations;
+    for (auto h : hospitals) {
+        if (!traumaOnly || h->isTraumaCentre()) {
+            candidates.push_back(h);
+            locations.push_back(h->getLocation());
+        }
+    }
+
+    auto best = graph.nearestTargets(incidentLocation, locations, 1, departMinute);
+    if (best.empty())
+        return {nullptr, INT_MAX};
+    return {candidates[best[0].first], best[0].second};
+}
+// One search from the incident meets the hospitals in order, whatever their number
+
+HospitalEta HospitalDirectory::findBestHospital(int incidentLocation, const string &priority, Graph &graph, int departMinute) {
+    TRACE_SPAN_ARG("hospital", "find_best", incidentLocation);
+    if (departMinute < 0)
+        departMinute = currentMinuteOfDay();
+
+    if (priority == "HIGH") {
+        HospitalEta best = nearestOf(incidentLocation, true, graph, departMinute);
+        if (best.hospital)
+            return best;
+    }
+    return nearestOf(incidentLocation, false, graph, departMinute);
+}
+// HIGH priority patients go to the nearest trauma centre, or the nearest hospital when none can be reached
+// Other patients go to the nearest hospital
+
+TransportPlan HospitalDirectory::planTransport(int incidentLocation, const string &priority, ResourceManager &rm,
+                                               Graph &graph, AmbulanceFilter filter, int departMinute) {
+    TRACE_SPAN_ARG("hospital", "plan_transport", incidentLocation);
+    if (departMinute < 0)
+        departMinute = currentMinuteOfDay();
+
+    TransportPlan plan = {nullptr, nullptr, INT_MAX, INT_MAX, INT_MAX};
+
+    // without traffic the second leg is the same whichever unit drives it, so the nearest unit is best
+    int k = graph.hasProfiles() ? TRANSPORT_CANDIDATES : 1;
+    auto units = rm.findKNearest(incidentLocation, k, graph, filter, departMinute);
+    if (units.empty()) {
+        plan.hospital = findBestHospital(incidentLocation, priority, graph, departMinute).hospital;
+        return plan;
+    }
+
+    for (auto &unit : units) {
+        // the second leg leaves when the unit arrives, later arrivals may meet other traffic
+        HospitalEta leg = findBestHospital(incidentLocation, priority, graph, (departMinute + unit.eta) % MINUTES_PER_DAY);
+        int total = leg.hospital ? unit.eta + leg.eta : INT_MAX;
+
+        if (!plan.amb || total < plan.total) {
+            plan = {unit.amb, leg.hospital, unit.eta, leg.eta, total};
+        }
+    }
+    return plan;
+}
+// Picks the unit and hospital with the shortest unit -> incident -> hospital time
+
+vector<Hospital*> HospitalDirectory::getAllHospitals() {
+    return hospitals;
+}
+
+int HospitalDirectory::getCount() const {
+    return hospitals.size();
+}
+
+void HospitalDirectory::display() {
+    cout << "\nHospitals:\n";
+
+    if (hospitals.empty()) {
+        cout << "None\n";
+        return;
+    }
+
+    for (auto h : hospitals)
+        h->display();
+}
+
+void HospitalDirectory::loadFromFile(const string &filename) {
+    TRACE_SPAN("hospital", "load_hospitals");
+    ifstream file(filename);
+
+    if (!file.is_open()) {
+        cout << "File error\n";
+        return;
+    }
+
+    for (auto h : hospitals)
+        delete h;
+    hospitals.clear();
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        auto parts = split(line, ' ');
+        if (parts.size() >= 2) {
+            bool trauma = parts.size() >= 3 && parts[2] == "1";
+            addHospital(stoi(parts[0]), stoi(parts[1]), trauma);
+        }
+    }
+
+    file.close();
+    if (verbose)
+        cout << "Loaded from file\n";
+}
+// File format: "hospital_id node_id trauma", trauma 1 for a trauma centre (optional, 0 if missing)
+
+void HospitalDirectory::saveToFile(const string &filename) {
+    TRACE_SPAN("hospital", "save_hospitals");
+    ofstream file(filename);
+
+    if (!file.is_open()) {
+        cout << "Save failed\n";
+        return;
+    }
+
+    for (auto h : hospitals) {
+        file << h->getId() << " " << h->getLocation() << " " << (h->isTraumaCentre() ? 1 : 0) << '\n';
+    }
+
+    file.close();
+    cout << "Saved\n";
+}
+
+void HospitalDirectory::clearAll() {
+    for (auto h : hospitals)
+        delete h;
+    hospitals.clear();
+
+    if (verbose)
+        cout << "Hospitals cleared\n";
+}
+
+void HospitalDirectory::setVerbose(bool on) {
+    verbose = on;
+} // Turns routine messages off for bulk loads
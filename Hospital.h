@@ -0,0 +1,65 @@
+#ifndef HOSPITAL_H
+#define HOSPITAL_H
+
+#include <vector>
+#include <string>
+#include "ResourceManager.h"
+using namespace std;
+
+class Graph;
+
+class Hospital {
+    int id;
+    int location;
+    bool trauma; // trauma centre, takes HIGH priority patients
+
+public:
+    Hospital(int hospId, int loc, bool traumaCentre);
+
+    int getId() const;
+    int getLocation() const;
+    bool isTraumaCentre() const;
+
+    void display() const;
+};
+
+struct HospitalEta {
+    Hospital* hospital; // nullptr when no suitable hospital can be reached
+    int eta;            // minutes from the incident
+};
+
+struct TransportPlan {
+    Ambulance* amb;     // nullptr when no unit can reach the incident
+    Hospital* hospital; // nullptr when no hospital can be reached from the incident
+    int toIncident;     // first leg, unit to incident
+    int toHospital;     // second leg, incident to hospital
+    int total;          // both legs, INT_MAX when either is missing
+};
+
+class HospitalDirectory {
+    vector<Hospital*> hospitals;
+    bool verbose;
+
+    HospitalEta nearestOf(int incidentLocation, bool traumaOnly, Graph &graph, int departMinute);
+
+public:
+    HospitalDirectory();
+    ~HospitalDirectory();
+
+    void addHospital(int id, int location, bool trauma);
+    void generateTestHospitals(int count, Graph &graph);
+    HospitalEta findBestHospital(int incidentLocation, const string &priority, Graph &graph, int departMinute = -1);
+    TransportPlan planTransport(int incidentLocation, const string &priority, ResourceManager &rm, Graph &graph,
+                                AmbulanceFilter filter = nullptr, int departMinute = -1);
+
+    vector<Hospital*> getAllHospitals();
+    int getCount() const;
+
+    void display();
+    void loadFromFile(const string &filename);
+    void saveToFile(const string &filename);
+    void clearAll();
+    void setVerbose(bool on);
+};
+
+#endif
@@ -0,0 +1,365 @@
+#include "HubLabels.h"
+#include "Graph.h"
+#include "ContractionHierarchy.h"
+#include "SearchQueue.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <climits>
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static const int LABEL_BLOCK = 8;                    // labels are padded to whole blocks of 8 hubs
+static const int NO_HUB = INT_MAX;                   // padding hub, larger than any rank
+static const int PAD_TIME = INT_MAX / 4;             // padding time, two of them still fit in an int
+static const unsigned LABEL_FILE_MAGIC = 0x4C425548; // "HUBL"
+
+HubLabels::HubLabels(Graph &g) : graph(g) {
+    builtVersion = -1;
+    buildSeconds = 0;
+    entries = 0;
+}
+
+static void padLabel(vector<int> &hubs, vector<int> &dists) {
+    do {
+        hubs.push_back(NO_HUB);
+        dists.push_back(PAD_TIME);
+    } while (hubs.size() % LABEL_BLOCK != 0);
+}
+// Whole blocks let the merge compare 8 hubs against 8 without checking for the end
+
+static unsigned long long mix(unsigned long long x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+} // splitmix64 finalizer
+
+unsigned long long HubLabels::mapFingerprint() const {
+    unsigned long long sum = mix(graph.getNodeCount());
+    for (int id = 0; id < graph.getEdgeCount(); id++) {
+        Road r = graph.getRoad(id);
+        unsigned long long a = min(r.src, r.dest);
+        unsigned long long b = max(r.src, r.dest);
+        bool blocked = graph.isRoadBlocked(r.src, r.dest);
+        sum += mix(mix(a << 32 | (b & 0xFFFFFFFFULL)) ^ ((unsigned long long)r.weight << 1 | blocked));
+    }
+    return sum;
+}
+// Order independent, so a map saved and loaded again (roads in another order) still matches
+
+void HubLabels::build() {
+    auto start = chrono::steady_clock::now();
+
+    // contraction order: nodes many shortest paths pass through come first
+    {
+        ContractionHierarchy ch(graph);
+        nodeIds = ch.getOrder();
+    }
+    int n = nodeIds.size();
+    rankOf.clear();
+    for (int r = 0; r < n; r++)
+        rankOf[nodeIds[r]] = r;
+
+    vector<vector<pair<int, int>>> adj(n); // rank -> (neighbour rank, time) over open roads
+    for (int id = 0; id < graph.getEdgeCount(); id++) {
+        Road r = graph.getRoad(id);
+        if (r.src == r.dest || graph.isRoadBlocked(r.src, r.dest))
+            continue;
+        int a = rankOf[r.src];
+        int b = rankOf[r.dest];
+        adj[a].push_back({b, r.weight});
+        adj[b].push_back({a, r.weight});
+    }
+
+    // pruned Dijkstra from every node, most important first: a node is labelled only
+    // when the hubs found so far can't already give its distance to the root
+    vector<vector<pair<int, int>>> labels(n); // (hub rank, time), hubs added in rank order
+    vector<int> rootDist(n, INT_MAX);         // the root's own label, spread out by hub
+    vector<int> dist(n, INT_MAX);
+    vector<int> touched;
+
+    for (int root = 0; root < n; root++) {
+        for (auto &e : labels[root])
+            rootDist[e.first] = e.second;
+
+        RadixHeapQueue pq;
+        dist[root] = 0;
+        touched.push_back(root);
+        pq.push(0, root);
+        while (!pq.empty()) {
+            auto top = pq.pop();
+            int u = top.second;
+            if (top.first > dist[u])
+                continue;
+
+            bool covered = false;
+            for (auto &e : labels[u])
+                if (rootDist[e.first] != INT_MAX && rootDist[e.first] + e.second <= top.first) {
+                    covered = true;
+                    break;
+                }
+            if (covered)
+                continue;
+
+            labels[u].push_back({root, top.first});
+            for (auto &e : adj[u]) {
+                // earlier roots already cover every node ranked above this one
+                if (e.first < root)
+                    continue;
+                int nd = top.first + e.second;
+                if (nd < dist[e.first]) {
+                    if (dist[e.first] == INT_MAX)
+                        touched.push_back(e.first);
+                    dist[e.first] = nd;
+                    pq.push(nd, e.first);
+                }
+            }
+        }
+
+        for (int v : touched)
+            dist[v] = INT_MAX;
+        touched.clear();
+        for (auto &e : labels[root])
+            rootDist[e.first] = INT_MAX;
+    }
+
+    // one flat array per field instead of a vector per node
+    labelStart.assign(n + 1, 0);
+    hubs.clear();
+    dists.clear();
+    entries = 0;
+    for (int r = 0; r < n; r++) {
+        labelStart[r] = hubs.size();
+        for (auto &e : labels[r]) {
+            hubs.push_back(e.first);
+            dists.push_back(e.second);
+        }
+        entries += labels[r].size();
+        padLabel(hubs, dists);
+        vector<pair<int, int>>().swap(labels[r]);
+    }
+    labelStart[n] = hubs.size();
+
+    builtVersion = graph.getVersion();
+    buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+// Pruned landmark labelling in contraction hierarchy order, open roads with their static times
+// (the same answers as dijkstraWithBlocked)
+
+int HubLabels::query(int start, int end) const {
+    auto a = rankOf.find(start);
+    auto b = rankOf.find(end);
+    if (a == rankOf.end() || b == rankOf.end())
+        return INT_MAX;
+
+    int i = labelStart[a->second], endA = labelStart[a->second + 1];
+    int j = labelStart[b->second], endB = labelStart[b->second + 1];
+    const int *ha = hubs.data();
+    const int *da = dists.data();
+    const int *hb = hubs.data();
+    const int *db = dists.data();
+    int best = INT_MAX;
+
+#if defined(__AVX2__)
+    // block merge: all 8 x 8 hub pairs of two blocks compared by rotating one block 8 times,
+    // then the block with the smaller last hub is done
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    const __m256i none = _mm256_set1_epi32(INT_MAX);
+    __m256i bestLanes = none;
+    while (i < endA && j < endB) {
+        __m256i hubA = _mm256_loadu_si256((const __m256i *)(ha + i));
+        __m256i timeA = _mm256_loadu_si256((const __m256i *)(da + i));
+        __m256i hubB = _mm256_loadu_si256((const __m256i *)(hb + j));
+        __m256i timeB = _mm256_loadu_si256((const __m256i *)(db + j));
+        for (int k = 0; k < LABEL_BLOCK; k++) {
+            __m256i same = _mm256_cmpeq_epi32(hubA, hubB);
+            __m256i through = _mm256_blendv_epi8(none, _mm256_add_epi32(timeA, timeB), same);
+            bestLanes = _mm256_min_epi32(bestLanes, through);
+            hubB = _mm256_permutevar8x32_epi32(hubB, rotate);
+            timeB = _mm256_permutevar8x32_epi32(timeB, rotate);
+        }
+        int lastA = ha[i + LABEL_BLOCK - 1];
+        int lastB = hb[j + LABEL_BLOCK - 1];
+        i += (lastA <= lastB) * LABEL_BLOCK;
+        j += (lastB <= lastA) * LABEL_BLOCK;
+    }
+    int lanes[LABEL_BLOCK];
+    _mm256_storeu_si256((__m256i *)lanes, bestLanes);
+    for (int k = 0; k < LABEL_BLOCK; k++)
+        best = min(best, lanes[k]);
+#else
+    // merge of the two sorted hub lists without data dependent branches: both cursors step by
+    // comparison results and a match updates best through a conditional move
+    while (i < endA && j < endB) {
+        int x = ha[i];
+        int y = hb[j];
+        int through = da[i] + db[j];
+        best = x == y && through < best ? through : best;
+        i += x <= y;
+        j += y <= x;
+    }
+#endif
+    return best >= PAD_TIME ? INT_MAX : best; // only padding met padding
+}
+// Shortest travel time through a shared hub, INT_MAX if there is none (unreachable)
+// Answers for the roads as they were at build time, see isStale
+
+bool HubLabels::isStale() const {
+    return builtVersion != graph.getVersion();
+}
+
+static void writeVarint(ofstream &file, unsigned value) {
+    while (value >= 0x80) {
+        file.put((char)(value | 0x80));
+        value >>= 7;
+    }
+    file.put((char)value);
+}
+
+static bool readVarint(ifstream &file, unsigned &value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int c = file.get();
+        if (c == EOF)
+            return false;
+        value |= (unsigned)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+// 7 bits per byte, small numbers take one byte
+
+bool HubLabels::saveToFile(const string &filename) const {
+    if (isStale()) {
+        cout << "Hub labels are out of date, build them first\n";
+        return false;
+    }
+
+    ofstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        cout << "Save failed\n";
+        return false;
+    }
+
+    unsigned long long fingerprint = mapFingerprint();
+    int n = nodeIds.size();
+    file.write((const char *)&LABEL_FILE_MAGIC, sizeof(LABEL_FILE_MAGIC));
+    file.write((const char *)&fingerprint, sizeof(fingerprint));
+    file.write((const char *)&buildSeconds, sizeof(buildSeconds));
+    file.write((const char *)&n, sizeof(n));
+    for (int id : nodeIds)
+        file.write((const char *)&id, sizeof(id));
+
+    // hubs as gaps from the previous hub, times as they are, both as varints
+    for (int r = 0; r < n; r++) {
+        int size = find(hubs.begin() + labelStart[r], hubs.begin() + labelStart[r + 1], NO_HUB) - hubs.begin() - labelStart[r];
+        writeVarint(file, size);
+        int previous = 0;
+        for (int k = labelStart[r]; k < labelStart[r] + size; k++) {
+            writeVarint(file, hubs[k] - previous);
+            writeVarint(file, dists[k]);
+            previous = hubs[k];
+        }
+    }
+
+    file.close();
+    cout << "Hub labels saved\n";
+    return true;
+}
+
+bool HubLabels::loadFromFile(const string &filename) {
+    ifstream file(filename, ios::binary);
+    if (!file.is_open())
+        return false;
+
+    unsigned magic = 0;
+    unsigned long long fingerprint = 0;
+    double seconds = 0;
+    int n = 0;
+    file.read((char *)&magic, sizeof(magic));
+    file.read((char *)&fingerprint, sizeof(fingerprint));
+    file.read((char *)&seconds, sizeof(seconds));
+    file.read((char *)&n, sizeof(n));
+    if (!file || magic != LABEL_FILE_MAGIC || n != graph.getNodeCount() || fingerprint != mapFingerprint()) {
+        cout << "Saved hub labels do not match the current map\n";
+        return false;
+    }
+
+    vector<int> ids(n);
+    for (int &id : ids)
+        file.read((char *)&id, sizeof(id));
+
+    vector<int> start(n + 1);
+    vector<int> h, d;
+    long long count = 0;
+    for (int r = 0; r < n; r++) {
+        start[r] = h.size();
+        unsigned size, gap, time;
+        if (!readVarint(file, size)) {
+            cout << "Hub label file is damaged\n";
+            return false;
+        }
+        int previous = 0;
+        for (unsigned k = 0; k < size; k++) {
+            if (!readVarint(file, gap) || !readVarint(file, time)) {
+                cout << "Hub label file is damaged\n";
+                return false;
+            }
+            previous += gap;
+            h.push_back(previous);
+            d.push_back(time);
+        }
+        count += size;
+        padLabel(h, d);
+    }
+    start[n] = h.size();
+
+    nodeIds.swap(ids);
+    labelStart.swap(start);
+    hubs.swap(h);
+    dists.swap(d);
+    entries = count;
+    rankOf.clear();
+    for (int r = 0; r < n; r++)
+        rankOf[nodeIds[r]] = r;
+    buildSeconds = seconds;
+    builtVersion = graph.getVersion();
+    cout << "Hub labels loaded\n";
+    return true;
+}
+// Only accepted when the file was written for exactly these roads, times and closures
+
+double HubLabels::getBuildSeconds() const {
+    return buildSeconds;
+}
+
+size_t HubLabels::getMemoryBytes() const {
+    size_t bytes = (nodeIds.size() + labelStart.size() + hubs.size() + dists.size()) * sizeof(int);
+    bytes += rankOf.size() * (sizeof(pair<int, int>) + 2 * sizeof(void *)); // node plus bucket, roughly
+    return bytes;
+}
+
+double HubLabels::getAverageLabelSize() const {
+    if (nodeIds.empty())
+        return 0;
+    return (double)entries / nodeIds.size(); // padding left out
+}
+
+void HubLabels::display() const {
+    cout << "\nHub Labels\n";
+    cout << fixed << setprecision(1);
+    cout << "Locations:       " << nodeIds.size() << endl;
+    cout << "Hubs per label:  " << getAverageLabelSize() << endl;
+    cout << "Memory:          " << getMemoryBytes() / (1024.0 * 1024.0) << " MB\n";
+    cout << "Build time:      " << buildSeconds << " s\n";
+    cout << "Up to date:      " << (isStale() ? "no" : "yes") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
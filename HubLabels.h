@@ -0,0 +1,41 @@
+#ifndef HUB_LABELS_H
+#define HUB_LABELS_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+class Graph;
+
+class HubLabels {
+    Graph &graph;
+    long long builtVersion;        // graph version the labels match, -1 before the first build
+    double buildSeconds;
+
+    vector<int> nodeIds;           // by rank, most important first
+    unordered_map<int, int> rankOf;
+    vector<int> labelStart;        // rank -> first entry of its label, labelStart[n] = array size
+    vector<int> hubs;              // hub ranks, ascending within a label, padded to whole blocks
+    vector<int> dists;             // travel time to the hub, same position as in hubs
+    long long entries;             // hubs without the padding
+
+    unsigned long long mapFingerprint() const;
+
+public:
+    HubLabels(Graph &g);
+
+    void build();
+    int query(int start, int end) const;
+    bool isStale() const;
+
+    bool saveToFile(const string &filename) const;
+    bool loadFromFile(const string &filename);
+
+    double getBuildSeconds() const;
+    size_t getMemoryBytes() const;
+    double getAverageLabelSize() const;
+    void display() const;
+};
+
+#endif
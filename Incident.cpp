@@ -1,6 +1,10 @@
 #include "Incident.h"
 #include "utils.h"
 #include "Graph.h"
+#include "SharedMap.h"
+#include "StateLog.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include <iostream>
 #include <fstream>
 #include <algorithm>
@@ -8,11 +12,12 @@
 #include <ctime>
 #include <vector>
 #include <string>
+#include <atomic>
 
 using namespace std;
 
 Incident::Incident(int loc, const string &pri, const string &desc) {
-    static int nextId = 1; // Static variable to generate unique IDs
+    static atomic<int> nextId(1); // Static counter to generate unique IDs, safe across threads
     id = nextId++;
     location = loc;
     priority = pri;
@@ -67,38 +72,75 @@ void Incident::display() const {
 // Incident 5 | Node 12 | HIGH | Accident case (active)
 
 bool CompareIncidentPriority::operator()(const Incident* a, const Incident* b) {
-    return a->getPriorityValue() < b->getPriorityValue(); // Higher priority incidents come first
+    if (a->getPriorityValue() != b->getPriorityValue())
+        return a->getPriorityValue() < b->getPriorityValue(); // Higher priority incidents come first
+    return a->getId() > b->getId(); // Same priority: older incident first
 }
-//Returns true if a has lower priority than b
+//Returns true if a should be handled after b
+
+static Gauge &queueDepth() {
+    static Gauge &depth = MetricsRegistry::instance().gauge(
+        "ers_incident_queue_depth", "", "Incidents waiting in incident queues");
+    return depth;
+}
+// Shared by every queue, so simulations running next to the dispatcher add to it too
 
 IncidentQueue::IncidentQueue() {
+    verbose = true;
+    journal = nullptr;
     srand(time(0));
 }
 
 IncidentQueue::~IncidentQueue() {
+    journal = nullptr; // going away is not a change worth logging
     clearAll();
 }
 
-void IncidentQueue::addIncident(int location, const string &priority, const string &description) {
+Incident* IncidentQueue::addIncident(int location, const string &priority, const string &description) {
+    TRACE_SPAN_ARG("incidents", "add_incident", location);
     Incident* inc = new Incident(location, priority, description);
     pq.push(inc);
+    queueDepth().add(1);
     allIncidents.push_back(inc);
+    if (journal)
+        journal->incidentAdded(*inc);
 
-    cout << "Incident added\n";
+    if (verbose)
+        cout << "Incident added\n";
+    return inc;
 }
 // Creates new incident and adds to priority queue and list
 
+bool IncidentQueue::resolveIncident(int incidentId) {
+    TRACE_SPAN_ARG("incidents", "resolve_incident", incidentId);
+    for (auto inc : allIncidents) {
+        if (inc->getId() == incidentId) {
+            if (inc->isResolved())
+                return false;
+            inc->resolve();
+            if (journal)
+                journal->incidentResolved(incidentId);
+            return true;
+        }
+    }
+    return false;
+}
+// Marks an incident as handled, it stays in the list but no longer counts as active
+
 void IncidentQueue::reAddIncident(Incident* inc) {
     pq.push(inc);
+    queueDepth().add(1);
 }
 // Puts an incident back in the queue during reassignment if incident wasn't handled
 
 Incident* IncidentQueue::getNextIncident() {
+    TRACE_SPAN("incidents", "dequeue");
     if (pq.empty())
         return nullptr;
 
     Incident* next = pq.top(); // Get highest priority incident
     pq.pop(); // Remove it from the queue
+    queueDepth().add(-1);
     return next;
 }
 // Gets the most urgent incident
@@ -120,6 +162,10 @@ int IncidentQueue::getActiveCount() const {
     return count;
 } // Counts how many incidents are still unresolved
 
+vector<Incident*> IncidentQueue::getAllIncidents() const {
+    return allIncidents;
+} // Every incident ever added, resolved ones included
+
 void IncidentQueue::displayAll() const {
     cout << "\nIncidents:\n";
 
@@ -144,6 +190,17 @@ void IncidentQueue::displayAll() const {
 }
 
 void IncidentQueue::loadFromFile(const string &filename, Graph &graph) {
+    loadFromFile(filename, [&](int node) { return graph.hasNode(node); });
+}
+
+void IncidentQueue::loadFromFile(const string &filename, const SharedMap &map) {
+    loadFromFile(filename, [&](int node) { return map.hasNode(node); });
+}
+
+void IncidentQueue::loadFromFile(const string &filename, const function<bool(int)> &onMap) {
+    static Histogram &loadTime = MetricsRegistry::instance().histogram("ers_load_seconds", "file=\"incidents\"");
+    ScopedTimer timer(loadTime);
+    TRACE_SPAN("incidents", "load_incidents");
     ifstream file(filename);
 
     if (!file.is_open()) {
@@ -162,18 +219,19 @@ void IncidentQueue::loadFromFile(const string &filename, Graph &graph) {
             string pri = parts[1];
             string desc = parts[2];
 
-            auto nodes = graph.getAllNodes();
-            if (find(nodes.begin(), nodes.end(), loc) != nodes.end()) {
+            if (onMap(loc)) {
                 addIncident(loc, pri, desc);
             }
         }
     }
 
     file.close();
-    cout << "Incidents loaded\n";
+    if (verbose)
+        cout << "Incidents loaded\n";
 }
 
 void IncidentQueue::saveToFile(const string &filename) const {
+    TRACE_SPAN("incidents", "save_incidents");
     ofstream file(filename);
 
     if (!file.is_open()) {
@@ -185,7 +243,7 @@ void IncidentQueue::saveToFile(const string &filename) const {
         if (!inc->isResolved()) {
             file << inc->getLocation() << ","
                  << inc->getPriority() << ","
-                 << inc->getDescription() << endl;
+                 << inc->getDescription() << '\n';
         }
     }
 
@@ -224,6 +282,7 @@ void IncidentQueue::generateTestIncidents(int count, Graph &graph) {
 } // Creates random incidents for testing
 
 void IncidentQueue::clearAll() {
+    queueDepth().add(-(long long)pq.size());
     while (!pq.empty())
         pq.pop();
 
@@ -231,5 +290,16 @@ void IncidentQueue::clearAll() {
         delete inc;
 
     allIncidents.clear();
-    cout << "Incidents cleared\n";
+    if (journal)
+        journal->incidentsCleared();
+    if (verbose)
+        cout << "Incidents cleared\n";
 }
+
+void IncidentQueue::setVerbose(bool on) {
+    verbose = on;
+} // Turns routine messages off for bulk work such as simulations
+
+void IncidentQueue::setJournal(StateLog* log) {
+    journal = log;
+} // Changes made from here on are written to the state log
@@ -4,9 +4,12 @@
 #include <queue>
 #include <vector>
 #include <string>
+#include <functional>
 using namespace std;
 
 class Graph;
+class SharedMap;
+class StateLog;
 
 class Incident {
     int id;
@@ -36,22 +39,31 @@ struct CompareIncidentPriority {
 class IncidentQueue {
     priority_queue<Incident*, vector<Incident*>, CompareIncidentPriority> pq;
     vector<Incident*> allIncidents;
+    bool verbose;
+    StateLog* journal; // records every added, resolved or cleared incident when set
+
+    void loadFromFile(const string &filename, const function<bool(int)> &onMap);
     
 public:
     IncidentQueue();
     ~IncidentQueue();
     
-    void addIncident(int location, const string &priority, const string &description);
+    Incident* addIncident(int location, const string &priority, const string &description);
     void reAddIncident(Incident* inc);
+    bool resolveIncident(int incidentId);
     Incident* getNextIncident();
     bool isEmpty() const;
     int size() const;
     int getActiveCount() const;
+    vector<Incident*> getAllIncidents() const;
     void displayAll() const;
     void loadFromFile(const string &filename, Graph &graph);
+    void loadFromFile(const string &filename, const SharedMap &map);
     void saveToFile(const string &filename) const;
     void generateTestIncidents(int count, Graph &graph);
     void clearAll();
+    void setVerbose(bool on);
+    void setJournal(StateLog* log);
 };
 
 #endif
\ No newline at end of file
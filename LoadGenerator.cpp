@@ -0,0 +1,186 @@
+#include "LoadGenerator.h"
+#include "Graph.h"
+#include "ResourceManager.h"
+#include "Incident.h"
+#include "Ambulance.h"
+#include "Metrics.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+static const int MAX_RATE_STEPS = 12;
+static const double RATE_STEP = 1.25; // each capacity search step offers 25% more load
+
+LoadTestConfig::LoadTestConfig() {
+    arrivalsPerSecond = 100;
+    seconds = 5;
+    highShare = 0.2;
+    mediumShare = 0.5;
+    hotspots = 0;
+    hotspotShare = 0.7;
+    hotspotHops = 3;
+    seed = 1;
+}
+
+LoadGenerator::LoadGenerator(Graph &g, ResourceManager &r, IncidentQueue &q, const LoadTestConfig &cfg)
+    : graph(g), rm(r), queue(q), config(cfg), rng(cfg.seed) {
+    nodes = graph.getAllNodes();
+    if (nodes.empty())
+        return;
+
+    for (int h = 0; h < config.hotspots; h++) {
+        // every place within a few roads of a random centre
+        vector<int> area = {nodes[rng() % nodes.size()]};
+        unordered_set<int> seen(area.begin(), area.end());
+        size_t levelStart = 0;
+        for (int hop = 0; hop < config.hotspotHops; hop++) {
+            size_t levelEnd = area.size();
+            for (size_t i = levelStart; i < levelEnd; i++) {
+                for (auto &nb : graph.getNeighbors(area[i])) {
+                    if (seen.insert(nb.first).second)
+                        area.push_back(nb.first);
+                }
+            }
+            levelStart = levelEnd;
+        }
+        hotspotAreas.push_back(area);
+    }
+}
+
+int LoadGenerator::pickLocation() {
+    uniform_real_distribution<double> coin(0, 1);
+    if (!hotspotAreas.empty() && coin(rng) < config.hotspotShare) {
+        auto &area = hotspotAreas[rng() % hotspotAreas.size()];
+        return area[rng() % area.size()];
+    }
+    return nodes[rng() % nodes.size()];
+}
+// Hotspot incidents pick a hotspot first, then a place around it, the others fall anywhere
+
+LoadTestReport LoadGenerator::run(double arrivalsPerSecond) {
+    LoadTestReport report = {};
+    report.targetRate = arrivalsPerSecond;
+    if (nodes.empty() || arrivalsPerSecond <= 0)
+        return report;
+
+    // the whole arrival schedule is drawn up front, so drawing it doesn't slow the dispatcher down
+    long long total = max(1LL, (long long)(arrivalsPerSecond * config.seconds));
+    exponential_distribution<double> gap(arrivalsPerSecond);
+    uniform_real_distribution<double> coin(0, 1);
+    vector<long long> due(total);   // nanoseconds after the start
+    vector<int> where(total);
+    vector<string> priority(total);
+    double t = 0;
+    for (long long i = 0; i < total; i++) {
+        t += gap(rng);
+        due[i] = (long long)(t * 1e9);
+        where[i] = pickLocation();
+        double p = coin(rng);
+        priority[i] = p < config.highShare ? "HIGH" : p < config.highShare + config.mediumShare ? "MEDIUM" : "LOW";
+    }
+
+    queue.clearAll();
+    Histogram latency;
+    unordered_map<int, long long> dueOf; // incident ID -> scheduled arrival
+    long long cutoff = (long long)((config.seconds * 2 + 1) * 1e9);
+    long long next = 0, serviceNs = 0;
+
+    auto start = chrono::steady_clock::now();
+    auto elapsed = [&start]() {
+        return (long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    };
+
+    while (report.handled + report.noUnit < total) {
+        long long now = elapsed();
+        while (next < total && due[next] <= now) {
+            Incident* inc = queue.addIncident(where[next], priority[next], "load test");
+            dueOf[inc->getId()] = due[next];
+            next++;
+        }
+
+        if (queue.isEmpty()) {
+            this_thread::sleep_until(start + chrono::nanoseconds(due[next]));
+            continue;
+        }
+        if (now > cutoff) {
+            report.fellBehind = true; // arrivals keep coming faster than they are handled
+            break;
+        }
+
+        // the dispatch path: most urgent incident, nearest unit, dispatch, call completed
+        long long began = elapsed();
+        Incident* inc = queue.getNextIncident();
+        Ambulance* amb = rm.findNearestAmbulance(inc->getLocation(), graph);
+        if (amb) {
+            rm.dispatchAmbulance(amb->getId(), inc->getId(), inc->getLocation());
+            rm.completeAssignment(amb->getId());
+            report.handled++;
+        } else {
+            report.noUnit++;
+        }
+        queue.resolveIncident(inc->getId());
+
+        long long done = elapsed();
+        serviceNs += done - began;
+        latency.record(done - dueOf[inc->getId()]); // counted from when it was due, not when we got to it
+    }
+
+    double wall = elapsed() / 1e9;
+    queue.clearAll();
+
+    HistogramSnapshot snap = latency.snapshot();
+    long long finished = report.handled + report.noUnit;
+    report.sent = next;
+    report.achievedRate = wall > 0 ? finished / wall : 0;
+    report.p50Ms = snap.percentile(50) / 1e6;
+    report.p99Ms = snap.percentile(99) / 1e6;
+    report.p999Ms = snap.percentile(99.9) / 1e6;
+    report.maxMs = snap.max / 1e6;
+    report.meanServiceMs = finished > 0 ? serviceNs / 1e6 / finished : 0;
+    return report;
+}
+// Open loop: arrivals follow their own Poisson schedule, a slow dispatch delays every incident behind it
+// and that wait is part of their latency, so stalls can't hide the way they do in a timing loop
+
+double LoadGenerator::findMaxRate(double p99TargetMs, vector<LoadTestReport> &steps) {
+    LoadTestReport probe = run(config.arrivalsPerSecond);
+    steps.push_back(probe);
+    if (probe.meanServiceMs <= 0)
+        return 0;
+
+    // one dispatcher can't beat 1 / service time, start below that and step up until the target is missed
+    // (a quiet probe often measures a slower service time than a busy run, so the estimate is only a start)
+    double rate = 500 / probe.meanServiceMs;
+    double best = 0;
+
+    for (int i = 0; i < MAX_RATE_STEPS; i++, rate *= RATE_STEP) {
+        LoadTestReport step = run(rate);
+        steps.push_back(step);
+        if (step.fellBehind || step.p99Ms > p99TargetMs)
+            break;
+        best = step.targetRate;
+    }
+
+    if (!probe.fellBehind && probe.p99Ms <= p99TargetMs)
+        best = max(best, probe.targetRate);
+    return best;
+}
+// Highest arrival rate tried whose p99 latency stayed within the target
+
+void LoadGenerator::printReport(const LoadTestReport &report) {
+    cout << fixed << setprecision(1);
+    cout << "Target " << report.targetRate << "/s, handled " << report.achievedRate << "/s"
+         << " | Sent: " << report.sent << " | Handled: " << report.handled
+         << " | No unit: " << report.noUnit << (report.fellBehind ? " | FELL BEHIND" : "") << endl;
+    cout << setprecision(3) << "Latency from scheduled arrival (ms): p50 " << report.p50Ms
+         << "  p99 " << report.p99Ms << "  p99.9 " << report.p999Ms << "  max " << report.maxMs
+         << "  | service " << report.meanServiceMs << " ms" << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
@@ -0,0 +1,59 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <vector>
+#include <random>
+using namespace std;
+
+class Graph;
+class ResourceManager;
+class IncidentQueue;
+
+struct LoadTestConfig {
+    double arrivalsPerSecond;   // target rate, arrivals are scheduled whether or not we keep up
+    double seconds;             // length of one run
+    double highShare;           // fraction of HIGH incidents
+    double mediumShare;         // fraction of MEDIUM incidents, the rest are LOW
+    int hotspots;               // places incidents cluster around, 0 = uniform over the map
+    double hotspotShare;        // fraction of incidents near a hotspot
+    int hotspotHops;            // how far from its hotspot an incident can be
+    unsigned seed;
+
+    LoadTestConfig();
+};
+
+struct LoadTestReport {
+    double targetRate;
+    double achievedRate;        // incidents handled per second of wall time
+    long long sent;             // arrivals that were due before the run stopped
+    long long handled;
+    long long noUnit;           // no ambulance could reach the incident
+    bool fellBehind;            // the backlog was still growing when the run was cut off
+    double p50Ms;               // latency from the scheduled arrival to the completed dispatch
+    double p99Ms;
+    double p999Ms;
+    double maxMs;
+    double meanServiceMs;       // time actually spent per incident, without waiting in the queue
+};
+
+class LoadGenerator {
+    Graph &graph;
+    ResourceManager &rm;
+    IncidentQueue &queue;
+    LoadTestConfig config;
+
+    mt19937 rng;
+    vector<int> nodes;
+    vector<vector<int>> hotspotAreas; // nodes within hotspotHops of each hotspot
+
+    int pickLocation();
+
+public:
+    LoadGenerator(Graph &g, ResourceManager &r, IncidentQueue &q, const LoadTestConfig &cfg);
+
+    LoadTestReport run(double arrivalsPerSecond);
+    double findMaxRate(double p99TargetMs, vector<LoadTestReport> &steps);
+    static void printReport(const LoadTestReport &report);
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include "Metrics.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
+
+using namespace std;
+
+static atomic<int> nextShard(0);
+static thread_local int threadShard = nextShard++ % METRIC_SHARDS; // fixed per thread
+
+void Counter::add(long long n) {
+    slots[threadShard].value.fetch_add(n, memory_order_relaxed);
+}
+
+long long Counter::value() const {
+    long long total = 0;
+    for (auto &s : slots)
+        total += s.value.load(memory_order_relaxed);
+    return total;
+}
+
+void Gauge::add(long long n) {
+    current.fetch_add(n, memory_order_relaxed);
+}
+
+void Gauge::set(long long v) {
+    current.store(v, memory_order_relaxed);
+}
+
+long long Gauge::value() const {
+    return current.load(memory_order_relaxed);
+}
+
+Histogram::Histogram() : shards(new Shard[METRIC_SHARDS]) {
+    for (int s = 0; s < METRIC_SHARDS; s++) {
+        for (auto &b : shards[s].buckets)
+            b.store(0, memory_order_relaxed);
+        shards[s].count.store(0, memory_order_relaxed);
+        shards[s].sum.store(0, memory_order_relaxed);
+        shards[s].max.store(0, memory_order_relaxed);
+    }
+}
+
+int Histogram::bucketOf(long long value) {
+    const long long sub = 1LL << HISTOGRAM_SUB_BITS;
+    if (value < sub)
+        return value < 0 ? 0 : value; // small values get a bucket each
+
+    int top = 63 - __builtin_clzll(value);
+    int shift = top - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * sub + ((value >> shift) - sub);
+}
+// The highest set bit picks the power of two, the next HISTOGRAM_SUB_BITS bits the bucket inside it
+
+long long Histogram::bucketTop(int bucket) {
+    const long long sub = 1LL << HISTOGRAM_SUB_BITS;
+    if (bucket < sub)
+        return bucket;
+
+    int shift = bucket / sub - 1;
+    long long low = (sub + bucket % sub) << shift;
+    return low + (1LL << shift) - 1;
+}
+// Largest value that lands in the bucket
+
+void Histogram::record(long long value) {
+    Shard &s = shards[threadShard];
+    s.buckets[bucketOf(value)].fetch_add(1, memory_order_relaxed);
+    s.count.fetch_add(1, memory_order_relaxed);
+    s.sum.fetch_add(value, memory_order_relaxed);
+
+    long long seen = s.max.load(memory_order_relaxed);
+    while (value > seen && !s.max.compare_exchange_weak(seen, value, memory_order_relaxed)) {
+    }
+}
+
+HistogramSnapshot Histogram::snapshot() const {
+    HistogramSnapshot snap;
+    snap.buckets.assign(HISTOGRAM_BUCKETS, 0);
+    snap.count = snap.sum = snap.max = 0;
+
+    for (int s = 0; s < METRIC_SHARDS; s++) {
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+            snap.buckets[b] += shards[s].buckets[b].load(memory_order_relaxed);
+        snap.count += shards[s].count.load(memory_order_relaxed);
+        snap.sum += shards[s].sum.load(memory_order_relaxed);
+        snap.max = max(snap.max, shards[s].max.load(memory_order_relaxed));
+    }
+    return snap;
+}
+// Adds the shards up, recording goes on meanwhile so the fields can be a few samples apart
+
+long long HistogramSnapshot::percentile(double p) const {
+    long long total = 0;
+    for (long long c : buckets)
+        total += c;
+    if (total == 0)
+        return 0;
+
+    long long rank = (long long)(p / 100.0 * total + 0.5);
+    rank = std::max(1LL, std::min(rank, total));
+
+    long long seen = 0;
+    for (int b = 0; b < (int)buckets.size(); b++) {
+        seen += buckets[b];
+        if (seen >= rank)
+            return std::min(Histogram::bucketTop(b), max);
+    }
+    return max;
+}
+
+double HistogramSnapshot::mean() const {
+    return count == 0 ? 0 : (double)sum / count;
+}
+
+MetricsRegistry::MetricsRegistry() : dumperStopping(false), dumpSeconds(0) {}
+
+MetricsRegistry::~MetricsRegistry() {
+    stopPeriodicDump();
+}
+
+MetricsRegistry &MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Entry &MetricsRegistry::find(const string &name, const string &labels, const string &text) {
+    lock_guard<mutex> guard(lock);
+    Entry &e = entries[{name, labels}];
+    if (e.name.empty()) {
+        e.name = name;
+        e.labels = labels;
+    }
+    if (!text.empty())
+        help[name] = text;
+    return e;
+}
+
+Counter &MetricsRegistry::counter(const string &name, const string &labels, const string &help) {
+    Entry &e = find(name, labels, help);
+    lock_guard<mutex> guard(lock);
+    if (!e.counter)
+        e.counter.reset(new Counter());
+    return *e.counter;
+}
+
+Gauge &MetricsRegistry::gauge(const string &name, const string &labels, const string &help) {
+    Entry &e = find(name, labels, help);
+    lock_guard<mutex> guard(lock);
+    if (!e.gauge)
+        e.gauge.reset(new Gauge());
+    return *e.gauge;
+}
+
+Histogram &MetricsRegistry::histogram(const string &name, const string &labels, const string &help) {
+    Entry &e = find(name, labels, help);
+    lock_guard<mutex> guard(lock);
+    if (!e.histogram)
+        e.histogram.reset(new Histogram());
+    return *e.histogram;
+}
+// Callers keep the returned reference (usually in a function static), the lookup is the only locked part
+
+static bool inSeconds(const string &name) {
+    return name.size() > 8 && name.compare(name.size() - 8, 8, "_seconds") == 0;
+}
+// Histograms named *_seconds are recorded in nanoseconds and exported in seconds
+
+static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+static string withLabels(const string &labels, const string &extra = "") {
+    string all = labels;
+    if (!extra.empty())
+        all += (all.empty() ? "" : ",") + extra;
+    return all.empty() ? "" : "{" + all + "}";
+}
+
+void MetricsRegistry::writePrometheus(ostream &out) const {
+    lock_guard<mutex> guard(lock);
+    string lastName;
+
+    for (auto &item : entries) {
+        const Entry &e = item.second;
+        bool header = e.name != lastName;
+        lastName = e.name;
+
+        auto text = help.find(e.name);
+        if (header && text != help.end())
+            out << "# HELP " << e.name << " " << text->second << '\n';
+
+        if (e.counter) {
+            if (header)
+                out << "# TYPE " << e.name << " counter\n";
+            out << e.name << withLabels(e.labels) << " " << e.counter->value() << '\n';
+        } else if (e.gauge) {
+            if (header)
+                out << "# TYPE " << e.name << " gauge\n";
+            out << e.name << withLabels(e.labels) << " " << e.gauge->value() << '\n';
+        } else if (e.histogram) {
+            if (header)
+                out << "# TYPE " << e.name << " summary\n";
+            HistogramSnapshot snap = e.histogram->snapshot();
+            double scale = inSeconds(e.name) ? 1e-9 : 1;
+            for (double q : QUANTILES) {
+                ostringstream label;
+                label << "quantile=\"" << q << "\"";
+                out << e.name << withLabels(e.labels, label.str()) << " " << snap.percentile(q * 100) * scale << '\n';
+            }
+            out << e.name << "_sum" << withLabels(e.labels) << " " << snap.sum * scale << '\n';
+            out << e.name << "_count" << withLabels(e.labels) << " " << snap.count << '\n';
+        }
+    }
+}
+// Prometheus text format, histograms become summaries with fixed quantiles
+
+static string jsonEscape(const string &s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+void MetricsRegistry::writeJson(ostream &out) const {
+    lock_guard<mutex> guard(lock);
+    out << "{\n  \"metrics\": [";
+    bool first = true;
+
+    for (auto &item : entries) {
+        const Entry &e = item.second;
+        out << (first ? "\n" : ",\n") << "    {\"name\": \"" << e.name << "\", \"labels\": \""
+            << jsonEscape(e.labels) << "\", ";
+        first = false;
+
+        if (e.counter) {
+            out << "\"type\": \"counter\", \"value\": " << e.counter->value() << "}";
+        } else if (e.gauge) {
+            out << "\"type\": \"gauge\", \"value\": " << e.gauge->value() << "}";
+        } else if (e.histogram) {
+            HistogramSnapshot snap = e.histogram->snapshot();
+            double scale = inSeconds(e.name) ? 1e-9 : 1;
+            out << "\"type\": \"histogram\", \"count\": " << snap.count << ", \"sum\": " << snap.sum * scale
+                << ", \"mean\": " << snap.mean() * scale << ", \"max\": " << snap.max * scale
+                << ", \"p50\": " << snap.percentile(50) * scale << ", \"p90\": " << snap.percentile(90) * scale
+                << ", \"p99\": " << snap.percentile(99) * scale << ", \"p999\": " << snap.percentile(99.9) * scale
+                << "}";
+        } else {
+            out << "\"type\": \"none\"}";
+        }
+    }
+    out << "\n  ]\n}\n";
+}
+
+bool MetricsRegistry::saveToFiles(const string &promPath, const string &jsonPath) const {
+    string paths[2] = {promPath, jsonPath};
+    for (int i = 0; i < 2; i++) {
+        string temp = paths[i] + ".tmp";
+        ofstream file(temp);
+        if (!file.is_open())
+            return false;
+
+        if (i == 0)
+            writePrometheus(file);
+        else
+            writeJson(file);
+        file.close();
+
+        if (rename(temp.c_str(), paths[i].c_str()) != 0)
+            return false;
+    }
+    return true;
+}
+// Renamed into place so a scraper never reads a half written file
+
+void MetricsRegistry::dumperLoop() {
+    unique_lock<mutex> guard(dumperLock);
+    while (!dumperWake.wait_for(guard, chrono::seconds(dumpSeconds), [this] { return dumperStopping; }))
+        saveToFiles(promFile, jsonFile);
+    saveToFiles(promFile, jsonFile); // the last numbers before stopping, e.g. at exit
+}
+
+void MetricsRegistry::startPeriodicDump(int seconds, const string &promPath, const string &jsonPath) {
+    stopPeriodicDump();
+    if (seconds <= 0)
+        return;
+
+    dumperStopping = false;
+    dumpSeconds = seconds;
+    promFile = promPath;
+    jsonFile = jsonPath;
+    dumper = thread(&MetricsRegistry::dumperLoop, this);
+}
+// Writes both files every few seconds from a background thread until stopped
+
+void MetricsRegistry::stopPeriodicDump() {
+    if (!dumper.joinable())
+        return;
+
+    {
+        lock_guard<mutex> guard(dumperLock);
+        dumperStopping = true;
+    }
+    dumperWake.notify_all();
+    dumper.join();
+}
+
+void MetricsRegistry::display() const {
+    lock_guard<mutex> guard(lock);
+    cout << "\nMetrics:\n";
+
+    for (auto &item : entries) {
+        const Entry &e = item.second;
+        cout << "  " << e.name << withLabels(e.labels) << ": ";
+
+        if (e.counter) {
+            cout << e.counter->value() << endl;
+        } else if (e.gauge) {
+            cout << e.gauge->value() << endl;
+        } else if (e.histogram) {
+            HistogramSnapshot snap = e.histogram->snapshot();
+            if (inSeconds(e.name)) {
+                ostringstream line; // keeps the fixed format out of cout
+                line << fixed << setprecision(1) << snap.count << " calls, us p50 " << snap.percentile(50) / 1000.0
+                     << "  p99 " << snap.percentile(99) / 1000.0 << "  max " << snap.max / 1000.0;
+                cout << line.str() << endl;
+            } else {
+                cout << snap.count << " samples, p50 " << snap.percentile(50) << "  p99 "
+                     << snap.percentile(99) << "  max " << snap.max << endl;
+            }
+        } else {
+            cout << "-" << endl;
+        }
+    }
+}
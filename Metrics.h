@@ -0,0 +1,125 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <ostream>
+using namespace std;
+
+const int METRIC_SHARDS = 8;      // threads spread over this many copies of every metric
+const int HISTOGRAM_SUB_BITS = 5; // 32 buckets per power of two, values kept within about 3%
+const int HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS) << HISTOGRAM_SUB_BITS;
+
+class Counter {
+    struct alignas(64) Slot {
+        atomic<long long> value{0};
+    };
+    Slot slots[METRIC_SHARDS]; // one cache line per shard, threads don't fight over it
+
+public:
+    void add(long long n = 1);
+    long long value() const;
+};
+// Monotonic count, e.g. nodes settled by all searches so far
+
+class Gauge {
+    atomic<long long> current{0};
+
+public:
+    void add(long long n);
+    void set(long long v);
+    long long value() const;
+};
+// Level that goes up and down, e.g. incidents waiting in queues
+
+struct HistogramSnapshot {
+    vector<long long> buckets;
+    long long count;
+    long long sum;
+    long long max;
+
+    long long percentile(double p) const;
+    double mean() const;
+};
+
+class Histogram {
+    struct Shard {
+        atomic<long long> buckets[HISTOGRAM_BUCKETS];
+        atomic<long long> count;
+        atomic<long long> sum;
+        atomic<long long> max;
+    };
+    unique_ptr<Shard[]> shards;
+
+public:
+    Histogram();
+    void record(long long value);
+    HistogramSnapshot snapshot() const;
+
+    static int bucketOf(long long value);
+    static long long bucketTop(int bucket);
+};
+// HDR style log-linear histogram of non-negative values (latencies are kept in nanoseconds)
+
+class MetricsRegistry {
+    struct Entry {
+        string name;
+        string labels; // Prometheus label list without braces, e.g. kind="dijkstra"
+        unique_ptr<Counter> counter;
+        unique_ptr<Gauge> gauge;
+        unique_ptr<Histogram> histogram;
+    };
+
+    mutable mutex lock;
+    map<pair<string, string>, Entry> entries; // (name, labels), sorted so exports group by name
+    map<string, string> help;                 // one description per name, shared by all its labels
+
+    thread dumper;
+    mutex dumperLock;
+    condition_variable dumperWake;
+    bool dumperStopping;
+    int dumpSeconds;
+    string promFile;
+    string jsonFile;
+
+    Entry &find(const string &name, const string &labels, const string &text);
+    void dumperLoop();
+
+public:
+    MetricsRegistry();
+    ~MetricsRegistry();
+    static MetricsRegistry &instance();
+
+    Counter &counter(const string &name, const string &labels = "", const string &help = "");
+    Gauge &gauge(const string &name, const string &labels = "", const string &help = "");
+    Histogram &histogram(const string &name, const string &labels = "", const string &help = "");
+
+    void writePrometheus(ostream &out) const;
+    void writeJson(ostream &out) const;
+    bool saveToFiles(const string &promPath, const string &jsonPath) const;
+    void startPeriodicDump(int seconds, const string &promPath, const string &jsonPath);
+    void stopPeriodicDump();
+    void display() const;
+};
+// Process-wide metrics, looked up once by name and then updated without locks
+
+class ScopedTimer {
+    Histogram &histogram;
+    chrono::steady_clock::time_point start;
+
+public:
+    ScopedTimer(Histogram &h) : histogram(h), start(chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        histogram.record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    }
+};
+// Records the time until the end of the enclosing block
+
+#endif
@@ -0,0 +1,319 @@
+#include "Reassigner.h"
+#include "Graph.h"
+#include "ResourceManager.h"
+#include "Incident.h"
+#include "Ambulance.h"
+#include "utils.h"
+#include <iostream>
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+bool MostUrgentFirst::operator()(const Incident* a, const Incident* b) const {
+    if (a->getPriorityValue() != b->getPriorityValue())
+        return a->getPriorityValue() > b->getPriorityValue();
+    return a->getId() < b->getId();
+}
+
+Reassigner::Reassigner(Graph &g, ResourceManager &r, IncidentQueue &q)
+    : graph(g), rm(r), incidents(q) {
+    evaluated = 0;
+    changed = 0;
+    listenerHandle = graph.addChangeListener([this](const vector<int> &roads) {
+        onRoadsChanged(roads);
+    });
+    rebuild();
+}
+
+Reassigner::~Reassigner() {
+    graph.removeChangeListener(listenerHandle);
+}
+
+void Reassigner::setPairing(Incident* inc, Ambulance* amb, int eta, vector<int> &route) {
+    clearPairing(inc);
+
+    Pairing &p = plan[inc];
+    p.amb = amb;
+    p.eta = eta;
+    p.route.swap(route);
+    owner[amb->getId()] = inc;
+    etas.insert(eta);
+    for (int road : p.route)
+        roadUsers[road].insert(inc);
+    waiting.erase(inc);
+}
+// Proposes amb for inc and indexes the roads its route uses
+
+void Reassigner::clearPairing(Incident* inc) {
+    Pairing &p = plan[inc];
+    if (p.amb) {
+        owner.erase(p.amb->getId());
+        etas.erase(etas.find(p.eta));
+        for (int road : p.route) {
+            auto it = roadUsers.find(road);
+            it->second.erase(inc);
+            if (it->second.empty())
+                roadUsers.erase(it);
+        }
+    }
+    p.amb = nullptr;
+    p.eta = INT_MAX;
+    p.route.clear();
+    waiting.insert(inc);
+}
+
+void Reassigner::removeIncident(Incident* inc) {
+    auto it = plan.find(inc);
+    if (it == plan.end())
+        return;
+
+    Ambulance* released = it->second.amb;
+    clearPairing(inc);
+    plan.erase(it);
+    byId.erase(inc->getId());
+    waiting.erase(inc);
+    dirty.erase(inc);
+
+    vector<Incident*> &here = atNode[inc->getLocation()];
+    here.erase(find(here.begin(), here.end(), inc));
+    if (here.empty())
+        atNode.erase(inc->getLocation());
+
+    if (released && released->isAvailable()) {
+        markAround(released->getLocation()); // the unit may now beat someone else's
+        markUnpaired();
+    }
+}
+
+void Reassigner::markAround(int node) {
+    if (etas.empty())
+        return;
+
+    // a unit at node can only improve pairings slower than the time to get there
+    int worst = *etas.rbegin();
+    for (int n : graph.isochrone(node, worst, currentMinuteOfDay())) {
+        auto it = atNode.find(n);
+        if (it == atNode.end())
+            continue;
+        for (auto inc : it->second)
+            if (plan[inc].amb)
+                dirty.insert(inc);
+    }
+}
+// Flags the paired incidents that something new at node could reach before their unit does
+
+void Reassigner::markUnpaired() {
+    for (auto inc : waiting)
+        dirty.insert(inc);
+}
+
+void Reassigner::evaluate(Incident* inc) {
+    if (inc->isResolved()) {
+        removeIncident(inc);
+        return;
+    }
+    evaluated++;
+
+    Pairing &p = plan[inc];
+    int minute = currentMinuteOfDay();
+
+    // units already proposed for a more urgent incident are off limits
+    auto usable = [&](const Ambulance &amb) {
+        auto it = owner.find(amb.getId());
+        return it == owner.end() || it->second == inc || MostUrgentFirst()(inc, it->second);
+    };
+    auto best = rm.findKNearest(inc->getLocation(), 1, graph, usable, minute);
+
+    if (best.empty()) {
+        Ambulance* released = p.amb;
+        clearPairing(inc);
+        if (released)
+            markAround(released->getLocation());
+        return;
+    }
+
+    Ambulance* amb = best[0].amb;
+    int eta = best[0].eta;
+    vector<int> route;
+
+    // keep the current unit on a tie so pairings don't flip back and forth
+    if (p.amb && p.amb != amb && p.amb->isAvailable()) {
+        int stay = graph.findRoute(p.amb->getLocation(), inc->getLocation(), minute, route);
+        if (stay <= eta) {
+            amb = p.amb;
+            eta = stay;
+        }
+    }
+    if (amb != p.amb || route.empty())
+        graph.findRoute(amb->getLocation(), inc->getLocation(), minute, route);
+
+    if (amb == p.amb) {
+        setPairing(inc, amb, eta, route); // same unit, fresh ETA and route
+        return;
+    }
+
+    Ambulance* released = p.amb;
+    auto taken = owner.find(amb->getId());
+    if (taken != owner.end()) {
+        Incident* loser = taken->second; // less urgent, has to look again
+        clearPairing(loser);
+        dirty.insert(loser);
+    }
+
+    setPairing(inc, amb, eta, route);
+    changed++;
+
+    if (released && released->isAvailable()) {
+        markAround(released->getLocation());
+        markUnpaired();
+    }
+}
+// Gives one incident the nearest unit no more urgent incident holds, taking it from a
+// less urgent one if needed, and flags whoever that change can affect
+
+RoadSeen Reassigner::look(int road) const {
+    Road r = graph.getRoad(road);
+    return {r.weight, r.profile, graph.isRoadBlocked(r.src, r.dest)};
+}
+
+void Reassigner::onRoadsChanged(const vector<int> &roads) {
+    for (int road : roads) {
+        bool known = road < (int)seen.size();
+        for (int id = seen.size(); id < graph.getEdgeCount(); id++)
+            seen.push_back(look(id)); // added since the last look, each as it is now
+
+        RoadSeen now = look(road);
+        RoadSeen was = seen[road];
+        seen[road] = now;
+
+        bool faster = !now.blocked && (was.blocked || now.weight < was.weight);
+        if (!known || was.profile != now.profile || (was.weight == now.weight && was.blocked == now.blocked))
+            faster = true; // new road, other profile or a change we can't see, it may have got faster
+
+        auto users = roadUsers.find(road);
+        if (users != roadUsers.end())
+            for (auto inc : users->second)
+                dirty.insert(inc); // their ETA is out of date either way
+
+        if (faster) {
+            // an open or faster road can only help routes passing near it
+            Road r = graph.getRoad(road);
+            markAround(r.src);
+            markAround(r.dest);
+            markUnpaired();
+        }
+    }
+}
+// A closed or slower road only hurts the pairings whose route drives it, nobody else can gain
+
+void Reassigner::incidentAdded(Incident* inc) {
+    if (!inc || inc->isResolved() || plan.count(inc))
+        return;
+
+    plan[inc] = {nullptr, INT_MAX, {}};
+    byId[inc->getId()] = inc;
+    atNode[inc->getLocation()].push_back(inc);
+    waiting.insert(inc);
+    dirty.insert(inc);
+}
+// A new incident only needs its own evaluation, it takes a unit from less urgent ones if it must
+
+void Reassigner::incidentServed(int incidentId) {
+    auto it = byId.find(incidentId);
+    if (it != byId.end())
+        removeIncident(it->second);
+}
+// A unit was dispatched to the incident (or it was resolved), it leaves the plan
+
+void Reassigner::unitFreed(Ambulance* amb) {
+    if (!amb || !amb->isAvailable())
+        return;
+    markAround(amb->getLocation());
+    markUnpaired();
+}
+
+void Reassigner::unitTaken(Ambulance* amb) {
+    if (!amb)
+        return;
+
+    auto it = owner.find(amb->getId());
+    if (it == owner.end())
+        return;
+
+    Incident* inc = it->second;
+    clearPairing(inc);
+    dirty.insert(inc);
+}
+
+int Reassigner::update() {
+    evaluated = 0;
+    changed = 0;
+    while (!dirty.empty()) {
+        Incident* inc = *dirty.begin(); // most urgent first, like a full pass
+        dirty.erase(dirty.begin());
+        evaluate(inc);
+    }
+    return evaluated;
+}
+// Re-evaluates only the pairings flagged since the last update, returns how many
+
+void Reassigner::rebuild() {
+    plan.clear();
+    byId.clear();
+    waiting.clear();
+    owner.clear();
+    roadUsers.clear();
+    atNode.clear();
+    etas.clear();
+    dirty.clear();
+
+    seen.clear();
+    for (int road = 0; road < graph.getEdgeCount(); road++)
+        seen.push_back(look(road));
+
+    unordered_set<int> served;
+    for (auto amb : rm.getAllAmbulances())
+        if (!amb->isAvailable())
+            served.insert(amb->getAssignedIncident());
+
+    for (auto inc : incidents.getAllIncidents())
+        if (!served.count(inc->getId()))
+            incidentAdded(inc);
+    update();
+}
+// Full pass from scratch, needed only when the map or the fleet is replaced
+
+const Pairing* Reassigner::getPairing(Incident* inc) const {
+    auto it = plan.find(inc);
+    if (it == plan.end())
+        return nullptr;
+    return &it->second;
+}
+
+int Reassigner::getEvaluatedCount() const {
+    return evaluated;
+}
+
+int Reassigner::getChangedCount() const {
+    return changed;
+}
+
+void Reassigner::display() const {
+    cout << "\nAssignment plan:\n";
+
+    if (plan.empty()) {
+        cout << "No pending incidents\n";
+        return;
+    }
+
+    for (auto &entry : plan) {
+        Incident* inc = entry.first;
+        const Pairing &p = entry.second;
+        cout << "Incident #" << inc->getId() << " (" << inc->getPriority() << ") at " << inc->getLocation() << ": ";
+        if (p.amb)
+            cout << "Ambulance #" << p.amb->getId() << ", ETA " << p.eta << " min" << endl;
+        else
+            cout << "no unit available" << endl;
+    }
+}
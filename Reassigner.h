@@ -0,0 +1,79 @@
+#ifndef REASSIGNER_H
+#define REASSIGNER_H
+
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+using namespace std;
+
+class Graph;
+class ResourceManager;
+class IncidentQueue;
+class Incident;
+class Ambulance;
+
+struct MostUrgentFirst {
+    bool operator()(const Incident* a, const Incident* b) const;
+};
+// Same order the incident queue hands incidents out in
+
+struct Pairing {
+    Ambulance* amb;    // proposed unit, nullptr when none can reach the incident
+    int eta;
+    vector<int> route; // edge IDs the unit would drive
+};
+
+struct RoadSeen {
+    int weight;
+    int profile;
+    bool blocked;
+};
+// A road as the reassigner last saw it, to tell a faster road from a slower one
+
+class Reassigner {
+    Graph &graph;
+    ResourceManager &rm;
+    IncidentQueue &incidents;
+    int listenerHandle;
+
+    map<Incident*, Pairing, MostUrgentFirst> plan;          // every pending incident
+    unordered_map<int, Incident*> byId;                      // incident ID -> pending incident
+    unordered_set<Incident*> waiting;                        // pending incidents without a unit
+    unordered_map<int, Incident*> owner;                     // ambulance ID -> incident it is proposed for
+    unordered_map<int, unordered_set<Incident*>> roadUsers;  // edge ID -> incidents whose route uses it
+    unordered_map<int, vector<Incident*>> atNode;            // node ID -> pending incidents there
+    multiset<int> etas;                                      // ETA of every paired incident
+    set<Incident*, MostUrgentFirst> dirty;                   // pairings to re-evaluate
+    vector<RoadSeen> seen;                                   // edge ID -> road at the last change
+    int evaluated;                                           // re-evaluations in the last update
+    int changed;                                             // pairings that moved to another unit
+
+    void setPairing(Incident* inc, Ambulance* amb, int eta, vector<int> &route);
+    void clearPairing(Incident* inc);
+    void removeIncident(Incident* inc);
+    void markAround(int node);
+    void markUnpaired();
+    RoadSeen look(int road) const;
+    void evaluate(Incident* inc);
+    void onRoadsChanged(const vector<int> &roads);
+
+public:
+    Reassigner(Graph &g, ResourceManager &r, IncidentQueue &q);
+    ~Reassigner();
+
+    void incidentAdded(Incident* inc);
+    void incidentServed(int incidentId);
+    void unitFreed(Ambulance* amb);
+    void unitTaken(Ambulance* amb);
+
+    int update();
+    void rebuild();
+    const Pairing* getPairing(Incident* inc) const;
+    int getEvaluatedCount() const;
+    int getChangedCount() const;
+    void display() const;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#include "Repositioner.h"
+#include "Graph.h"
+#include "ResourceManager.h"
+#include "Incident.h"
+#include "Ambulance.h"
+#include <iostream>
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+Repositioner::Repositioner(Graph &g, ResourceManager &r, int budgetMinutes) : graph(g), rm(r) {
+    budget = budgetMinutes;
+    busyFraction = 0.3;
+    maxMoveMinutes = INT_MAX;
+    minGain = 0.01;
+    tableStale = true;
+    builtLayout = -1;
+    listenerHandle = graph.addChangeListener([this](const vector<int> &) {
+        tableStale = true; // road changes invalidate the distance table
+    });
+}
+
+Repositioner::~Repositioner() {
+    graph.removeChangeListener(listenerHandle);
+}
+
+void Repositioner::setCandidateStations(const vector<int> &nodes) {
+    stations.clear();
+    for (int n : nodes)
+        if (graph.hasNode(n) && find(stations.begin(), stations.end(), n) == stations.end())
+            stations.push_back(n);
+    tableStale = true;
+}
+// Places units may be sent to, normally the ambulance stations and standby points
+
+void Repositioner::setDemandFromIncidents(IncidentQueue &incidents) {
+    nodeIds = graph.getAllNodes();
+    slot.clear();
+    for (int i = 0; i < (int)nodeIds.size(); i++)
+        slot[nodeIds[i]] = i;
+    builtLayout = graph.getLayoutVersion();
+
+    demand.assign(nodeIds.size(), 0.1); // quiet places still count a little
+    for (auto inc : incidents.getAllIncidents()) {
+        auto it = slot.find(inc->getLocation());
+        if (it != slot.end())
+            demand[it->second] += 1;
+    }
+    tableStale = true;
+}
+// Historical incident density, every incident on record adds weight to its node
+
+void Repositioner::setBusyFraction(double q) {
+    busyFraction = q;
+}
+
+void Repositioner::setMaxMoveMinutes(int minutes) {
+    maxMoveMinutes = minutes;
+}
+
+void Repositioner::relayout() {
+    vector<int> ids = graph.getAllNodes();
+    double quiet = demand.empty() ? 1 : *min_element(demand.begin(), demand.end());
+
+    vector<double> kept(ids.size(), quiet); // no demand given yet, treat every node the same
+    for (int i = 0; i < (int)ids.size(); i++) {
+        auto it = slot.find(ids[i]);
+        if (it != slot.end())
+            kept[i] = demand[it->second];
+    }
+
+    nodeIds.swap(ids);
+    demand.swap(kept);
+    slot.clear();
+    for (int i = 0; i < (int)nodeIds.size(); i++)
+        slot[nodeIds[i]] = i;
+    builtLayout = graph.getLayoutVersion();
+    tableStale = true;
+}
+// Follows a renumbered or reloaded map: demand stays with its node ID, new nodes count like the quietest one
+
+void Repositioner::buildTable() {
+    table.clear();
+    covers.clear();
+    for (int st : stations) {
+        table.push_back(graph.distancesFrom(st)); // roads are two-way, so this is also the time *to* st
+        vector<int> cover;
+        for (int j = 0; j < (int)nodeIds.size(); j++)
+            if (table.back()[j] <= budget)
+                cover.push_back(j);
+        covers.push_back(cover);
+    }
+    tableStale = false;
+}
+// One one-to-all search per candidate station, redone only after roads change
+
+double Repositioner::expectedCoverage(const vector<int> &count) const {
+    double covered = 0, total = 0;
+    for (int j = 0; j < (int)demand.size(); j++) {
+        covered += demand[j] * (1 - busyPower[count[j]]);
+        total += demand[j];
+    }
+    return total > 0 ? covered / total : 0;
+}
+// Share of demand expected to find a free unit within budget when each unit is busy with chance q
+
+double Repositioner::gainOfAdding(const vector<int> &cover, const vector<int> &count) const {
+    double gain = 0;
+    for (int j : cover)
+        gain += demand[j] * busyPower[count[j]] * (1 - busyFraction);
+    return gain;
+}
+// Extra expected coverage one more unit at a station would bring
+
+vector<RelocationMove> Repositioner::computeMoves(double &coverageBefore, double &coverageAfter) {
+    vector<RelocationMove> moves;
+    coverageBefore = coverageAfter = 0;
+
+    if (stations.empty())
+        return moves;
+    if (builtLayout != graph.getLayoutVersion())
+        relayout();
+    if (tableStale)
+        buildTable();
+
+    vector<Ambulance*> idle;
+    for (auto amb : rm.getAvailableAmbulances())
+        if (slot.find(amb->getLocation()) != slot.end())
+            idle.push_back(amb); // a unit off the map has no drive times to plan with
+    if (idle.empty())
+        return moves;
+
+    busyPower.assign(idle.size() + 1, 1);
+    for (int c = 1; c <= (int)idle.size(); c++)
+        busyPower[c] = busyPower[c - 1] * busyFraction;
+
+    // stations each unit can actually drive to, closures and separate map pieces rule some out
+    vector<int> from(idle.size());
+    vector<vector<int>> allowed(idle.size());
+    for (int u = 0; u < (int)idle.size(); u++) {
+        from[u] = slot.find(idle[u]->getLocation())->second; // on the map, checked above
+        for (int s = 0; s < (int)stations.size(); s++) {
+            int minutes = table[s][from[u]];
+            if (minutes != INT_MAX && minutes <= maxMoveMinutes)
+                allowed[u].push_back(s);
+        }
+    }
+    auto canDrive = [&](int u, int s) {
+        return find(allowed[u].begin(), allowed[u].end(), s) != allowed[u].end();
+    };
+
+    // coverage of the idle units where they stand right now; units with nowhere to go stay there
+    vector<int> count(nodeIds.size(), 0), stay(nodeIds.size(), 0);
+    for (int u = 0; u < (int)idle.size(); u++)
+        for (int node : graph.isochrone(idle[u]->getLocation(), budget)) {
+            auto it = slot.find(node);
+            if (it == slot.end())
+                continue;
+            count[it->second]++;
+            if (allowed[u].empty())
+                stay[it->second]++;
+        }
+    coverageBefore = expectedCoverage(count);
+
+    // greedy: place units one by one where they add the most expected coverage, each only
+    // at a station it can reach
+    vector<int> chosen(idle.size(), -1); // station index per unit
+    count = stay;
+    vector<double> gain(stations.size());
+    for (int step = 0; step < (int)idle.size(); step++) {
+        for (int s = 0; s < (int)stations.size(); s++)
+            gain[s] = gainOfAdding(covers[s], count);
+
+        int bestUnit = -1, best = -1;
+        double bestGain = -1;
+        for (int u = 0; u < (int)idle.size(); u++) {
+            if (chosen[u] != -1)
+                continue;
+            for (int s : allowed[u]) {
+                if (gain[s] > bestGain) {
+                    bestGain = gain[s];
+                    bestUnit = u;
+                    best = s;
+                }
+            }
+        }
+        if (bestUnit == -1)
+            break; // the rest can't reach any station
+        chosen[bestUnit] = best;
+        for (int j : covers[best])
+            count[j]++;
+    }
+
+    // local search: swap one placed unit to another station it can reach while that helps
+    bool improved = true;
+    for (int pass = 0; pass < 3 && improved; pass++) {
+        improved = false;
+        for (int u = 0; u < (int)idle.size(); u++) {
+            if (chosen[u] == -1)
+                continue;
+            for (int j : covers[chosen[u]])
+                count[j]--; // take the unit out
+            double keep = gainOfAdding(covers[chosen[u]], count);
+
+            int best = chosen[u];
+            double bestGain = keep;
+            for (int s : allowed[u]) {
+                double g = gainOfAdding(covers[s], count);
+                if (g > bestGain + 1e-9) {
+                    bestGain = g;
+                    best = s;
+                }
+            }
+            if (best != chosen[u])
+                improved = true;
+            chosen[u] = best;
+            for (int j : covers[best])
+                count[j]++; // put it back at the better place
+        }
+    }
+    coverageAfter = expectedCoverage(count);
+
+    if (coverageAfter - coverageBefore < minGain) {
+        coverageAfter = coverageBefore;
+        return moves; // not worth moving anyone
+    }
+
+    // trade stations between two units when both can drive to the other's and it shortens the drives
+    improved = true;
+    for (int pass = 0; pass < 3 && improved; pass++) {
+        improved = false;
+        for (int u = 0; u < (int)idle.size(); u++) {
+            for (int v = u + 1; v < (int)idle.size(); v++) {
+                int a = chosen[u], b = chosen[v];
+                if (a == -1 || b == -1 || a == b || !canDrive(u, b) || !canDrive(v, a))
+                    continue;
+                if (table[b][from[u]] + table[a][from[v]] < table[a][from[u]] + table[b][from[v]]) {
+                    swap(chosen[u], chosen[v]);
+                    improved = true;
+                }
+            }
+        }
+    }
+
+    // send units to their stations, shortest drives first
+    for (int u = 0; u < (int)idle.size(); u++) {
+        if (chosen[u] == -1)
+            continue;
+        int to = stations[chosen[u]];
+        if (to != idle[u]->getLocation())
+            moves.push_back({idle[u], idle[u]->getLocation(), to, table[chosen[u]][from[u]]});
+    }
+    sort(moves.begin(), moves.end(), [](const RelocationMove &a, const RelocationMove &b) {
+        return a.minutes < b.minutes;
+    });
+    return moves;
+}
+// Greedy plus swap local search for maximum expected coverage over the stations each unit can
+// reach, then trades stations between units to shorten the drives. Returns only the units that need to move.
+
+int Repositioner::applyMoves(const vector<RelocationMove> &moves) {
+    int applied = 0;
+    for (auto &m : moves) {
+        if (m.amb->isAvailable() && m.amb->getLocation() == m.from) {
+            rm.moveAmbulance(m.amb->getId(), m.to);
+            applied++;
+        }
+    }
+    return applied;
+}
+// Moves units that are still idle where the plan found them
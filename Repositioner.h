@@ -0,0 +1,57 @@
+#ifndef REPOSITIONER_H
+#define REPOSITIONER_H
+
+#include <vector>
+#include <unordered_map>
+using namespace std;
+
+class Graph;
+class ResourceManager;
+class IncidentQueue;
+class Ambulance;
+
+struct RelocationMove {
+    Ambulance* amb;
+    int from;
+    int to;
+    int minutes; // driving time of the move
+};
+
+class Repositioner {
+    Graph &graph;
+    ResourceManager &rm;
+    int budget;              // coverage target in minutes
+    double busyFraction;     // chance a covering unit is already busy (expected coverage model)
+    int maxMoveMinutes;      // never send a unit further than this
+    double minGain;          // coverage share (0-1) a plan must add before anyone moves, 0.01 = one point
+    int listenerHandle;
+
+    vector<int> nodeIds;                 // slot -> node ID
+    unordered_map<int, int> slot;        // node ID -> slot
+    vector<double> demand;               // incident weight of every slot
+    vector<int> stations;                // candidate station node IDs
+    vector<vector<int>> table;           // station x slot driving times
+    vector<vector<int>> covers;          // slots each station reaches within budget
+    vector<double> busyPower;            // busyFraction^c for c covering units
+    bool tableStale;
+    long long builtLayout;               // graph layout nodeIds was taken from, -1 before the first
+
+    void relayout();
+    void buildTable();
+    double expectedCoverage(const vector<int> &count) const;
+    double gainOfAdding(const vector<int> &cover, const vector<int> &count) const;
+
+public:
+    Repositioner(Graph &g, ResourceManager &r, int budgetMinutes);
+    ~Repositioner();
+
+    void setCandidateStations(const vector<int> &nodes);
+    void setDemandFromIncidents(IncidentQueue &incidents);
+    void setBusyFraction(double q);
+    void setMaxMoveMinutes(int minutes);
+
+    vector<RelocationMove> computeMoves(double &coverageBefore, double &coverageAfter);
+    int applyMoves(const vector<RelocationMove> &moves);
+};
+
+#endif
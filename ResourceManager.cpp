@@ -2,6 +2,12 @@
 #include "utils.h"
 #include "Graph.h"
 #include "Incident.h"
+#include "StateLog.h"
+#include "Hospital.h"
+#include "RouteTracker.h"
+#include "SharedMap.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include <iostream>
 #include <fstream>
 #include <climits>
@@ -10,15 +16,37 @@
 
 using namespace std;
 
-ResourceManager::ResourceManager() {}
+ResourceManager::ResourceManager() {
+    verbose = true;
+    observer = nullptr;
+    journal = nullptr;
+    routes = nullptr;
+}
 
 ResourceManager::~ResourceManager() {
     for (auto amb : ambulances) {
-        delete amb;
+        deleteAmbulance(amb);
     }
     ambulances.clear();
 }
 
+void ResourceManager::deleteAmbulance(Ambulance* amb) {
+    if (observer)
+        observer->onRemoved(*amb);
+    if (routes)
+        routes->finish(amb->getId());
+    delete amb;
+} // Frees an ambulance, letting the observer and the route tracker forget it first
+
+void ResourceManager::trackAmbulance(Ambulance* amb) {
+    ambulances.push_back(amb);
+    amb->setObserver(observer);
+    if (observer)
+        observer->onStatusChanged(*amb);
+    if (journal)
+        journal->unitAdded(amb->getId(), amb->getLocation());
+} // Adds a new ambulance to the fleet and reports it to the observer
+
 void ResourceManager::addAmbulance(int id, int location) {
     for (auto amb : ambulances) {
         if (amb->getId() == id) {
@@ -27,8 +55,9 @@ void ResourceManager::addAmbulance(int id, int location) {
         }
     }
 
-    ambulances.push_back(new Ambulance(id, location));
-    cout << "Ambulance added\n";
+    trackAmbulance(new Ambulance(id, location));
+    if (verbose)
+        cout << "Ambulance added\n";
 }
 // Adds new ambulance to the fleet
 // Checks if ambulance ID already exists (no duplicates)
@@ -58,6 +87,29 @@ void ResourceManager::addAmbulanceInteractive() {
 }
 // Interactive version asks user for input and adds ambulance
 
+void ResourceManager::generateTestAmbulances(int count, Graph &graph) {
+    if (count <= 0) {
+        cout << "Invalid count\n";
+        return;
+    }
+
+    auto nodes = graph.getAllNodes();
+    if (nodes.empty()) {
+        cout << "No map loaded\n";
+        return;
+    }
+
+    int nextId = 0;
+    for (auto amb : ambulances)
+        nextId = max(nextId, amb->getId() + 1);
+
+    for (int i = 0; i < count; i++)
+        trackAmbulance(new Ambulance(nextId + i, nodes[rand() % nodes.size()]));
+
+    if (verbose)
+        cout << count << " test ambulances added\n";
+} // Adds ambulances at random stations for load testing
+
 bool ResourceManager::removeAmbulance(int id) {
     for (auto it = ambulances.begin(); it != ambulances.end(); it++) {
         if ((*it)->getId() == id) {
@@ -66,8 +118,10 @@ bool ResourceManager::removeAmbulance(int id) {
                 return false;
             }
 
-            delete *it;
+            deleteAmbulance(*it);
             ambulances.erase(it);
+            if (journal)
+                journal->unitRemoved(id);
             cout << "Ambulance removed\n";
             return true;
         }
@@ -79,24 +133,63 @@ bool ResourceManager::removeAmbulance(int id) {
 // Removes an ambulance from the system
 // Won't remove if ambulance is busy (on a call)
 
-Ambulance* ResourceManager::findNearestAmbulance(int incidentLocation, Graph &graph) {
-    Ambulance* nearest = nullptr;
-    int minDist = INT_MAX;
+Ambulance* ResourceManager::findNearestAmbulance(int incidentLocation, Graph &graph, int departMinute) {
+    auto best = findKNearest(incidentLocation, 1, graph, nullptr, departMinute);
+    if (best.empty())
+        return nullptr;
+    return best[0].amb;
+}
+// Finds the closest available ambulance to an emergency
 
+void ResourceManager::collectAvailable(AmbulanceFilter filter, vector<Ambulance*> &units, vector<int> &locations) const {
     for (auto amb : ambulances) {
-        if (amb->isAvailable()) {
-            int dist = graph.dijkstra(amb->getLocation(), incidentLocation);
-            if (dist < minDist) {
-                minDist = dist;
-                nearest = amb;
-            }
+        if (amb->isAvailable() && (!filter || filter(*amb))) {
+            units.push_back(amb);
+            locations.push_back(amb->getLocation());
         }
     }
-
-    return nearest;
 }
-// Finds the closest available ambulance to an emergency
-// Uses Dijkstra's algorithm (from Graph class) to find shortest path distance
+// Available units passing the filter, with where each one stands
+
+vector<UnitEta> ResourceManager::findKNearest(int incidentLocation, int k, Graph &graph, AmbulanceFilter filter,
+                                              int departMinute, int maxEta) {
+    static Histogram &lookupTime = MetricsRegistry::instance().histogram(
+        "ers_find_nearest_seconds", "", "Time to rank the available units for an incident");
+    ScopedTimer timer(lookupTime);
+    TRACE_SPAN_ARG("fleet", "find_nearest", incidentLocation);
+
+    if (departMinute < 0)
+        departMinute = currentMinuteOfDay(); // leave now
+
+    vector<Ambulance*> candidates;
+    vector<int> locations;
+    collectAvailable(filter, candidates, locations);
+
+    vector<UnitEta> ranked;
+    for (auto &r : graph.nearestSources(locations, incidentLocation, k, departMinute, maxEta))
+        ranked.push_back({candidates[r.first], r.second});
+    return ranked;
+}
+// Finds the k closest available ambulances (that pass the filter) with their travel times, fastest first
+// One search from the incident (from Graph class) covers the whole fleet, so rush-hour traffic
+// and closed roads count, the cost doesn't grow with fleet size and no second search is needed for ETAs
+
+vector<UnitEta> ResourceManager::findKNearest(int incidentLocation, int k, const SharedMap &map, AmbulanceFilter filter,
+                                              int departMinute, int maxEta) {
+    TRACE_SPAN_ARG("fleet", "find_nearest_shared", incidentLocation);
+    if (departMinute < 0)
+        departMinute = currentMinuteOfDay();
+
+    vector<Ambulance*> candidates;
+    vector<int> locations;
+    collectAvailable(filter, candidates, locations);
+
+    vector<UnitEta> ranked;
+    for (auto &r : map.nearestSources(locations, incidentLocation, k, departMinute, maxEta))
+        ranked.push_back({candidates[r.first], r.second});
+    return ranked;
+}
+// Same ranking on a map attached from shared memory, with this process's own closures
 
 Ambulance* ResourceManager::findAmbulanceById(int id) {
     for (auto amb : ambulances) {
@@ -109,6 +202,7 @@ Ambulance* ResourceManager::findAmbulanceById(int id) {
 
 
 bool ResourceManager::dispatchAmbulance(int ambulanceId, int incidentId, int incidentLocation) {
+    TRACE_SPAN_ARG("fleet", "dispatch", ambulanceId);
     Ambulance* amb = findAmbulanceById(ambulanceId);
 
     if (!amb) {
@@ -122,22 +216,52 @@ bool ResourceManager::dispatchAmbulance(int ambulanceId, int incidentId, int inc
     }
 
     amb->dispatchTo(incidentId);  // Dispatch ambulance to incident function in Ambulance class
-    cout << "Ambulance dispatched\n";
+    if (journal)
+        journal->unitDispatched(ambulanceId, incidentId);
+    if (routes && incidentLocation >= 0)
+        routes->track(amb, incidentLocation, routes->currentTime(), currentMinuteOfDay());
+    if (verbose)
+        cout << "Ambulance dispatched\n";
     return true;
 }
 // Sends a specific ambulance to a specific incident
 
 void ResourceManager::completeAssignment(int ambulanceId) {
+    TRACE_SPAN_ARG("fleet", "complete", ambulanceId);
     Ambulance* amb = findAmbulanceById(ambulanceId);
 
     if (amb) {
         amb->setAvailable();
-        cout << "Assignment completed\n";
+        if (routes)
+            routes->finish(ambulanceId);
+        if (journal)
+            journal->unitFreed(ambulanceId);
+        if (verbose)
+            cout << "Assignment completed\n";
     }
 }
 // Marks an ambulance as available after completing its job
 
-void ResourceManager::reassignAmbulances(IncidentQueue &incidents, Graph &graph) {
+bool ResourceManager::moveAmbulance(int ambulanceId, int location) {
+    TRACE_SPAN_ARG("fleet", "move", ambulanceId);
+    Ambulance* amb = findAmbulanceById(ambulanceId);
+    if (!amb)
+        return false;
+
+    amb->setLocation(location);
+    if (journal)
+        journal->unitMoved(ambulanceId, location);
+    return true;
+}
+// Moves a unit without changing its status, e.g. an idle unit sent to cover a gap
+
+void ResourceManager::reassignAmbulances(IncidentQueue &incidents, Graph &graph, HospitalDirectory* hospitals) {
+    static Histogram &passTime = MetricsRegistry::instance().histogram(
+        "ers_reassign_seconds", "", "Time of a full reassignment pass");
+    static Counter &reassigned = MetricsRegistry::instance().counter(
+        "ers_reassigned_units_total", "", "Units sent to a new incident by reassignment");
+    ScopedTimer timer(passTime);
+    TRACE_SPAN("fleet", "reassign_all");
     cout << "\nReassigning...\n";
 
     if (incidents.isEmpty()) {
@@ -147,16 +271,34 @@ void ResourceManager::reassignAmbulances(IncidentQueue &incidents, Graph &graph)
 
     vector<Incident*> temp;
     int count = 0;
+    long long toHospital = 0; // summed unit -> incident -> hospital times
+    int transported = 0;
+    bool byHospital = hospitals && hospitals->getCount() > 0;
 
     while (!incidents.isEmpty()) {
         Incident* inc = incidents.getNextIncident(); // Get next incident from the queue
         if (inc && !inc->isResolved()) {
             temp.push_back(inc);
 
-            Ambulance* amb = findNearestAmbulance(inc->getLocation(), graph);
+            Ambulance* amb;
+            if (byHospital) {
+                // chosen on the time until the patient reaches a suitable hospital, not just the scene
+                TransportPlan plan = hospitals->planTransport(inc->getLocation(), inc->getPriority(), *this, graph);
+                amb = plan.amb;
+                if (plan.total != INT_MAX) {
+                    toHospital += plan.total;
+                    transported++;
+                }
+            } else {
+                amb = findNearestAmbulance(inc->getLocation(), graph);
+            }
             if (amb) {
                 amb->dispatchTo(inc->getId());
                 amb->setLocation(inc->getLocation());
+                if (journal) {
+                    journal->unitDispatched(amb->getId(), inc->getId());
+                    journal->unitMoved(amb->getId(), inc->getLocation());
+                }
 
                 reassignmentLog.push_back({amb->getId(), inc->getId()});
                 count++;
@@ -167,9 +309,14 @@ void ResourceManager::reassignAmbulances(IncidentQueue &incidents, Graph &graph)
     for (auto inc : temp)
         incidents.reAddIncident(inc);
 
-    cout << "Done (" << count << " reassigned)\n";
+    reassigned.add(count);
+    cout << "Done (" << count << " reassigned";
+    if (transported > 0)
+        cout << ", " << toHospital / transported << " min to hospital on average";
+    cout << ")\n";
 }
 // Reassigns all ambulances to optimize response to all pending incidents
+// With hospitals given, each unit is picked on total time to hospital instead of time to the scene
 vector<Ambulance*> ResourceManager::getAllAmbulances() {
     return ambulances;
 }
@@ -220,6 +367,9 @@ void ResourceManager::displayReassignmentLog() {
 }
 
 void ResourceManager::loadFromFile(const string &filename) {
+    static Histogram &loadTime = MetricsRegistry::instance().histogram("ers_load_seconds", "file=\"ambulances\"");
+    ScopedTimer timer(loadTime);
+    TRACE_SPAN("fleet", "load_ambulances");
     ifstream file(filename);
 
     if (!file.is_open()) {
@@ -228,8 +378,10 @@ void ResourceManager::loadFromFile(const string &filename) {
     }
 
     for (auto amb : ambulances)
-        delete amb;
+        deleteAmbulance(amb);
     ambulances.clear();
+    if (journal)
+        journal->unitsCleared();
 
     string line;
     while (getline(file, line)) {
@@ -243,10 +395,12 @@ void ResourceManager::loadFromFile(const string &filename) {
     }
 
     file.close();
-    cout << "Loaded from file\n";
+    if (verbose)
+        cout << "Loaded from file\n";
 }
 
 void ResourceManager::saveToFile(const string &filename) {
+    TRACE_SPAN("fleet", "save_ambulances");
     ofstream file(filename);
 
     if (!file.is_open()) {
@@ -255,7 +409,7 @@ void ResourceManager::saveToFile(const string &filename) {
     }
 
     for (auto amb : ambulances) {
-        file << amb->getId() << " " << amb->getLocation() << endl;
+        file << amb->getId() << " " << amb->getLocation() << '\n';
     }
 
     file.close();
@@ -266,3 +420,42 @@ void ResourceManager::clearReassignmentLog() {
     reassignmentLog.clear();
     cout << "Log cleared\n";
 }
+
+void ResourceManager::clearAll() {
+    for (auto amb : ambulances)
+        deleteAmbulance(amb);
+    ambulances.clear();
+    if (journal)
+        journal->unitsCleared();
+
+    if (verbose)
+        cout << "Ambulances cleared\n";
+}
+
+void ResourceManager::setObserver(AmbulanceObserver* obs) {
+    observer = obs;
+    for (auto amb : ambulances)
+        amb->setObserver(obs);
+}
+// Attaches (or with nullptr detaches) one observer to every current and future ambulance
+
+void ResourceManager::setJournal(StateLog* log) {
+    journal = log;
+} // Changes made from here on are written to the state log
+
+void ResourceManager::setRouteTracker(RouteTracker* tracker) {
+    routes = tracker;
+    if (!routes)
+        return;
+    routes->setRerouteHandler([this](Ambulance* amb, double arrival) {
+        if (verbose)
+            cout << "Ambulance #" << amb->getId() << " rerouted around a road change, arrives in "
+                 << max(0, (int)(arrival - routes->currentTime() + 0.5)) << " min\n";
+    });
+}
+// Units dispatched from here on are followed until they complete; must outlive this manager
+// or be set back to nullptr first
+
+void ResourceManager::setVerbose(bool on) {
+    verbose = on;
+} // Turns routine messages off for bulk work such as simulations
@@ -3,15 +3,37 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <climits>
 #include "Ambulance.h"
 using namespace std;
 
 class Graph;
 class IncidentQueue;
+class StateLog;
+class HospitalDirectory;
+class RouteTracker;
+class SharedMap;
+
+struct UnitEta {
+    Ambulance* amb;
+    int eta; // minutes to the incident
+};
+
+typedef function<bool(const Ambulance &)> AmbulanceFilter;
+// Extra condition a unit must meet to be considered, e.g. a unit type or a station
 
 class ResourceManager {
     vector<Ambulance*> ambulances;
     vector<pair<int, int>> reassignmentLog;
+    bool verbose;
+    AmbulanceObserver* observer;
+    StateLog* journal; // records every fleet change when set
+    RouteTracker* routes; // follows dispatched units on the road when set, reroutes them around closures
+
+    void trackAmbulance(Ambulance* amb);
+    void deleteAmbulance(Ambulance* amb);
+    void collectAvailable(AmbulanceFilter filter, vector<Ambulance*> &units, vector<int> &locations) const;
     
 public:
     ResourceManager();
@@ -19,13 +41,19 @@ public:
     
     void addAmbulance(int id, int location);
     void addAmbulanceInteractive();
+    void generateTestAmbulances(int count, Graph &graph);
     bool removeAmbulance(int id);
-    Ambulance* findNearestAmbulance(int incidentLocation, Graph &graph);
+    Ambulance* findNearestAmbulance(int incidentLocation, Graph &graph, int departMinute = -1);
+    vector<UnitEta> findKNearest(int incidentLocation, int k, Graph &graph, AmbulanceFilter filter = nullptr,
+                                 int departMinute = -1, int maxEta = INT_MAX);
+    vector<UnitEta> findKNearest(int incidentLocation, int k, const SharedMap &map, AmbulanceFilter filter = nullptr,
+                                 int departMinute = -1, int maxEta = INT_MAX);
     Ambulance* findAmbulanceById(int id);
     
-    void reassignAmbulances(IncidentQueue &incidents, Graph &graph);
+    void reassignAmbulances(IncidentQueue &incidents, Graph &graph, HospitalDirectory* hospitals = nullptr);
     bool dispatchAmbulance(int ambulanceId, int incidentId, int incidentLocation);
     void completeAssignment(int ambulanceId);
+    bool moveAmbulance(int ambulanceId, int location);
     
     vector<Ambulance*> getAllAmbulances();
     vector<Ambulance*> getAvailableAmbulances();
@@ -37,6 +65,11 @@ public:
     void saveToFile(const string &filename);
     
     void clearReassignmentLog();
+    void clearAll();
+    void setObserver(AmbulanceObserver* obs);
+    void setJournal(StateLog* log);
+    void setRouteTracker(RouteTracker* tracker);
+    void setVerbose(bool on);
 };
 
 #endif
\ No newline at end of file
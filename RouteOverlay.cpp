@@ -0,0 +1,409 @@
+#include "RouteOverlay.h"
+#include "Graph.h"
+#include "SearchQueue.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <queue>
+
+using namespace std;
+
+static const int LEVEL_GROWTH = 8;   // each level's cells hold up to this many times more nodes
+static const int MIN_TOP_CELLS = 64; // a level with fewer, larger cells costs more to customize than it saves
+
+RouteOverlay::RouteOverlay(Graph &g, int cellNodes, int threads) : graph(g), pool(threads) {
+    cellSize = max(2, cellNodes);
+    nodeCount = 0;
+    edgeCount = 0;
+    lastCustomizeMs = 0;
+    listenerHandle = graph.addChangeListener([this](const vector<int> &roads) {
+        pendingRoads.insert(pendingRoads.end(), roads.begin(), roads.end());
+    });
+}
+
+RouteOverlay::~RouteOverlay() {
+    graph.removeChangeListener(listenerHandle);
+}
+
+void RouteOverlay::buildTopology() {
+    vector<int> nodes = graph.getAllNodes();
+    nodeCount = nodes.size();
+    edgeCount = graph.getEdgeCount();
+
+    index.clear();
+    for (int i = 0; i < nodeCount; i++)
+        index[nodes[i]] = i;
+
+    weight.assign(edgeCount, 0);
+    blocked.assign(edgeCount, 0);
+    vector<vector<pair<int, int>>> lists(nodeCount); // node -> (neighbour, edge ID)
+    for (int id = 0; id < edgeCount; id++) {
+        Road r = graph.getRoad(id);
+        weight[id] = r.weight;
+        blocked[id] = graph.isRoadBlocked(r.src, r.dest);
+        int a = index[r.src];
+        int b = index[r.dest];
+        if (a == b)
+            continue;
+        lists[a].push_back({b, id});
+        lists[b].push_back({a, id});
+    }
+
+    arcStart.assign(nodeCount + 1, 0);
+    arcTo.clear();
+    arcRoad.clear();
+    for (int v = 0; v < nodeCount; v++) {
+        arcStart[v] = arcTo.size();
+        for (auto &e : lists[v]) {
+            arcTo.push_back(e.first);
+            arcRoad.push_back(e.second);
+        }
+    }
+    arcStart[nodeCount] = arcTo.size();
+    pendingRoads.clear();
+}
+// Copies the road network once, only weights and closures are refreshed afterwards
+
+void RouteOverlay::growCells(int level, int limit) {
+    // units are nodes on level 0, the cells of the level below otherwise
+    int units = level == 0 ? nodeCount : cells[level - 1].size();
+    vector<int> unitSize(units, 1);
+    vector<vector<int>> unitAdj(units);
+    if (level == 0) {
+        for (int v = 0; v < nodeCount; v++)
+            unitAdj[v].assign(arcTo.begin() + arcStart[v], arcTo.begin() + arcStart[v + 1]);
+    } else {
+        for (int c = 0; c < units; c++)
+            unitSize[c] = 0;
+        for (int v = 0; v < nodeCount; v++) {
+            int c = cellOf[level - 1][v];
+            unitSize[c]++;
+            for (int a = arcStart[v]; a < arcStart[v + 1]; a++) {
+                int d = cellOf[level - 1][arcTo[a]];
+                if (d != c)
+                    unitAdj[c].push_back(d);
+            }
+        }
+        for (auto &list : unitAdj) {
+            sort(list.begin(), list.end());
+            list.erase(unique(list.begin(), list.end()), list.end());
+        }
+    }
+
+    // breadth-first growth from the first unassigned unit until the cell is full
+    vector<int> group(units, -1);
+    int groups = 0;
+    for (int seed = 0; seed < units; seed++) {
+        if (group[seed] != -1)
+            continue;
+
+        int size = unitSize[seed];
+        queue<int> frontier;
+        frontier.push(seed);
+        group[seed] = groups;
+        while (!frontier.empty()) {
+            int u = frontier.front();
+            frontier.pop();
+            for (int w : unitAdj[u]) {
+                if (group[w] != -1 || size + unitSize[w] > limit)
+                    continue;
+                group[w] = groups;
+                size += unitSize[w];
+                frontier.push(w);
+            }
+        }
+        groups++;
+    }
+
+    cellOf.push_back(vector<int>(nodeCount));
+    for (int v = 0; v < nodeCount; v++)
+        cellOf[level][v] = level == 0 ? group[v] : group[cellOf[level - 1][v]];
+    cells.push_back(vector<OverlayCell>(groups));
+}
+// Cells are grown breadth-first over the road network (nodes, then cells of the level below),
+// so they are connected and compact without needing coordinates
+
+void RouteOverlay::buildPartition() {
+    cells.clear();
+    cellOf.clear();
+    vertexPos.clear();
+    boundaryPos.clear();
+
+    long long limit = cellSize;
+    for (int level = 0;; level++) {
+        growCells(level, min(limit, (long long)INT_MAX));
+        if (level > 0 && (int)cells[level].size() < MIN_TOP_CELLS) {
+            cells.pop_back();
+            cellOf.pop_back();
+            break;
+        }
+        limit *= LEVEL_GROWTH;
+
+        vector<OverlayCell> &list = cells[level];
+        vertexPos.push_back(vector<int>(nodeCount, -1));
+        boundaryPos.push_back(vector<int>(nodeCount, -1));
+        for (int v = 0; v < nodeCount; v++) {
+            OverlayCell &cell = list[cellOf[level][v]];
+
+            // searched inside the cell: every node on level 0, boundary nodes of the subcells above
+            if (level == 0 || boundaryPos[level - 1][v] != -1) {
+                vertexPos[level][v] = cell.vertices.size();
+                cell.vertices.push_back(v);
+            }
+
+            for (int a = arcStart[v]; a < arcStart[v + 1]; a++) {
+                if (cellOf[level][arcTo[a]] != cellOf[level][v]) {
+                    boundaryPos[level][v] = cell.boundary.size();
+                    cell.boundary.push_back(v);
+                    break;
+                }
+            }
+        }
+        for (auto &cell : list)
+            cell.parent = -1;
+        if (level > 0)
+            for (int v = 0; v < nodeCount; v++)
+                cells[level - 1][cellOf[level - 1][v]].parent = cellOf[level][v];
+    }
+}
+// Metric independent: depends only on which roads exist, computed once
+
+void RouteOverlay::customizeCell(int level, int c, bool &changed) {
+    OverlayCell &cell = cells[level][c];
+    int b = cell.boundary.size();
+    int m = cell.vertices.size();
+    vector<int> clique((size_t)b * b, INT_MAX);
+    vector<int> dist(m);
+    vector<char> viaClique(m); // best label came across the subcell, its clique row adds nothing
+
+    for (int i = 0; i < b; i++) {
+        fill(dist.begin(), dist.end(), INT_MAX);
+        RadixHeapQueue pq; // clique times can be long, Dial's ring would be too
+        int from = vertexPos[level][cell.boundary[i]];
+        dist[from] = 0;
+        viaClique[from] = 0;
+        pq.push(0, from);
+
+        while (!pq.empty()) {
+            auto top = pq.pop();
+            if (top.first > dist[top.second])
+                continue;
+
+            int v = cell.vertices[top.second];
+            auto relax = [&](int w, int time, bool clique) {
+                int p = vertexPos[level][w];
+                if (top.first + time < dist[p]) {
+                    dist[p] = top.first + time;
+                    viaClique[p] = clique;
+                    pq.push(dist[p], p);
+                }
+            };
+
+            // two clique hops in a row are never faster than one
+            if (level > 0 && !viaClique[top.second]) {
+                // across the subcell through its clique
+                const OverlayCell &sub = cells[level - 1][cellOf[level - 1][v]];
+                int row = boundaryPos[level - 1][v];
+                int sb = sub.boundary.size();
+                for (int j = 0; j < sb; j++)
+                    if (sub.clique[(size_t)row * sb + j] != INT_MAX)
+                        relax(sub.boundary[j], sub.clique[(size_t)row * sb + j], true);
+            }
+
+            // roads staying in this cell (between two subcells above level 0)
+            for (int a = arcStart[v]; a < arcStart[v + 1]; a++) {
+                int w = arcTo[a];
+                if (blocked[arcRoad[a]] || cellOf[level][w] != c)
+                    continue;
+                if (level > 0 && cellOf[level - 1][w] == cellOf[level - 1][v])
+                    continue; // covered by the clique
+                relax(w, weight[arcRoad[a]], false);
+            }
+        }
+
+        for (int j = 0; j < b; j++)
+            clique[(size_t)i * b + j] = dist[vertexPos[level][cell.boundary[j]]];
+    }
+
+    changed = clique != cell.clique;
+    cell.clique.swap(clique);
+}
+// Travel times between every pair of boundary nodes, searching only inside the cell
+
+void RouteOverlay::customizeCells(int level, vector<int> &dirty, vector<char> &parentDirty) {
+    vector<char> changed(dirty.size(), 0);
+    for (size_t i = 0; i < dirty.size(); i++) {
+        pool.submit([this, level, &dirty, &changed, i]() {
+            bool c;
+            customizeCell(level, dirty[i], c);
+            changed[i] = c;
+        });
+    }
+    pool.waitAll();
+
+    // a cell whose clique did not move leaves the level above untouched
+    for (size_t i = 0; i < dirty.size(); i++) {
+        int parent = cells[level][dirty[i]].parent;
+        if (changed[i] && parent != -1)
+            parentDirty[parent] = 1;
+    }
+}
+// Cells of one level are independent, they are recomputed in parallel on the pool
+
+void RouteOverlay::build() {
+    buildTopology();
+    buildPartition();
+
+    auto start = chrono::steady_clock::now();
+    for (int level = 0; level < (int)cells.size(); level++) {
+        vector<int> all(cells[level].size());
+        for (int c = 0; c < (int)all.size(); c++)
+            all[c] = c;
+        vector<char> unused(level + 1 < (int)cells.size() ? cells[level + 1].size() : 0);
+        customizeCells(level, all, unused);
+    }
+    lastCustomizeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+// Partition plus a full customization
+
+int RouteOverlay::customize() {
+    if (nodeCount != graph.getNodeCount() || edgeCount != graph.getEdgeCount()) {
+        build(); // roads or places were added, the partition has to be redone
+        int total = 0;
+        for (auto &level : cells)
+            total += level.size();
+        return total;
+    }
+    if (pendingRoads.empty())
+        return 0;
+
+    auto start = chrono::steady_clock::now();
+    int levels = cells.size();
+    vector<vector<char>> dirty(levels);
+    for (int level = 0; level < levels; level++)
+        dirty[level].assign(cells[level].size(), 0);
+
+    for (int road : pendingRoads) {
+        Road r = graph.getRoad(road);
+        weight[road] = r.weight;
+        blocked[road] = graph.isRoadBlocked(r.src, r.dest);
+
+        // the lowest cell holding both ends is the only clique the road feeds directly
+        int a = index[r.src];
+        int b = index[r.dest];
+        for (int level = 0; level < levels; level++)
+            if (cellOf[level][a] == cellOf[level][b]) {
+                dirty[level][cellOf[level][a]] = 1;
+                break;
+            }
+    }
+    pendingRoads.clear();
+
+    int recomputed = 0;
+    vector<char> none;
+    for (int level = 0; level < levels; level++) {
+        vector<int> list;
+        for (int c = 0; c < (int)dirty[level].size(); c++)
+            if (dirty[level][c])
+                list.push_back(c);
+        recomputed += list.size();
+        customizeCells(level, list, level + 1 < levels ? dirty[level + 1] : none);
+    }
+
+    lastCustomizeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return recomputed;
+}
+// Absorbs the road changes heard since the last call, recomputing only the cells they touch
+// and their parents when a clique really changed. Returns how many cells were recomputed.
+
+int RouteOverlay::queryLevel(int v, int s, int t) const {
+    for (int level = cells.size() - 1; level >= 0; level--)
+        if (cellOf[level][v] != cellOf[level][s] && cellOf[level][v] != cellOf[level][t])
+            return level;
+    return -1;
+}
+// Highest level whose cell around v holds neither end, -1 means plain roads
+
+int RouteOverlay::query(int start, int end) {
+    customize();
+
+    auto si = index.find(start);
+    auto ti = index.find(end);
+    if (si == index.end() || ti == index.end())
+        return INT_MAX;
+    int s = si->second;
+    int t = ti->second;
+    if (s == t)
+        return 0;
+
+    // labels are reset through touched, a query only reaches a small part of the map
+    queryDist.resize(nodeCount, INT_MAX);
+    queryViaClique.resize(nodeCount, 0);
+    for (int v : queryTouched)
+        queryDist[v] = INT_MAX;
+    queryTouched.clear();
+
+    RadixHeapQueue pq;
+    queryDist[s] = 0;
+    queryViaClique[s] = 0;
+    queryTouched.push_back(s);
+    pq.push(0, s);
+
+    while (!pq.empty()) {
+        auto top = pq.pop();
+        int v = top.second;
+        if (v == t)
+            return top.first;
+        if (top.first > queryDist[v])
+            continue;
+
+        auto relax = [&](int w, int time, bool clique) {
+            int nd = top.first + time;
+            if (nd < queryDist[w]) {
+                if (queryDist[w] == INT_MAX)
+                    queryTouched.push_back(w);
+                queryDist[w] = nd;
+                queryViaClique[w] = clique;
+                pq.push(nd, w);
+            }
+        };
+
+        int level = queryLevel(v, s, t);
+        int row = level == -1 ? -1 : boundaryPos[level][v];
+        if (row == -1) {
+            for (int a = arcStart[v]; a < arcStart[v + 1]; a++)
+                if (!blocked[arcRoad[a]])
+                    relax(arcTo[a], weight[arcRoad[a]], false);
+            continue;
+        }
+
+        // cross the cell in one step (unless that is how v was reached), then leave it by a road
+        const OverlayCell &cell = cells[level][cellOf[level][v]];
+        int b = cell.boundary.size();
+        if (!queryViaClique[v])
+            for (int j = 0; j < b; j++)
+                if (cell.clique[(size_t)row * b + j] != INT_MAX)
+                    relax(cell.boundary[j], cell.clique[(size_t)row * b + j], true);
+        for (int a = arcStart[v]; a < arcStart[v + 1]; a++)
+            if (!blocked[arcRoad[a]] && cellOf[level][arcTo[a]] != cellOf[level][v])
+                relax(arcTo[a], weight[arcRoad[a]], false);
+    }
+    return INT_MAX;
+}
+// Same answer as dijkstraWithBlocked: plain roads near both ends, the largest cells that hold
+// neither end everywhere else
+
+int RouteOverlay::getLevelCount() const {
+    return cells.size();
+}
+
+int RouteOverlay::getCellCount(int level) const {
+    if (level < 1 || level > (int)cells.size())
+        return 0;
+    return cells[level - 1].size();
+}
+// Levels count from 1, the smallest cells
+
+double RouteOverlay::getLastCustomizeMs() const {
+    return lastCustomizeMs;
+}
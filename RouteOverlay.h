@@ -0,0 +1,68 @@
+#ifndef ROUTE_OVERLAY_H
+#define ROUTE_OVERLAY_H
+
+#include <vector>
+#include <unordered_map>
+#include "ThreadPool.h"
+using namespace std;
+
+class Graph;
+
+struct OverlayCell {
+    vector<int> vertices;   // nodes searched inside the cell (level 1: all, above: boundary nodes of the subcells)
+    vector<int> boundary;   // nodes with a road leaving the cell
+    vector<int> clique;     // boundary x boundary travel times inside the cell, INT_MAX if none
+    int parent;             // cell one level up
+};
+
+class RouteOverlay {
+    Graph &graph;
+    int listenerHandle;
+    int cellSize;                          // largest level 1 cell, each level above is 8 times larger
+    ThreadPool pool;
+
+    // topology, fixed until roads or places are added
+    int nodeCount;
+    int edgeCount;
+    unordered_map<int, int> index;         // node ID -> internal index (getAllNodes order)
+    vector<int> arcStart;                  // CSR adjacency by internal index
+    vector<int> arcTo;
+    vector<int> arcRoad;
+
+    // metric, refreshed from the graph for changed roads only
+    vector<int> weight;                    // by edge ID
+    vector<char> blocked;                  // by edge ID
+    vector<int> pendingRoads;              // changed since the last customization
+
+    // partition, levels 1..L kept at index level - 1
+    vector<vector<OverlayCell>> cells;
+    vector<vector<int>> cellOf;            // [level][node] -> cell
+    vector<vector<int>> vertexPos;         // [level][node] -> position in its cell's vertices, -1 if not one
+    vector<vector<int>> boundaryPos;       // [level][node] -> position in its cell's boundary, -1 if not one
+
+    double lastCustomizeMs;
+    vector<int> queryDist;                 // query labels by node, INT_MAX when untouched
+    vector<char> queryViaClique;           // reached across a cell, its clique row adds nothing
+    vector<int> queryTouched;
+
+    void buildTopology();
+    void buildPartition();
+    void growCells(int level, int limit);
+    void customizeCell(int level, int cell, bool &changed);
+    void customizeCells(int level, vector<int> &dirty, vector<char> &parentDirty);
+    int queryLevel(int v, int s, int t) const;
+
+public:
+    RouteOverlay(Graph &g, int cellNodes = 128, int threads = 0);
+    ~RouteOverlay();
+
+    void build();
+    int customize();
+    int query(int start, int end);
+
+    int getLevelCount() const;
+    int getCellCount(int level) const;
+    double getLastCustomizeMs() const;
+};
+
+#endif
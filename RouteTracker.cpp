@@ -0,0 +1,173 @@
+#include "RouteTracker.h"
+#include "Graph.h"
+#include "Ambulance.h"
+#include "TrafficProfile.h"
+#include <algorithm>
+#include <climits>
+#include <chrono>
+
+using namespace std;
+
+RouteTracker::RouteTracker(Graph &g, bool useWallClock) : graph(g) {
+    wallClock = useWallClock;
+    now = 0;
+    reroutes = 0;
+    listenerHandle = graph.addChangeListener([this](const vector<int> &roads) {
+        onRoadsChanged(roads);
+    });
+}
+
+RouteTracker::~RouteTracker() {
+    graph.removeChangeListener(listenerHandle);
+}
+
+bool RouteTracker::plan(ActiveRoute &route, int from, double start, int startMinute) {
+    if (graph.findRoute(from, route.dest, startMinute, route.roads) == INT_MAX)
+        return false;
+
+    route.start = start;
+    route.startMinute = startMinute;
+    route.nodes.assign(1, from);
+    route.reach.assign(1, 0);
+
+    // walk the roads once to know where the unit is at any time
+    for (int road : route.roads) {
+        Road r = graph.getRoad(road);
+        int at = route.reach.back();
+        route.nodes.push_back(r.src == route.nodes.back() ? r.dest : r.src);
+        route.reach.push_back(at + graph.getTravelTime(road, startMinute + at));
+    }
+    return true;
+}
+// Fastest route avoiding blocked roads (dijkstraAt rules), with the time each node is reached
+
+void RouteTracker::index(const ActiveRoute &route) {
+    for (int road : route.roads)
+        roadUnits[road].push_back(route.amb->getId());
+}
+
+void RouteTracker::unindex(const ActiveRoute &route) {
+    for (int road : route.roads) {
+        auto it = roadUnits.find(road);
+        if (it == roadUnits.end())
+            continue;
+
+        vector<int> &units = it->second;
+        auto pos = find(units.begin(), units.end(), route.amb->getId());
+        if (pos != units.end()) {
+            *pos = units.back(); // order doesn't matter
+            units.pop_back();
+        }
+        if (units.empty())
+            roadUnits.erase(it);
+    }
+}
+
+int RouteTracker::track(Ambulance* amb, int dest, double time, int minuteOfDay) {
+    finish(amb->getId());
+
+    ActiveRoute route;
+    route.amb = amb;
+    route.dest = dest;
+    if (!plan(route, amb->getLocation(), time, minuteOfDay))
+        return INT_MAX;
+
+    index(route);
+    int eta = route.reach.back();
+    routes[amb->getId()] = move(route);
+    return eta;
+}
+// Starts following a unit that leaves its location now, returns its travel time (INT_MAX if it can't get there)
+
+void RouteTracker::finish(int ambId) {
+    auto it = routes.find(ambId);
+    if (it == routes.end())
+        return;
+
+    unindex(it->second);
+    routes.erase(it);
+}
+// The unit arrived or was called off
+
+void RouteTracker::reroute(int ambId, int road) {
+    ActiveRoute &route = routes[ambId];
+
+    // the unit finishes the road it is on, it turns around at the next node at the earliest
+    double elapsed = now - route.start;
+    int next = lower_bound(route.reach.begin(), route.reach.end(), elapsed) - route.reach.begin();
+    if (next >= (int)route.nodes.size() - 1)
+        return; // arriving anyway
+
+    int at = find(route.roads.begin() + next, route.roads.end(), road) - route.roads.begin();
+    if (at == (int)route.roads.size())
+        return; // already drove past that road
+
+    ActiveRoute fresh;
+    fresh.amb = route.amb;
+    fresh.dest = route.dest;
+    double leave = route.start + route.reach[next];
+    if (!plan(fresh, route.nodes[next], leave, (route.startMinute + route.reach[next]) % MINUTES_PER_DAY))
+        return; // no way around, it keeps going and waits at the closure
+
+    unindex(route);
+    index(fresh);
+    route = move(fresh);
+    reroutes++;
+
+    if (handler)
+        handler(route.amb, route.start + route.reach.back());
+}
+// Recomputes one unit's route from the next node it reaches, only when the changed road is still ahead
+
+void RouteTracker::onRoadsChanged(const vector<int> &roads) {
+    if (wallClock)
+        now = currentTime(); // how far along each unit is right now
+    for (int road : roads) {
+        auto it = roadUnits.find(road);
+        if (it == roadUnits.end())
+            continue; // nobody drives there, nothing to do
+
+        vector<int> affected = it->second; // rerouting edits the index
+        for (int ambId : affected)
+            reroute(ambId, road);
+    }
+}
+// Only the units whose route uses a changed road are looked at, through the road index
+
+void RouteTracker::setTime(double time) {
+    now = time;
+}
+// Current time, rerouting needs to know how far along its route each unit is
+
+double RouteTracker::currentTime() const {
+    if (!wallClock)
+        return now;
+    return chrono::duration<double, ratio<60>>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+// Minutes, on the steady clock for live dispatch so a clock change never moves a unit
+
+void RouteTracker::setRerouteHandler(RerouteHandler h) {
+    handler = h;
+}
+
+const ActiveRoute* RouteTracker::getRoute(int ambId) const {
+    auto it = routes.find(ambId);
+    if (it == routes.end())
+        return nullptr;
+    return &it->second;
+}
+
+int RouteTracker::getUnitsOnRoad(int edgeId) const {
+    auto it = roadUnits.find(edgeId);
+    if (it == roadUnits.end())
+        return 0;
+    return it->second.size();
+}
+
+int RouteTracker::getActiveCount() const {
+    return routes.size();
+}
+
+int RouteTracker::getRerouteCount() const {
+    return reroutes;
+}
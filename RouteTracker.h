@@ -0,0 +1,58 @@
+#ifndef ROUTE_TRACKER_H
+#define ROUTE_TRACKER_H
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+using namespace std;
+
+class Graph;
+class Ambulance;
+
+struct ActiveRoute {
+    Ambulance* amb;
+    int dest;
+    double start;        // time the unit left nodes[0]
+    int startMinute;     // minute of the day it left, prices the roads with traffic
+    vector<int> roads;   // edge IDs in driving order
+    vector<int> nodes;   // nodes[i] is where roads[i] starts, the last one is dest
+    vector<int> reach;   // minutes after start each node is reached
+};
+
+typedef function<void(Ambulance* amb, double arrival)> RerouteHandler;
+// Told about every unit that got a new route and when it now arrives
+
+class RouteTracker {
+    Graph &graph;
+    int listenerHandle;
+    bool wallClock;     // live dispatch: minutes are read from the clock, not set by a simulation
+    double now;
+    int reroutes;
+
+    unordered_map<int, ActiveRoute> routes;     // ambulance ID -> route it is driving
+    unordered_map<int, vector<int>> roadUnits;  // edge ID -> ambulance IDs whose route uses it
+    RerouteHandler handler;
+
+    bool plan(ActiveRoute &route, int from, double start, int startMinute);
+    void index(const ActiveRoute &route);
+    void unindex(const ActiveRoute &route);
+    void reroute(int ambId, int road);
+    void onRoadsChanged(const vector<int> &roads);
+
+public:
+    RouteTracker(Graph &g, bool useWallClock = false);
+    ~RouteTracker();
+
+    int track(Ambulance* amb, int dest, double time, int minuteOfDay);
+    void finish(int ambId);
+    void setTime(double time);
+    double currentTime() const;
+    void setRerouteHandler(RerouteHandler h);
+
+    const ActiveRoute* getRoute(int ambId) const;
+    int getUnitsOnRoad(int edgeId) const;
+    int getActiveCount() const;
+    int getRerouteCount() const;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "ScenarioRunner.h"
+#include "ThreadPool.h"
+#include "Graph.h"
+#include "ResourceManager.h"
+#include "Incident.h"
+#include "utils.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+struct RunResult {
+    double mean;
+    double p90;
+    double highP90;
+    double coverage;
+};
+// Outcome of one randomized simulation
+
+ScenarioRunner::ScenarioRunner(Graph &g, const SimulationConfig &baseConfig, int runsPerPlan, double coverageMinutes)
+    : graph(g), base(baseConfig) {
+    replications = max(1, runsPerPlan);
+    targetMinutes = coverageMinutes;
+    base.roadChangesPerHour = 0; // runs share one read-only map, so no closures inside a run
+}
+
+void ScenarioRunner::addPlan(const FleetPlan &plan) {
+    plans.push_back(plan);
+}
+
+void ScenarioRunner::loadPlansFromFile(const string &filename) {
+    ifstream file(filename);
+
+    if (!file.is_open()) {
+        cout << "File error\n";
+        return;
+    }
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        auto parts = split(line, ' ');
+        if (parts.size() == 25 && parts[0] == "hourly") {
+            base.hourlyFactor.clear();
+            for (int i = 1; i < 25; i++)
+                base.hourlyFactor.push_back(stod(parts[i]));
+        } else if (parts.size() >= 3 && parts[0] == "plan") {
+            FleetPlan plan;
+            plan.name = parts[1];
+            for (int i = 2; i < (int)parts.size(); i++) {
+                int node = stoi(parts[i]);
+                if (graph.hasNode(node))
+                    plan.stations.push_back(node);
+            }
+            if (!plan.stations.empty())
+                addPlan(plan);
+        }
+    }
+
+    file.close();
+    cout << plans.size() << " fleet plans loaded\n";
+}
+// File format: "hourly f0 .. f23" (optional relative rate per hour) and "plan name node node ..."
+
+int ScenarioRunner::getPlanCount() const {
+    return plans.size();
+}
+
+vector<PlanResult> ScenarioRunner::run(int threads) {
+    int total = plans.size() * replications;
+    vector<RunResult> runs(total); // each task writes only its own slot, no locking needed
+
+    auto start = chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (int task = 0; task < total; task++) {
+            pool.submit([this, task, &runs] {
+                const FleetPlan &plan = plans[task / replications];
+
+                SimulationConfig config = base;
+                config.seed = base.seed + task % replications; // same seeds for every plan
+
+                ResourceManager fleet;
+                IncidentQueue queue;
+                fleet.setVerbose(false);
+                queue.setVerbose(false);
+                for (int i = 0; i < (int)plan.stations.size(); i++)
+                    fleet.addAmbulance(i, plan.stations[i]);
+
+                Simulator sim(graph, fleet, queue, config);
+                sim.run();
+
+                RunResult &r = runs[task];
+                r.mean = sim.getOverallStats().mean;
+                r.p90 = sim.getOverallStats().p90;
+                r.highP90 = sim.getStats(3).p90;
+                r.coverage = sim.getCoverage(targetMinutes);
+            });
+        }
+        pool.waitAll();
+        cout << total << " simulations on " << pool.size() << " threads in "
+             << fixed << setprecision(2)
+             << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s\n";
+        cout.unsetf(ios::fixed);
+    }
+
+    vector<PlanResult> results;
+    for (int p = 0; p < (int)plans.size(); p++) {
+        PlanResult res = {plans[p].name, (int)plans[p].stations.size(), replications, 0, 0, 0, 0, 0};
+        for (int k = 0; k < replications; k++) {
+            RunResult &r = runs[p * replications + k];
+            res.meanResponse += r.mean / replications;
+            res.p90Response += r.p90 / replications;
+            res.highP90 += r.highP90 / replications;
+            res.coverage += r.coverage / replications;
+        }
+        for (int k = 0; k < replications; k++) {
+            double d = runs[p * replications + k].coverage - res.coverage;
+            res.coverageSpread += d * d / replications;
+        }
+        res.coverageSpread = sqrt(res.coverageSpread);
+        results.push_back(res);
+    }
+
+    sort(results.begin(), results.end(), [](const PlanResult &a, const PlanResult &b) {
+        return a.coverage > b.coverage;
+    });
+    return results;
+}
+// Runs every plan replications times in parallel, plans see the same seeded incident streams
+// Returns one aggregated row per plan, best coverage first
+
+void ScenarioRunner::printResults(const vector<PlanResult> &results) const {
+    cout << "\nFleet Plan Results (coverage = on scene within " << targetMinutes << " min)\n";
+    cout << "Plan            Units  Runs     Mean      P90  HighP90  Coverage\n";
+    cout << fixed << setprecision(2);
+    for (auto &r : results) {
+        cout << left << setw(16) << r.name << right
+             << setw(5) << r.units
+             << setw(6) << r.runs
+             << setw(9) << r.meanResponse
+             << setw(9) << r.p90Response
+             << setw(9) << r.highP90
+             << setw(7) << r.coverage * 100 << "% +/- " << r.coverageSpread * 100 << endl;
+    }
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
@@ -0,0 +1,44 @@
+#ifndef SCENARIO_RUNNER_H
+#define SCENARIO_RUNNER_H
+
+#include <vector>
+#include <string>
+#include "Simulator.h"
+using namespace std;
+
+class Graph;
+
+struct FleetPlan {
+    string name;
+    vector<int> stations; // one entry per ambulance, a node may appear more than once
+};
+
+struct PlanResult {
+    string name;
+    int units;
+    int runs;
+    double meanResponse;   // average over runs of the mean response time
+    double p90Response;    // average over runs of the 90th percentile
+    double highP90;        // same for HIGH priority only
+    double coverage;       // average share of incidents reached within the target time
+    double coverageSpread; // standard deviation of coverage between runs
+};
+
+class ScenarioRunner {
+    Graph &graph;
+    SimulationConfig base;
+    int replications;
+    double targetMinutes;
+    vector<FleetPlan> plans;
+
+public:
+    ScenarioRunner(Graph &g, const SimulationConfig &baseConfig, int runsPerPlan, double coverageMinutes);
+
+    void addPlan(const FleetPlan &plan);
+    void loadPlansFromFile(const string &filename);
+    int getPlanCount() const;
+    vector<PlanResult> run(int threads = 0);
+    void printResults(const vector<PlanResult> &results) const;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef SEARCH_QUEUE_H
+#define SEARCH_QUEUE_H
+
+#include <vector>
+#include <queue>
+#include <utility>
+using namespace std;
+
+// Priority queues for the Dijkstra searches. All of them hand out (distance, node) pairs
+// smallest distance first and allow the same node to be pushed again with a better
+// distance (stale copies are skipped by the search). Dial and the radix heap are monotone:
+// nothing pushed may be smaller than the last distance popped, which Dijkstra guarantees.
+
+enum QueueKind {
+    QUEUE_AUTO,         // pick from the largest road time
+    QUEUE_BINARY_HEAP,
+    QUEUE_DIAL,
+    QUEUE_RADIX_HEAP
+};
+
+const int DIAL_MAX_WEIGHT = 1024; // above this a bucket per minute wastes too much scanning
+
+class BinaryHeapQueue {
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
+
+public:
+    void push(int dist, int node) {
+        pq.push({dist, node});
+    }
+
+    pair<int, int> pop() {
+        pair<int, int> top = pq.top();
+        pq.pop();
+        return top;
+    }
+
+    bool empty() const {
+        return pq.empty();
+    }
+};
+// The std::priority_queue the searches always used, O(log n) per operation
+
+class DialQueue {
+    vector<vector<int>> buckets; // bucket d % size holds the nodes at distance d
+    int current;                 // distance of the bucket being emptied
+    int count;
+
+public:
+    DialQueue(int maxWeight) : buckets(maxWeight + 1), current(0), count(0) {}
+
+    void push(int dist, int node) {
+        buckets[dist % buckets.size()].push_back(node);
+        count++;
+    }
+
+    pair<int, int> pop() {
+        while (buckets[current % buckets.size()].empty())
+            current++;
+        vector<int> &b = buckets[current % buckets.size()];
+        int node = b.back();
+        b.pop_back();
+        count--;
+        return {current, node};
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+};
+// Dial's bucket queue: one bucket per minute, reused around a ring of maxWeight + 1,
+// since nothing waiting can be more than one road time past the current distance
+
+class RadixHeapQueue {
+    vector<pair<unsigned, int>> buckets[33]; // bucket i: distances differing from last in bit i - 1 at most
+    unsigned last;                           // last distance popped
+    int count;
+
+    static int bucketOf(unsigned dist, unsigned last) {
+        return dist == last ? 0 : 32 - __builtin_clz(dist ^ last);
+    }
+
+public:
+    RadixHeapQueue() : last(0), count(0) {}
+
+    void push(int dist, int node) {
+        buckets[bucketOf(dist, last)].push_back({(unsigned)dist, node});
+        count++;
+    }
+
+    pair<int, int> pop() {
+        if (buckets[0].empty()) {
+            int i = 1;
+            while (buckets[i].empty())
+                i++;
+
+            // the smallest distance in the first non-empty bucket becomes last,
+            // and everything in that bucket moves to a lower one
+            unsigned smallest = buckets[i][0].first;
+            for (auto &e : buckets[i])
+                if (e.first < smallest)
+                    smallest = e.first;
+            last = smallest;
+            for (auto &e : buckets[i])
+                buckets[bucketOf(e.first, last)].push_back(e);
+            buckets[i].clear();
+        }
+
+        pair<unsigned, int> top = buckets[0].back();
+        buckets[0].pop_back();
+        count--;
+        return {(int)top.first, top.second};
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+};
+// Radix heap: 33 buckets by the highest bit that differs from the last distance popped,
+// each entry moves down at most 32 times whatever the road times are
+
+#endif
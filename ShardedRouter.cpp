@@ -0,0 +1,530 @@
+#include "ShardedRouter.h"
+#include "Graph.h"
+#include "SearchQueue.h"
+#include "Trace.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// Messages between the router and a region worker: type, payload length, payload ints
+enum ShardMessage { MSG_LOAD, MSG_READY, MSG_TABLE, MSG_FROM, MSG_ROAD, MSG_QUIT };
+
+static bool writeAll(int fd, const void* data, size_t n) {
+    const char* p = (const char*)data;
+    while (n > 0) {
+        ssize_t sent = send(fd, p, n, MSG_NOSIGNAL); // a dead worker is an error, not SIGPIPE
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        p += sent;
+        n -= sent;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t n) {
+    char* p = (char*)data;
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+static bool sendMessage(int fd, int type, const vector<int> &payload) {
+    int header[2] = {type, (int)payload.size()};
+    return writeAll(fd, header, sizeof(header)) &&
+           writeAll(fd, payload.data(), payload.size() * sizeof(int));
+}
+
+static bool receiveMessage(int fd, int &type, vector<int> &payload) {
+    int header[2];
+    if (!readAll(fd, header, sizeof(header)) || header[1] < 0)
+        return false;
+    type = header[0];
+    payload.resize(header[1]);
+    return readAll(fd, payload.data(), payload.size() * sizeof(int));
+}
+
+static bool expectMessage(int fd, int type, vector<int> &payload) {
+    int got;
+    return receiveMessage(fd, got, payload) && got == type;
+}
+
+ShardedRouter::ShardedRouter(Graph &g, int count) : graph(g) {
+    regionCount = max(1, count);
+    builtNodes = -1;
+    builtEdges = -1;
+    listenerHandle = graph.addChangeListener([this](const vector<int> &changedRoads) {
+        if (isRunning())
+            pendingRoads.insert(pendingRoads.end(), changedRoads.begin(), changedRoads.end());
+    });
+}
+// Road changes are queued and handed to the workers on the next query or refresh()
+
+ShardedRouter::~ShardedRouter() {
+    stop();
+    graph.removeChangeListener(listenerHandle);
+}
+
+void ShardedRouter::partition(vector<vector<int>> &members) {
+    // breadth-first order over the whole map, restarted for every disconnected piece
+    vector<int> nodes = graph.getAllNodes();
+    vector<int> order;
+    unordered_map<int, bool> seen;
+    for (int root : nodes) {
+        if (seen[root])
+            continue;
+        seen[root] = true;
+        size_t head = order.size();
+        order.push_back(root);
+        while (head < order.size()) {
+            for (auto &next : graph.getNeighbors(order[head++])) {
+                if (!seen[next.first]) {
+                    seen[next.first] = true;
+                    order.push_back(next.first);
+                }
+            }
+        }
+    }
+
+    // equal runs of that order are bands of BFS levels, so each region is one piece of
+    // the map with only its two edges touching other regions
+    members.assign(regionCount, vector<int>());
+    for (size_t i = 0; i < order.size(); i++)
+        members[i * regionCount / order.size()].push_back(order[i]);
+}
+
+bool ShardedRouter::spawn(int r, const string &program, const vector<int> &members) {
+    RegionShard &shard = regions[r];
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("socketpair");
+        return false;
+    }
+
+    // everything the child needs is ready before the fork, it only execs
+    char fdArg[16];
+    snprintf(fdArg, sizeof(fdArg), "%d", sv[1]);
+    const char* path = program.c_str();
+    cout.flush();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        fcntl(sv[1], F_SETFD, 0); // its own end survives the exec, the rest of ours do not
+        execl(path, path, "--region-worker", fdArg, (char*)nullptr);
+        _exit(127);
+    }
+    close(sv[1]);
+    shard.pid = pid;
+    shard.fd = sv[0];
+
+    // the worker gets its own part of the map and nothing else
+    vector<int> load;
+    load.push_back(members.size());
+    load.insert(load.end(), members.begin(), members.end());
+    load.push_back(shard.boundary.size());
+    load.insert(load.end(), shard.boundary.begin(), shard.boundary.end());
+    vector<int> roads;
+    for (int id = 0; id < graph.getEdgeCount(); id++) {
+        Road road = graph.getRoad(id);
+        if (regionOf[road.src] != r || regionOf[road.dest] != r)
+            continue;
+        roads.push_back(road.src);
+        roads.push_back(road.dest);
+        roads.push_back(road.weight);
+        roads.push_back(graph.isRoadBlocked(road.src, road.dest));
+    }
+    load.push_back(roads.size() / 4);
+    load.insert(load.end(), roads.begin(), roads.end());
+    return sendMessage(shard.fd, MSG_LOAD, load);
+}
+
+bool ShardedRouter::start(const string &program) {
+    TRACE_SPAN("sharded", "start");
+    stop();
+
+    vector<vector<int>> members;
+    partition(members);
+    regions.assign(regionCount, RegionShard{-1, -1, 0, 0, {}, {}, 0});
+    regionOf.clear();
+    for (int r = 0; r < regionCount; r++)
+        for (int node : members[r])
+            regionOf[node] = r;
+
+    // a node is on the boundary when one of its roads leaves the region
+    cutRoads.clear();
+    unordered_map<int, bool> onBoundary;
+    for (int id = 0; id < graph.getEdgeCount(); id++) {
+        Road road = graph.getRoad(id);
+        if (regionOf[road.src] == regionOf[road.dest])
+            continue;
+        cutRoads.push_back(id);
+        onBoundary[road.src] = true;
+        onBoundary[road.dest] = true;
+    }
+    overlayIndex.clear();
+    for (int r = 0; r < regionCount; r++) {
+        for (int node : members[r]) {
+            if (onBoundary.count(node)) {
+                int next = overlayIndex.size();
+                overlayIndex[node] = next;
+                regions[r].boundary.push_back(node);
+            }
+        }
+    }
+
+    for (int r = 0; r < regionCount; r++) {
+        if (!spawn(r, program, members[r])) {
+            cout << "Could not start the worker for region " << r << endl;
+            stop();
+            return false;
+        }
+    }
+
+    // workers load in parallel, then their tables are computed in parallel too
+    vector<int> all;
+    for (int r = 0; r < regionCount; r++) {
+        vector<int> ready;
+        if (!expectMessage(regions[r].fd, MSG_READY, ready) || ready.size() != 2) {
+            cout << "Region worker " << r << " did not start" << endl;
+            stop();
+            return false;
+        }
+        regions[r].nodes = ready[0];
+        regions[r].roads = ready[1];
+        all.push_back(r);
+    }
+    if (!fetchTables(all))
+        return false;
+
+    pendingRoads.clear();
+    buildOverlay();
+    builtNodes = graph.getNodeCount();
+    builtEdges = graph.getEdgeCount();
+    return true;
+}
+// Partitions the map, starts one worker process per region running `program` and
+// collects every region's boundary table
+
+bool ShardedRouter::fetchTables(const vector<int> &which) {
+    TRACE_SPAN("sharded", "fetch_tables");
+    for (int r : which)
+        sendMessage(regions[r].fd, MSG_TABLE, {});
+
+    for (int r : which) {
+        RegionShard &shard = regions[r];
+        size_t b = shard.boundary.size();
+        vector<int> reply;
+        if (!expectMessage(shard.fd, MSG_TABLE, reply) || reply.size() != b * b + 1) {
+            cout << "Region worker " << r << " stopped answering" << endl;
+            stop();
+            return false;
+        }
+        shard.tableMs = reply.back() / 1000.0; // the worker reports microseconds
+        reply.pop_back();
+        shard.table.swap(reply);
+    }
+    return true;
+}
+
+void ShardedRouter::buildOverlay() {
+    int n = overlayIndex.size();
+    vector<pair<int, pair<int, int>>> arcs; // from, (to, weight)
+
+    for (auto &shard : regions) {
+        size_t b = shard.boundary.size();
+        for (size_t i = 0; i < b; i++) {
+            int from = overlayIndex[shard.boundary[i]];
+            for (size_t j = 0; j < b; j++) {
+                int w = shard.table[i * b + j];
+                if (i != j && w != INT_MAX)
+                    arcs.push_back({from, {overlayIndex[shard.boundary[j]], w}});
+            }
+        }
+    }
+    for (int id : cutRoads) {
+        Road road = graph.getRoad(id);
+        if (graph.isRoadBlocked(road.src, road.dest))
+            continue;
+        int a = overlayIndex[road.src], b = overlayIndex[road.dest];
+        arcs.push_back({a, {b, road.weight}});
+        arcs.push_back({b, {a, road.weight}});
+    }
+
+    overlayStart.assign(n + 1, 0);
+    for (auto &arc : arcs)
+        overlayStart[arc.first + 1]++;
+    for (int i = 0; i < n; i++)
+        overlayStart[i + 1] += overlayStart[i];
+    overlayTo.resize(arcs.size());
+    overlayWeight.resize(arcs.size());
+    vector<int> fill(overlayStart.begin(), overlayStart.end() - 1);
+    for (auto &arc : arcs) {
+        int at = fill[arc.first]++;
+        overlayTo[at] = arc.second.first;
+        overlayWeight[at] = arc.second.second;
+    }
+}
+// Boundary nodes joined by every region's table plus the roads that cross between regions
+
+void ShardedRouter::stop() {
+    for (auto &shard : regions) {
+        if (shard.fd != -1) {
+            sendMessage(shard.fd, MSG_QUIT, {});
+            close(shard.fd);
+            shard.fd = -1;
+        }
+        if (shard.pid > 0) {
+            waitpid(shard.pid, nullptr, 0);
+            shard.pid = -1;
+        }
+    }
+    pendingRoads.clear();
+}
+
+bool ShardedRouter::isRunning() const {
+    if (regions.empty())
+        return false;
+    for (auto &shard : regions)
+        if (shard.fd == -1)
+            return false;
+    return true;
+}
+
+bool ShardedRouter::isStale() const {
+    return graph.getNodeCount() != builtNodes || graph.getEdgeCount() != builtEdges;
+}
+// Road changes are followed, new locations or roads need start() again
+
+int ShardedRouter::refresh() {
+    if (!isRunning() || pendingRoads.empty())
+        return 0;
+    TRACE_SPAN("sharded", "refresh");
+
+    sort(pendingRoads.begin(), pendingRoads.end());
+    pendingRoads.erase(unique(pendingRoads.begin(), pendingRoads.end()), pendingRoads.end());
+
+    vector<char> dirty(regionCount, 0);
+    bool crossing = false;
+    int forwarded = 0;
+    for (int id : pendingRoads) {
+        if (id >= graph.getEdgeCount())
+            continue;
+        Road road = graph.getRoad(id);
+        auto a = regionOf.find(road.src), b = regionOf.find(road.dest);
+        if (a == regionOf.end() || b == regionOf.end())
+            continue;
+        if (a->second != b->second) {
+            crossing = true; // only the overlay has it
+            continue;
+        }
+        sendMessage(regions[a->second].fd, MSG_ROAD,
+                    {road.src, road.dest, road.weight, graph.isRoadBlocked(road.src, road.dest)});
+        dirty[a->second] = 1;
+        forwarded++;
+    }
+    pendingRoads.clear();
+
+    vector<int> which;
+    for (int r = 0; r < regionCount; r++)
+        if (dirty[r])
+            which.push_back(r);
+    if (!which.empty() && !fetchTables(which))
+        return forwarded;
+    if (!which.empty() || crossing)
+        buildOverlay();
+    return forwarded;
+}
+// Sends changed roads to the regions holding them and gets new tables from those only
+
+int ShardedRouter::query(int start, int end) {
+    TRACE_SPAN("sharded", "query");
+    if (!isRunning())
+        return INT_MAX;
+    refresh();
+
+    auto rs = regionOf.find(start), re = regionOf.find(end);
+    if (rs == regionOf.end() || re == regionOf.end())
+        return INT_MAX;
+    RegionShard &from = regions[rs->second];
+    RegionShard &to = regions[re->second];
+    bool same = rs->second == re->second;
+
+    // both ends are asked at once, two workers search side by side; in one region the
+    // second request waits in the socket behind the first
+    sendMessage(from.fd, MSG_FROM, {start, same ? end : -1});
+    sendMessage(to.fd, MSG_FROM, {end, -1});
+    vector<int> out, in;
+    if (!expectMessage(from.fd, MSG_FROM, out) || out.size() != from.boundary.size() + 1 ||
+        !expectMessage(to.fd, MSG_FROM, in) || in.size() != to.boundary.size() + 1) {
+        cout << "A region worker stopped answering" << endl;
+        stop();
+        return INT_MAX;
+    }
+
+    long long best = same ? out.back() : INT_MAX; // without leaving the region
+    vector<int> dist(overlayIndex.size(), INT_MAX);
+    vector<int> last(overlayIndex.size(), INT_MAX); // boundary node -> end, inside the end's region
+    for (size_t i = 0; i < to.boundary.size(); i++)
+        last[overlayIndex[to.boundary[i]]] = in[i];
+
+    RadixHeapQueue pq;
+    for (size_t i = 0; i < from.boundary.size(); i++) {
+        if (out[i] == INT_MAX)
+            continue;
+        int u = overlayIndex[from.boundary[i]];
+        dist[u] = out[i];
+        pq.push(out[i], u);
+    }
+
+    while (!pq.empty()) {
+        pair<int, int> top = pq.pop();
+        int d = top.first;
+        int u = top.second;
+        if (d >= best)
+            break;
+        if (d > dist[u])
+            continue;
+        if (last[u] != INT_MAX)
+            best = min(best, (long long)d + last[u]);
+
+        for (int a = overlayStart[u]; a < overlayStart[u + 1]; a++) {
+            int v = overlayTo[a];
+            int total = d + overlayWeight[a];
+            if (total < dist[v]) {
+                dist[v] = total;
+                pq.push(total, v);
+            }
+        }
+    }
+    return best >= INT_MAX ? INT_MAX : (int)best;
+}
+// Start's row to its boundary, Dijkstra over the boundary overlay, then the end's row back;
+// static times avoiding closed roads, the same answers as dijkstraWithBlocked
+
+int ShardedRouter::getOverlayNodeCount() const {
+    return overlayIndex.size();
+}
+
+void ShardedRouter::display() const {
+    cout << "\nSharded Routing (" << regions.size() << " regions, " << overlayIndex.size() << " boundary locations, "
+         << cutRoads.size() << " roads between regions, " << overlayTo.size() << " overlay arcs)\n";
+    cout << fixed << setprecision(1);
+    for (size_t r = 0; r < regions.size(); r++) {
+        const RegionShard &shard = regions[r];
+        cout << "Region " << r << ": ";
+        if (shard.pid > 0)
+            cout << "pid " << shard.pid << ", ";
+        else
+            cout << "stopped, ";
+        cout << shard.nodes << " locations, " << shard.roads << " roads, " << shard.boundary.size()
+             << " on the boundary, table in " << shard.tableMs << " ms\n";
+    }
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+void runRegionWorker(int fd) {
+    Graph region;
+    region.setVerbose(false);
+    vector<int> boundary;
+    unordered_map<int, int> slot; // node ID -> position in the region's getAllNodes order
+    vector<int> position;         // boundary slot -> position
+
+    int type;
+    vector<int> msg;
+    while (receiveMessage(fd, type, msg)) {
+        switch (type) {
+            case MSG_LOAD: {
+                size_t at = 0;
+                int nodes = msg[at++];
+                for (int i = 0; i < nodes; i++)
+                    region.addNode(msg[at++]);
+                int count = msg[at++];
+                boundary.assign(msg.begin() + at, msg.begin() + at + count);
+                at += count;
+                int roads = msg[at++];
+                for (int i = 0; i < roads; i++, at += 4) {
+                    region.addEdge(msg[at], msg[at + 1], msg[at + 2]);
+                    if (msg[at + 3])
+                        region.markRoadBlocked(msg[at], msg[at + 1]);
+                }
+                region.reorderNodes();
+
+                vector<int> order = region.getAllNodes();
+                slot.clear();
+                for (size_t i = 0; i < order.size(); i++)
+                    slot[order[i]] = i;
+                position.clear();
+                for (int node : boundary)
+                    position.push_back(slot[node]);
+                sendMessage(fd, MSG_READY, {region.getNodeCount(), region.getEdgeCount()});
+                break;
+            }
+
+            case MSG_TABLE: {
+                auto start = chrono::steady_clock::now();
+                vector<int> table;
+                table.reserve(boundary.size() * boundary.size() + 1);
+                for (int node : boundary) {
+                    vector<int> dist = region.distancesFrom(node);
+                    for (int p : position)
+                        table.push_back(dist[p]);
+                }
+                table.push_back(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+                sendMessage(fd, MSG_TABLE, table);
+                break;
+            }
+
+            case MSG_FROM: {
+                // roads are undirected, so the row from a location is also the row to it
+                vector<int> dist = region.distancesFrom(msg[0]);
+                vector<int> row;
+                for (int p : position)
+                    row.push_back(dist[p]);
+                auto end = slot.find(msg[1]);
+                row.push_back(end == slot.end() ? INT_MAX : dist[end->second]);
+                sendMessage(fd, MSG_FROM, row);
+                break;
+            }
+
+            case MSG_ROAD:
+                region.updateEdgeWeight(msg[0], msg[1], msg[2]);
+                if (msg[3] && !region.isRoadBlocked(msg[0], msg[1]))
+                    region.markRoadBlocked(msg[0], msg[1]);
+                else if (!msg[3] && region.isRoadBlocked(msg[0], msg[1]))
+                    region.markRoadOpen(msg[0], msg[1]);
+                break;
+
+            case MSG_QUIT:
+                close(fd);
+                return;
+        }
+    }
+    close(fd);
+}
+// Worker process for one region: holds only that region's map and answers the router
+// until told to quit or the router goes away
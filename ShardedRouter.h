@@ -0,0 +1,61 @@
+#ifndef SHARDED_ROUTER_H
+#define SHARDED_ROUTER_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+using namespace std;
+
+class Graph;
+
+struct RegionShard {
+    pid_t pid;              // worker process, -1 when not running
+    int fd;                 // our end of its socket
+    int nodes;
+    int roads;              // roads with both ends in the region
+    vector<int> boundary;   // node IDs with a road to another region
+    vector<int> table;      // boundary x boundary travel times inside the region, INT_MAX if none
+    double tableMs;         // worker time for the last table
+};
+
+class ShardedRouter {
+    Graph &graph;
+    int listenerHandle;
+    int regionCount;
+    long long builtNodes;
+    long long builtEdges;
+
+    vector<RegionShard> regions;
+    unordered_map<int, int> regionOf;      // node ID -> region
+    unordered_map<int, int> overlayIndex;  // boundary node ID -> overlay position
+    vector<int> cutRoads;                  // edge IDs of roads between regions
+
+    // overlay over the boundary nodes: cell cliques plus the roads between regions
+    vector<int> overlayStart;
+    vector<int> overlayTo;
+    vector<int> overlayWeight;
+    vector<int> pendingRoads;              // changed since the last refresh
+
+    void partition(vector<vector<int>> &members);
+    bool spawn(int r, const string &program, const vector<int> &members);
+    bool fetchTables(const vector<int> &which);
+    void buildOverlay();
+
+public:
+    ShardedRouter(Graph &g, int regionCount);
+    ~ShardedRouter();
+
+    bool start(const string &program);
+    void stop();
+    bool isRunning() const;
+    bool isStale() const;
+    int refresh();
+    int query(int start, int end);
+    int getOverlayNodeCount() const;
+    void display() const;
+};
+
+void runRegionWorker(int fd);
+
+#endif
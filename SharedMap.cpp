@@ -0,0 +1,672 @@
+#include "SharedMap.h"
+#include "Graph.h"
+#include "SearchQueue.h"
+#include "TrafficProfile.h"
+#include "Trace.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <random>
+#include <atomic>
+#include <unordered_map>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+static const char MAGIC[8] = {'E', 'R', 'S', 'M', 'A', 'P', '2', 0}; // 2: traffic profiles included
+
+static long long align8(long long at) {
+    return (at + 7) & ~7LL;
+}
+
+SharedMap::SharedMap() {
+    base = nullptr;
+    size = 0;
+    header = nullptr;
+    attachMs = 0;
+}
+
+SharedMap::~SharedMap() {
+    detach();
+}
+
+bool SharedMap::publish(Graph &graph, const string &name) {
+    TRACE_SPAN("shared_map", "publish");
+    vector<int> ids = graph.getAllNodes();
+    int n = ids.size();
+    int m = graph.getEdgeCount();
+    const ProfileStore &profiles = graph.getProfiles();
+    int np = profiles.size();
+    unordered_map<int, int> position;
+    for (int i = 0; i < n; i++)
+        position[ids[i]] = i;
+
+    SharedMapHeader h;
+    memset(&h, 0, sizeof(h));
+    h.graphVersion = graph.getVersion();
+    h.nodes = n;
+    h.roads = m;
+    h.profiles = np;
+    long long at = align8(sizeof(SharedMapHeader));
+    h.nodeIdsAt = at;   at = align8(at + n * sizeof(int));
+    h.sortedIdsAt = at; at = align8(at + n * sizeof(int));
+    h.sortedPosAt = at; at = align8(at + n * sizeof(int));
+    h.offsetAt = at;    at = align8(at + (n + 1) * sizeof(unsigned));
+    h.arcToAt = at;     at = align8(at + 2LL * m * sizeof(int));
+    h.arcRoadAt = at;   at = align8(at + 2LL * m * sizeof(int));
+    h.weightAt = at;    at = align8(at + (long long)m * sizeof(int));
+    h.closedAt = at;    at = align8(at + m);
+    h.roadProfileAt = at; at = align8(at + (long long)m * sizeof(int));
+    h.profileAt = at;   at = align8(at + (long long)np * PROFILE_SLOTS * sizeof(unsigned short));
+    h.bytes = at;
+
+    // a new segment under the same name; processes still attached to the old one keep it
+    // until they detach
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return false;
+    }
+    if (ftruncate(fd, h.bytes) < 0) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    char* p = (char*)mmap(nullptr, h.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    int* nodeIds = (int*)(p + h.nodeIdsAt);
+    int* sortedIds = (int*)(p + h.sortedIdsAt);
+    int* sortedPos = (int*)(p + h.sortedPosAt);
+    unsigned* offset = (unsigned*)(p + h.offsetAt);
+    int* arcTo = (int*)(p + h.arcToAt);
+    int* arcRoad = (int*)(p + h.arcRoadAt);
+    int* weight = (int*)(p + h.weightAt);
+    unsigned char* closed = (unsigned char*)(p + h.closedAt);
+    int* roadProfile = (int*)(p + h.roadProfileAt);
+    unsigned short* profileData = (unsigned short*)(p + h.profileAt);
+
+    for (int id = 0; id < np; id++) {
+        unsigned short* block = profileData + (size_t)id * PROFILE_SLOTS;
+        copy(profiles.getPoints(id), profiles.getPoints(id) + PROFILE_BUCKETS, block);
+        block[PROFILE_BUCKETS] = profiles.getLowest(id);
+        block[PROFILE_BUCKETS + 1] = profiles.getPeak(id);
+        block[PROFILE_BUCKETS + 2] = profiles.getSteepestFall(id);
+    }
+
+    copy(ids.begin(), ids.end(), nodeIds);
+    vector<pair<int, int>> sorted;
+    for (int i = 0; i < n; i++)
+        sorted.push_back({ids[i], i});
+    sort(sorted.begin(), sorted.end());
+    for (int i = 0; i < n; i++) {
+        sortedIds[i] = sorted[i].first;
+        sortedPos[i] = sorted[i].second;
+    }
+
+    // both directions of every road, each node's arcs sorted by neighbour position
+    vector<pair<int, int>> ends(m);
+    vector<unsigned> degree(n + 1, 0);
+    for (int id = 0; id < m; id++) {
+        Road road = graph.getRoad(id);
+        ends[id] = {position[road.src], position[road.dest]};
+        degree[ends[id].first]++;
+        degree[ends[id].second]++;
+        weight[id] = road.weight;
+        closed[id] = graph.isRoadBlocked(road.src, road.dest);
+        roadProfile[id] = road.profile;
+        int longest = road.weight;
+        if (road.profile >= 0)
+            longest = (int)((long long)road.weight * profiles.getPeak(road.profile) / 100) + 1; // +1 for rounding
+        h.maxWeight = max(h.maxWeight, longest);
+    }
+    offset[0] = 0;
+    for (int i = 0; i < n; i++)
+        offset[i + 1] = offset[i] + degree[i];
+    vector<pair<int, int>> list(offset[n]);
+    vector<unsigned> fill(offset, offset + n);
+    for (int id = 0; id < m; id++) {
+        list[fill[ends[id].first]++] = {ends[id].second, id};
+        list[fill[ends[id].second]++] = {ends[id].first, id};
+    }
+    for (int u = 0; u < n; u++)
+        sort(list.begin() + offset[u], list.begin() + offset[u + 1]);
+    for (unsigned a = 0; a < offset[n]; a++) {
+        arcTo[a] = list[a].first;
+        arcRoad[a] = list[a].second;
+    }
+
+    // everything else is in place before the magic says the segment is complete
+    memcpy(p, &h, sizeof(h));
+    atomic_thread_fence(memory_order_release);
+    memcpy(p, MAGIC, sizeof(MAGIC));
+    munmap(p, h.bytes);
+    return true;
+}
+// Writes the current map into a POSIX shared memory segment (e.g. "/ers_map"); it stays
+// there for other processes to attach until remove() or a reboot
+
+bool SharedMap::remove(const string &name) {
+    return shm_unlink(name.c_str()) == 0;
+}
+
+bool SharedMap::attach(const string &segment) {
+    TRACE_SPAN("shared_map", "attach");
+    auto start = chrono::steady_clock::now();
+    detach();
+
+    int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        cout << "No shared map named " << segment << endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SharedMapHeader)) {
+        cout << "Shared map " << segment << " is not complete" << endl;
+        close(fd);
+        return false;
+    }
+    // read-only and shared: every process sees the same physical pages, and a stray write
+    // faults instead of changing the map under the others
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+
+    const SharedMapHeader* h = (const SharedMapHeader*)p;
+    if (memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 || h->bytes != st.st_size) {
+        cout << "Shared map " << segment << " is not complete" << endl;
+        munmap(p, st.st_size);
+        return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    base = (char*)p;
+    size = st.st_size;
+    header = h;
+    nodeIds = (const int*)(base + h->nodeIdsAt);
+    sortedIds = (const int*)(base + h->sortedIdsAt);
+    sortedPos = (const int*)(base + h->sortedPosAt);
+    offset = (const unsigned*)(base + h->offsetAt);
+    arcTo = (const int*)(base + h->arcToAt);
+    arcRoad = (const int*)(base + h->arcRoadAt);
+    weight = (const int*)(base + h->weightAt);
+    closed = (const unsigned char*)(base + h->closedAt);
+    roadProfile = (const int*)(base + h->roadProfileAt);
+    profileData = (const unsigned short*)(base + h->profileAt);
+    attachMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return true;
+}
+// Maps a published map read-only; nothing is parsed or copied, so it takes milliseconds
+
+void SharedMap::detach() {
+    if (base)
+        munmap(base, size);
+    base = nullptr;
+    size = 0;
+    header = nullptr;
+    overlay.clear();
+}
+
+bool SharedMap::isAttached() const {
+    return header != nullptr;
+}
+
+int SharedMap::positionOf(int nodeId) const {
+    const int* end = sortedIds + header->nodes;
+    const int* it = lower_bound(sortedIds, end, nodeId);
+    if (it == end || *it != nodeId)
+        return -1;
+    return sortedPos[it - sortedIds];
+}
+
+vector<int> SharedMap::findRoads(int src, int dest) const {
+    vector<int> found;
+    int s = header ? positionOf(src) : -1;
+    int d = header ? positionOf(dest) : -1;
+    if (s == -1 || d == -1)
+        return found;
+    for (unsigned a = offset[s]; a < offset[s + 1]; a++)
+        if (arcTo[a] == d) // every road between the pair, duplicates included
+            found.push_back(arcRoad[a]);
+    return found;
+}
+
+bool SharedMap::isClosed(int road) const {
+    if (!overlay.empty() && overlay[road])
+        return overlay[road] == OVERLAY_CLOSED;
+    return closed[road];
+}
+// This process's own closures first, then the state the map was published with
+
+bool SharedMap::setOverlay(int edgeId, unsigned char state) {
+    if (!header || edgeId < 0 || edgeId >= header->roads)
+        return false;
+    if (overlay.empty())
+        overlay.assign(header->roads, 0); // one byte per road, against about 30 shared
+    overlay[edgeId] = state;
+    return true;
+}
+
+bool SharedMap::setPairOverlay(int src, int dest, unsigned char state) {
+    vector<int> roads = findRoads(src, dest);
+    for (int id : roads)
+        setOverlay(id, state);
+    return !roads.empty();
+}
+// Like Graph::markRoadBlocked, a pair joined by several roads is closed or opened as a whole
+
+bool SharedMap::closeRoad(int src, int dest) {
+    return setPairOverlay(src, dest, OVERLAY_CLOSED);
+}
+
+bool SharedMap::closeRoadById(int edgeId) {
+    return setOverlay(edgeId, OVERLAY_CLOSED);
+}
+
+bool SharedMap::openRoad(int src, int dest) {
+    return setPairOverlay(src, dest, OVERLAY_OPEN); // also reopens, for this process, a road published as closed
+}
+
+void SharedMap::clearClosures() {
+    overlay.clear();
+}
+
+int SharedMap::getClosureCount() const {
+    return count(overlay.begin(), overlay.end(), OVERLAY_CLOSED);
+}
+
+template <class Body>
+auto SharedMap::withQueue(Body body) const {
+    if (header->maxWeight <= DIAL_MAX_WEIGHT) {
+        DialQueue pq(header->maxWeight);
+        return body(pq);
+    }
+    RadixHeapQueue pq;
+    return body(pq);
+}
+
+int SharedMap::roadTime(int road, int minuteOfDay) const {
+    int profile = roadProfile[road];
+    if (minuteOfDay < 0 || profile < 0)
+        return weight[road];
+    const unsigned short* block = profileData + (size_t)profile * PROFILE_SLOTS;
+    return profileTravelTime(block, block[PROFILE_BUCKETS + 1], block[PROFILE_BUCKETS + 2], weight[road], minuteOfDay);
+}
+// Same times as Graph::getTravelTime, minuteOfDay -1 for the static weight
+
+int SharedMap::lowerBound(int road) const {
+    int profile = roadProfile[road];
+    if (profile < 0)
+        return weight[road];
+    return (int)((long long)weight[road] * profileData[(size_t)profile * PROFILE_SLOTS + PROFILE_BUCKETS] / 100);
+}
+// Fastest the road ever gets, like ProfileStore::lowerBound
+
+int SharedMap::search(int s, int e, int departMinute) const {
+    if (s == e)
+        return 0;
+
+    return withQueue([&](auto &pq) {
+        vector<int> dist(header->nodes, INT_MAX);
+        dist[s] = 0;
+        pq.push(0, s);
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int d = top.first;
+            int u = top.second;
+            if (u == e)
+                return d;
+            if (d > dist[u])
+                continue;
+
+            for (unsigned a = offset[u]; a < offset[u + 1]; a++) {
+                if (isClosed(arcRoad[a]))
+                    continue;
+                int v = arcTo[a];
+                int time = roadTime(arcRoad[a], departMinute < 0 ? -1 : departMinute + d);
+                if (d + time < dist[v]) {
+                    dist[v] = d + time;
+                    pq.push(dist[v], v);
+                }
+            }
+        }
+        return INT_MAX;
+    });
+}
+// Point to point between positions avoiding closed roads, with traffic when departMinute >= 0
+
+int SharedMap::shortestTime(int start, int end) const {
+    if (!header)
+        return INT_MAX;
+    int s = positionOf(start);
+    int e = positionOf(end);
+    if (s == -1 || e == -1)
+        return INT_MAX;
+    return search(s, e, -1);
+}
+// Static times avoiding closed roads, the same answers as dijkstraWithBlocked
+
+int SharedMap::shortestTimeAt(int start, int end, int departMinute) const {
+    if (!header)
+        return INT_MAX;
+    int s = positionOf(start);
+    int e = positionOf(end);
+    if (s == -1 || e == -1)
+        return INT_MAX;
+    return search(s, e, departMinute);
+}
+// Leaving at departMinute with the published traffic profiles, the same answers as dijkstraAt
+
+vector<pair<int, int>> SharedMap::nearestSources(const vector<int> &sources, int target, int k, int departMinute,
+                                                 int maxTime) const {
+    vector<pair<int, int>> best; // (travel time, source index), fastest first
+    int t = header ? positionOf(target) : -1;
+    if (t == -1 || k <= 0)
+        return {};
+
+    unordered_map<int, vector<int>> sourcesAt; // position -> sources standing there
+    for (int i = 0; i < (int)sources.size(); i++) {
+        int p = positionOf(sources[i]);
+        if (p != -1)
+            sourcesAt[p].push_back(i);
+    }
+    bool exact = header->profiles == 0 || departMinute < 0; // without traffic the lower bound is the real time
+
+    withQueue([&](auto &pq) {
+        vector<int> dist(header->nodes, INT_MAX);
+        dist[t] = 0;
+        pq.push(0, t);
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int d = top.first;
+            int u = top.second;
+
+            if (d > maxTime)
+                break;
+            if ((int)best.size() == k && d >= best.back().first)
+                break; // nobody further away can beat the k found
+            if (d > dist[u])
+                continue;
+
+            auto it = sourcesAt.find(u);
+            if (it != sourcesAt.end()) {
+                int time = exact ? d : search(u, t, departMinute); // confirm in the direction driven
+                if (time <= maxTime) {
+                    for (int idx : it->second)
+                        best.push_back({time, idx});
+                    sort(best.begin(), best.end());
+                    if ((int)best.size() > k)
+                        best.resize(k);
+                }
+            }
+
+            for (unsigned a = offset[u]; a < offset[u + 1]; a++) {
+                if (isClosed(arcRoad[a]))
+                    continue;
+                int v = arcTo[a];
+                if (d + lowerBound(arcRoad[a]) < dist[v]) {
+                    dist[v] = d + lowerBound(arcRoad[a]);
+                    pq.push(dist[v], v);
+                }
+            }
+        }
+        return 0;
+    });
+
+    vector<pair<int, int>> ranked;
+    for (auto &b : best)
+        ranked.push_back({b.second, b.first});
+    return ranked;
+}
+// Sources (node IDs) that reach the target fastest, as Graph::nearestSources: one search over
+// lower bounds from the target, each source met checked with traffic at departMinute
+// Returns up to k (source index, travel time) pairs, fastest first, none slower than maxTime
+
+vector<int> SharedMap::isochrone(int source, int budget, int departMinute) const {
+    vector<int> reached;
+    int s = header ? positionOf(source) : -1;
+    if (s == -1 || budget < 0)
+        return reached;
+
+    withQueue([&](auto &pq) {
+        vector<int> dist(header->nodes, INT_MAX);
+        dist[s] = 0;
+        pq.push(0, s);
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int d = top.first;
+            int u = top.second;
+            if (d > budget)
+                break;
+            if (d > dist[u])
+                continue;
+            reached.push_back(nodeIds[u]);
+
+            for (unsigned a = offset[u]; a < offset[u + 1]; a++) {
+                if (isClosed(arcRoad[a]))
+                    continue;
+                int v = arcTo[a];
+                int time = d + roadTime(arcRoad[a], departMinute < 0 ? -1 : departMinute + d);
+                if (time <= budget && time < dist[v]) {
+                    dist[v] = time;
+                    pq.push(time, v);
+                }
+            }
+        }
+        return 0;
+    });
+    return reached;
+}
+// Node IDs reachable within budget minutes, closest first, as Graph::isochrone
+
+vector<int> SharedMap::distancesFrom(int source) const {
+    if (!header)
+        return vector<int>();
+    vector<int> dist(header->nodes, INT_MAX);
+    int s = positionOf(source);
+    if (s == -1)
+        return dist;
+
+    withQueue([&](auto &pq) {
+        dist[s] = 0;
+        pq.push(0, s);
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int d = top.first;
+            int u = top.second;
+            if (d > dist[u])
+                continue;
+
+            for (unsigned a = offset[u]; a < offset[u + 1]; a++) {
+                if (isClosed(arcRoad[a]))
+                    continue;
+                int v = arcTo[a];
+                if (d + weight[arcRoad[a]] < dist[v]) {
+                    dist[v] = d + weight[arcRoad[a]];
+                    pq.push(dist[v], v);
+                }
+            }
+        }
+        return 0;
+    });
+    return dist;
+}
+// One-to-all in the published node order, see getNodeId()
+
+void SharedMap::displayClosedRoads() const {
+    if (!header)
+        return;
+    int shown = 0;
+    cout << "Closed roads:";
+    for (int u = 0; u < header->nodes; u++)
+        for (unsigned a = offset[u]; a < offset[u + 1]; a++)
+            if (arcTo[a] > u && isClosed(arcRoad[a])) { // each road once, from its lower position
+                cout << " " << nodeIds[u] << "-" << nodeIds[arcTo[a]];
+                shown++;
+            }
+    if (shown == 0)
+        cout << " none";
+    cout << endl;
+}
+// Published closures plus this process's own
+
+bool SharedMap::hasNode(int nodeId) const {
+    return header && positionOf(nodeId) != -1;
+}
+
+bool SharedMap::hasProfiles() const {
+    return header && header->profiles > 0;
+}
+
+int SharedMap::getNodeCount() const {
+    return header ? header->nodes : 0;
+}
+
+int SharedMap::getRoadCount() const {
+    return header ? header->roads : 0;
+}
+
+int SharedMap::getNodeId(int position) const {
+    return nodeIds[position];
+}
+
+long long SharedMap::getBytes() const {
+    return size;
+}
+
+long long SharedMap::getGraphVersion() const {
+    return header ? header->graphVersion : -1;
+}
+
+double SharedMap::getAttachMs() const {
+    return attachMs;
+}
+
+void drawMapReaderWork(int nodes, int roads, int queries, int closures, unsigned seed,
+                       vector<pair<int, int>> &pairs, vector<int> &closedRoads) {
+    mt19937 rng(seed);
+    pairs.clear();
+    closedRoads.clear();
+    if (nodes == 0)
+        return;
+    for (int i = 0; i < closures && roads > 0; i++)
+        closedRoads.push_back(rng() % roads);
+    for (int i = 0; i < queries; i++)
+        pairs.push_back({(int)(rng() % nodes), (int)(rng() % nodes)});
+}
+// Node positions to route between and edge IDs to close, the same for a reader and for
+// the process checking its answers
+
+static void readMemory(long long &privateKb, long long &pssKb) {
+    privateKb = pssKb = -1;
+    ifstream in("/proc/self/smaps_rollup");
+    string line, key;
+    long long kb;
+    while (getline(in, line)) {
+        istringstream ss(line);
+        if (!(ss >> key >> kb))
+            continue;
+        if (key == "Pss:")
+            pssKb = kb;
+        else if (key == "Private_Clean:" || key == "Private_Dirty:")
+            privateKb = max(0LL, privateKb) + kb;
+    }
+}
+
+void runMapReader(const string &name, int queries, int closures, unsigned seed, int fd) {
+    MapReaderReport report = {getpid(), 0, 0, 0, 0, 0, false};
+    SharedMap map;
+    if (map.attach(name)) {
+        report.attachMs = map.getAttachMs();
+
+        vector<pair<int, int>> pairs;
+        vector<int> closedRoads;
+        drawMapReaderWork(map.getNodeCount(), map.getRoadCount(), queries, closures, seed, pairs, closedRoads);
+        for (int id : closedRoads)
+            map.closeRoadById(id);
+
+        auto start = chrono::steady_clock::now();
+        for (auto &q : pairs) {
+            int time = map.shortestTime(map.getNodeId(q.first), map.getNodeId(q.second));
+            if (time != INT_MAX)
+                report.checksum += time;
+        }
+        if (!pairs.empty())
+            report.queryMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / pairs.size();
+        readMemory(report.privateKb, report.pssKb);
+        report.ok = true;
+    }
+    if (write(fd, &report, sizeof(report)) != sizeof(report))
+        perror("write");
+    close(fd);
+}
+// Body of a reader process: attach, close its own roads, route, report back and exit
+
+vector<MapReaderReport> runMapReaders(const string &program, const string &name, int readers, int queries,
+                                      int closures, unsigned seed) {
+    vector<MapReaderReport> reports;
+    vector<pair<pid_t, int>> started; // pid, read end of its pipe
+    string queryArg = to_string(queries), closureArg = to_string(closures);
+    cout.flush();
+
+    for (int i = 0; i < readers; i++) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            perror("pipe");
+            break;
+        }
+        string seedArg = to_string(seed + i), fdArg = to_string(fds[1]);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            close(fds[0]);
+            close(fds[1]);
+            break;
+        }
+        if (pid == 0) {
+            fcntl(fds[1], F_SETFD, 0);
+            execl(program.c_str(), program.c_str(), "--map-reader", name.c_str(), queryArg.c_str(),
+                  closureArg.c_str(), seedArg.c_str(), fdArg.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        close(fds[1]);
+        started.push_back({pid, fds[0]});
+    }
+
+    // all readers run at once, attached to the same segment
+    for (auto &reader : started) {
+        MapReaderReport report;
+        memset(&report, 0, sizeof(report));
+        report.pid = reader.first;
+        ssize_t got = read(reader.second, &report, sizeof(report));
+        if (got != sizeof(report))
+            report.ok = false;
+        close(reader.second);
+        waitpid(reader.first, nullptr, 0);
+        reports.push_back(report);
+    }
+    return reports;
+}
+// Starts `readers` processes running `program --map-reader`; reader i uses seed + i
@@ -0,0 +1,118 @@
+#ifndef SHARED_MAP_H
+#define SHARED_MAP_H
+
+#include <vector>
+#include <string>
+#include <climits>
+using namespace std;
+
+class Graph;
+
+const int PROFILE_SLOTS = 99; // per published profile: PROFILE_BUCKETS points, lowest, peak, steepest fall
+const char SHARED_MAP_NAME[] = "/ers_map"; // the map dispatcher consoles attach to
+
+// Start of a published segment. Every section is an offset from the segment start, so the
+// same bytes work wherever a process maps them
+struct SharedMapHeader {
+    char magic[8];              // written last, a half-written segment is never attached
+    long long bytes;
+    long long graphVersion;     // Graph::getVersion() when published
+    int nodes;
+    int roads;
+    int maxWeight;              // longest any road takes at any minute, sizes Dial's buckets
+    int profiles;
+    long long nodeIdsAt;        // int[nodes], position -> node ID, getAllNodes order
+    long long sortedIdsAt;      // int[nodes], node IDs ascending
+    long long sortedPosAt;      // int[nodes], position of sortedIds[i]
+    long long offsetAt;         // unsigned[nodes + 1], first arc of each position
+    long long arcToAt;          // int[2 * roads], neighbour position
+    long long arcRoadAt;        // int[2 * roads], edge ID
+    long long weightAt;         // int[roads], travel time by edge ID
+    long long closedAt;         // unsigned char[roads], blocked when published
+    long long roadProfileAt;    // int[roads], profile of each road, -1 = the same time all day
+    long long profileAt;        // unsigned short[profiles * PROFILE_SLOTS]
+};
+
+struct MapReaderReport {
+    int pid;
+    double attachMs;
+    double queryMs;             // average shortestTime
+    long long checksum;         // sum of the answers, INT_MAX ones left out
+    long long privateKb;        // memory only this process uses
+    long long pssKb;            // proportional share, shared pages split over their users
+    bool ok;
+};
+
+class SharedMap {
+    char* base;
+    size_t size;
+    const SharedMapHeader* header;
+    const int* nodeIds;
+    const int* sortedIds;
+    const int* sortedPos;
+    const unsigned* offset;
+    const int* arcTo;
+    const int* arcRoad;
+    const int* weight;
+    const unsigned char* closed;
+    const int* roadProfile;
+    const unsigned short* profileData;
+
+    vector<unsigned char> overlay; // by edge ID, this process only: 0 as published, then
+                                   // OVERLAY_CLOSED or OVERLAY_OPEN; empty until first used
+    double attachMs;
+
+    int positionOf(int nodeId) const;
+    vector<int> findRoads(int src, int dest) const;
+    bool isClosed(int road) const;
+    int roadTime(int road, int minuteOfDay) const;
+    int lowerBound(int road) const;
+    int search(int s, int e, int departMinute) const;
+    template <class Body> auto withQueue(Body body) const;
+    bool setOverlay(int edgeId, unsigned char state);
+    bool setPairOverlay(int src, int dest, unsigned char state);
+
+    static const unsigned char OVERLAY_CLOSED = 1;
+    static const unsigned char OVERLAY_OPEN = 2;
+
+public:
+    SharedMap();
+    ~SharedMap();
+
+    static bool publish(Graph &graph, const string &name);
+    static bool remove(const string &name);
+    bool attach(const string &name);
+    void detach();
+    bool isAttached() const;
+
+    bool closeRoad(int src, int dest);
+    bool closeRoadById(int edgeId);
+    bool openRoad(int src, int dest);
+    void clearClosures();
+    int getClosureCount() const;
+
+    int shortestTime(int start, int end) const;
+    int shortestTimeAt(int start, int end, int departMinute) const;
+    vector<pair<int, int>> nearestSources(const vector<int> &sources, int target, int k, int departMinute,
+                                          int maxTime = INT_MAX) const;
+    vector<int> isochrone(int source, int budget, int departMinute = -1) const;
+    vector<int> distancesFrom(int source) const;
+    void displayClosedRoads() const;
+
+    bool hasNode(int nodeId) const;
+    bool hasProfiles() const;
+    int getNodeCount() const;
+    int getRoadCount() const;
+    int getNodeId(int position) const;
+    long long getBytes() const;
+    long long getGraphVersion() const;
+    double getAttachMs() const;
+};
+
+void drawMapReaderWork(int nodes, int roads, int queries, int closures, unsigned seed,
+                       vector<pair<int, int>> &pairs, vector<int> &closedRoads);
+vector<MapReaderReport> runMapReaders(const string &program, const string &name, int readers, int queries,
+                                      int closures, unsigned seed);
+void runMapReader(const string &name, int queries, int closures, unsigned seed, int fd);
+
+#endif
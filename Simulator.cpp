@@ -0,0 +1,362 @@
+#include "Simulator.h"
+#include "Graph.h"
+#include "ResourceManager.h"
+#include "Incident.h"
+#include "Ambulance.h"
+#include "TrafficProfile.h"
+#include "RouteTracker.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+
+using namespace std;
+
+SimulationConfig::SimulationConfig() {
+    days = 30;
+    startMinute = 0;
+    incidentsPerHour = 10;
+    highShare = 0.2;
+    mediumShare = 0.5;
+    meanSceneMinutes = 30;
+    roadChangesPerHour = 1;
+    seed = 1;
+}
+
+bool SimEvent::operator>(const SimEvent &other) const {
+    if (time != other.time)
+        return time > other.time;
+    return seq > other.seq;
+}
+// Earliest event first, ties keep the order they were scheduled in
+
+Simulator::Simulator(Graph &g, ResourceManager &r, IncidentQueue &q, const SimulationConfig &cfg)
+    : graph(g), rm(r), queue(q), config(cfg), rng(cfg.seed) {
+    nextSeq = 0;
+    now = 0;
+    peakFactor = 1;
+    freeUnits = 0;
+    roadChanges = 0;
+    routes = nullptr;
+    reroutes = 0;
+    unreachable = 0;
+    eventsProcessed = 0;
+    wallSeconds = 0;
+}
+
+long long Simulator::schedule(double time, SimEventType type, Ambulance* amb, Incident* inc, int road, bool close) {
+    SimEvent ev;
+    ev.time = time;
+    ev.seq = nextSeq++;
+    ev.type = type;
+    ev.amb = amb;
+    ev.inc = inc;
+    ev.road = road;
+    ev.close = close;
+    calendar.push(ev);
+    return ev.seq;
+}
+// Puts an event on the calendar, returns its sequence number
+
+void Simulator::startTrip(double travel, SimEventType arrival, Ambulance* amb, Incident* inc) {
+    long long seq = schedule(now + travel, arrival, amb, inc);
+    if (routes) {
+        SimEvent &leg = legs[amb->getId()];
+        leg.seq = seq;
+        leg.type = arrival;
+        leg.amb = amb;
+        leg.inc = inc;
+    }
+}
+// Schedules the end of a drive and remembers it, so a reroute can move the arrival
+
+void Simulator::onReroute(Ambulance* amb, double arrival) {
+    SimEvent &leg = legs[amb->getId()];
+    leg.seq = schedule(arrival, leg.type, leg.amb, leg.inc); // the old arrival event goes stale
+}
+
+int Simulator::minuteOfDay(double time) const {
+    return (config.startMinute + (long long)time) % MINUTES_PER_DAY;
+}
+
+double Simulator::exponential(double mean) {
+    exponential_distribution<double> d(1.0 / mean);
+    return d(rng);
+}
+
+void Simulator::scheduleNextArrival() {
+    if (config.incidentsPerHour <= 0 || peakFactor <= 0)
+        return;
+
+    // Poisson arrivals at the peak rate, thinned down to the rate of each hour
+    double t = now;
+    while (true) {
+        t += exponential(60.0 / (config.incidentsPerHour * peakFactor));
+        if (t >= config.days * MINUTES_PER_DAY)
+            return;
+
+        if (config.hourlyFactor.size() != 24)
+            break;
+        double keep = config.hourlyFactor[minuteOfDay(t) / 60] / peakFactor;
+        if (uniform_real_distribution<double>(0, 1)(rng) < keep)
+            break;
+    }
+    schedule(t, INCIDENT_ARRIVAL, nullptr, nullptr);
+}
+
+void Simulator::scheduleNextRoadChange() {
+    if (config.roadChangesPerHour <= 0 || graph.getEdgeCount() == 0)
+        return;
+
+    double t = now + exponential(60.0 / config.roadChangesPerHour);
+    if (t < config.days * MINUTES_PER_DAY)
+        schedule(t, ROAD_CHANGE, nullptr, nullptr, rng() % graph.getEdgeCount(), true);
+}
+
+void Simulator::dispatchWaiting() {
+    vector<Incident*> stuck; // no free unit can reach these right now
+
+    while (freeUnits > 0 && !queue.isEmpty()) {
+        Incident* inc = queue.getNextIncident(); // most urgent, oldest first
+        int minute = minuteOfDay(now);
+
+        auto best = rm.findKNearest(inc->getLocation(), 1, graph, nullptr, minute);
+        if (best.empty()) {
+            stuck.push_back(inc);
+            continue;
+        }
+
+        Ambulance* amb = best[0].amb;
+        int travel = best[0].eta;
+        if (routes)
+            travel = routes->track(amb, inc->getLocation(), now, minute); // same search, keeps the route
+        rm.dispatchAmbulance(amb->getId(), inc->getId(), inc->getLocation());
+        freeUnits--;
+        startTrip(travel, UNIT_ARRIVES_SCENE, amb, inc); // en route
+    }
+
+    for (auto inc : stuck)
+        queue.reAddIncident(inc);
+}
+// Hands waiting incidents to free units while both exist, same dispatch rule as production
+
+void Simulator::handle(const SimEvent &ev) {
+    if (routes && (ev.type == UNIT_ARRIVES_SCENE || ev.type == UNIT_ARRIVES_STATION)) {
+        auto leg = legs.find(ev.amb->getId());
+        if (leg == legs.end() || leg->second.seq != ev.seq)
+            return; // the unit was rerouted, a later arrival replaces this one
+        legs.erase(leg);
+        routes->finish(ev.amb->getId());
+    }
+
+    switch (ev.type) {
+        case INCIDENT_ARRIVAL: {
+            int loc;
+            if (config.nodeWeights.size() == nodes.size())
+                loc = nodes[pickNode(rng)];
+            else
+                loc = nodes[rng() % nodes.size()];
+
+            double roll = uniform_real_distribution<double>(0, 1)(rng);
+            string pri = "LOW";
+            if (roll < config.highShare)
+                pri = "HIGH";
+            else if (roll < config.highShare + config.mediumShare)
+                pri = "MEDIUM";
+
+            Incident* inc = queue.addIncident(loc, pri, "Simulated case");
+            reportedAt[inc->getId()] = now;
+
+            scheduleNextArrival();
+            dispatchWaiting();
+            break;
+        }
+
+        case UNIT_ARRIVES_SCENE: {
+            ev.amb->setLocation(ev.inc->getLocation());
+            responseTimes[ev.inc->getPriorityValue() - 1].push_back(now - reportedAt[ev.inc->getId()]);
+            reportedAt.erase(ev.inc->getId());
+            schedule(now + exponential(config.meanSceneMinutes), UNIT_CLEARS_SCENE, ev.amb, ev.inc);
+            break;
+        }
+
+        case UNIT_CLEARS_SCENE: {
+            ev.inc->resolve();
+            int back;
+            if (routes)
+                back = routes->track(ev.amb, ev.amb->getStation(), now, minuteOfDay(now));
+            else
+                back = graph.dijkstraAt(ev.amb->getLocation(), ev.amb->getStation(), minuteOfDay(now));
+            if (back == INT_MAX) {
+                // can't get home right now, become available where we are
+                rm.completeAssignment(ev.amb->getId());
+                freeUnits++;
+                dispatchWaiting();
+            } else {
+                startTrip(back, UNIT_ARRIVES_STATION, ev.amb, nullptr);
+            }
+            break;
+        }
+
+        case UNIT_ARRIVES_STATION: {
+            ev.amb->setLocation(ev.amb->getStation());
+            rm.completeAssignment(ev.amb->getId());
+            freeUnits++;
+            dispatchWaiting();
+            break;
+        }
+
+        case ROAD_CHANGE: {
+            Road r = graph.getRoad(ev.road);
+            if (ev.close) {
+                if (!graph.isRoadBlocked(r.src, r.dest)) {
+                    graph.markRoadBlocked(r.src, r.dest);
+                    closedRoads.push_back(ev.road);
+                    roadChanges++;
+                    double reopen = now + 30 + rng() % 211; // closed for 30 to 240 minutes
+                    schedule(reopen, ROAD_CHANGE, nullptr, nullptr, ev.road, false);
+                }
+                scheduleNextRoadChange();
+            } else {
+                graph.markRoadOpen(r.src, r.dest);
+                closedRoads.erase(find(closedRoads.begin(), closedRoads.end(), ev.road));
+                dispatchWaiting(); // waiting incidents may be reachable again
+            }
+            break;
+        }
+    }
+}
+
+void Simulator::run() {
+    auto wallStart = chrono::steady_clock::now();
+
+    freeUnits = rm.getAvailableCount();
+    nodes = graph.getAllNodes();
+    if (nodes.empty())
+        return;
+
+    if (config.nodeWeights.size() == nodes.size())
+        pickNode = discrete_distribution<int>(config.nodeWeights.begin(), config.nodeWeights.end());
+    if (config.hourlyFactor.size() == 24)
+        peakFactor = *max_element(config.hourlyFactor.begin(), config.hourlyFactor.end());
+
+    // units on the road only need following when roads can close under them;
+    // without closures the map stays read-only and runs can share it
+    if (config.roadChangesPerHour > 0) {
+        routes = new RouteTracker(graph);
+        routes->setRerouteHandler([this](Ambulance* amb, double arrival) {
+            onReroute(amb, arrival);
+        });
+    }
+
+    scheduleNextArrival();
+    scheduleNextRoadChange();
+
+    while (!calendar.empty()) {
+        SimEvent ev = calendar.top();
+        calendar.pop();
+        now = ev.time;
+        if (routes)
+            routes->setTime(now);
+        handle(ev);
+        eventsProcessed++;
+    }
+
+    if (routes) {
+        reroutes = routes->getRerouteCount();
+        delete routes;
+        routes = nullptr;
+        legs.clear();
+    }
+
+    unreachable = reportedAt.size(); // never got a unit on scene
+
+    for (int road : closedRoads) {
+        Road r = graph.getRoad(road);
+        graph.markRoadOpen(r.src, r.dest); // leave the map as we found it
+    }
+    closedRoads.clear();
+
+    wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+}
+// Runs the event calendar until the simulated period is over and every unit is back
+
+static ResponseStats summarize(vector<double> times) {
+    ResponseStats st = {0, 0, 0, 0, 0, 0};
+    if (times.empty())
+        return st;
+
+    sort(times.begin(), times.end());
+    double sum = 0;
+    for (double t : times)
+        sum += t;
+
+    auto pct = [&](double p) {
+        int idx = (int)ceil(p * times.size()) - 1; // nearest rank
+        return times[max(0, idx)];
+    };
+
+    st.count = times.size();
+    st.mean = sum / times.size();
+    st.p50 = pct(0.50);
+    st.p90 = pct(0.90);
+    st.p99 = pct(0.99);
+    st.max = times.back();
+    return st;
+}
+
+ResponseStats Simulator::getStats(int priorityValue) const {
+    return summarize(responseTimes[priorityValue - 1]);
+}
+// Response time distribution (report to unit on scene, minutes) for one priority
+
+ResponseStats Simulator::getOverallStats() const {
+    vector<double> all;
+    for (int p = 0; p < 3; p++)
+        all.insert(all.end(), responseTimes[p].begin(), responseTimes[p].end());
+    return summarize(all);
+}
+
+double Simulator::getCoverage(double withinMinutes) const {
+    long long total = unreachable, covered = 0;
+    for (int p = 0; p < 3; p++) {
+        total += responseTimes[p].size();
+        for (double t : responseTimes[p])
+            if (t <= withinMinutes)
+                covered++;
+    }
+    if (total == 0)
+        return 0;
+    return (double)covered / total;
+}
+// Fraction of incidents that had a unit on scene within the target time
+
+long long Simulator::getEventCount() const {
+    return eventsProcessed;
+}
+
+void Simulator::printReport() const {
+    cout << "\nSimulation Report\n";
+    cout << "Period: " << config.days << " days | Events: " << eventsProcessed
+         << " | Road closures: " << roadChanges << " | Reroutes: " << reroutes
+         << " | Wall time: " << fixed << setprecision(2) << wallSeconds << " s\n";
+
+    cout << "Priority  Count     Mean      P50      P90      P99      Max\n";
+    const char *names[] = {"LOW", "MEDIUM", "HIGH"};
+    for (int p = 3; p >= 1; p--) {
+        ResponseStats st = getStats(p);
+        cout << left << setw(8) << names[p - 1] << right
+             << setw(7) << st.count
+             << setw(9) << st.mean
+             << setw(9) << st.p50
+             << setw(9) << st.p90
+             << setw(9) << st.p99
+             << setw(9) << st.max << endl;
+    }
+
+    cout << "Never reached: " << unreachable << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
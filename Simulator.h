@@ -0,0 +1,109 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <vector>
+#include <queue>
+#include <string>
+#include <random>
+#include <unordered_map>
+using namespace std;
+
+class Graph;
+class ResourceManager;
+class IncidentQueue;
+class Incident;
+class Ambulance;
+class RouteTracker;
+
+struct SimulationConfig {
+    int days;                   // length of the simulated period
+    int startMinute;            // time of day the simulation starts
+    double incidentsPerHour;    // average arrival rate over the whole city
+    vector<double> hourlyFactor;// 24 relative rates by hour of day, empty = flat
+    vector<double> nodeWeights; // relative incident density per node (getAllNodes order), empty = uniform
+    double highShare;           // fraction of HIGH incidents
+    double mediumShare;         // fraction of MEDIUM incidents, the rest are LOW
+    double meanSceneMinutes;    // average time spent on scene
+    double roadChangesPerHour;  // random closures, each reopens after a while
+    unsigned seed;
+
+    SimulationConfig();
+};
+
+enum SimEventType {
+    INCIDENT_ARRIVAL,
+    UNIT_ARRIVES_SCENE,
+    UNIT_CLEARS_SCENE,
+    UNIT_ARRIVES_STATION,
+    ROAD_CHANGE
+};
+
+struct SimEvent {
+    double time;        // minutes since the start of the simulation
+    long long seq;      // keeps events at the same time in creation order
+    SimEventType type;
+    Ambulance* amb;
+    Incident* inc;
+    int road;           // edge ID for ROAD_CHANGE
+    bool close;         // ROAD_CHANGE closes the road when true, reopens it otherwise
+
+    bool operator>(const SimEvent &other) const;
+};
+
+struct ResponseStats {
+    int count;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+class Simulator {
+    Graph &graph;
+    ResourceManager &rm;
+    IncidentQueue &queue;
+    SimulationConfig config;
+
+    priority_queue<SimEvent, vector<SimEvent>, greater<SimEvent>> calendar;
+    mt19937 rng;
+    long long nextSeq;
+    double now;
+    int freeUnits;
+    vector<int> nodes;                      // incident locations are drawn from these
+    discrete_distribution<int> pickNode;    // follows config.nodeWeights
+    double peakFactor;                      // largest hourly factor, used for thinning
+
+    unordered_map<int, double> reportedAt;  // incident ID -> arrival time
+    vector<double> responseTimes[3];        // by priority value - 1
+    vector<int> closedRoads;                // closures still active at the end
+    int roadChanges;
+    int reroutes;                           // en-route units sent around a closure
+    RouteTracker* routes;                   // follows units on the road, only when roads change
+    unordered_map<int, SimEvent> legs;      // ambulance ID -> arrival event of the trip it is on
+    int unreachable;
+    long long eventsProcessed;
+    double wallSeconds;
+
+    long long schedule(double time, SimEventType type, Ambulance* amb, Incident* inc, int road = -1, bool close = false);
+    void startTrip(double travel, SimEventType arrival, Ambulance* amb, Incident* inc);
+    void onReroute(Ambulance* amb, double arrival);
+    int minuteOfDay(double time) const;
+    double exponential(double mean);
+    void scheduleNextArrival();
+    void scheduleNextRoadChange();
+    void dispatchWaiting();
+    void handle(const SimEvent &ev);
+
+public:
+    Simulator(Graph &g, ResourceManager &r, IncidentQueue &q, const SimulationConfig &cfg);
+
+    void run();
+    ResponseStats getStats(int priorityValue) const;
+    ResponseStats getOverallStats() const;
+    double getCoverage(double withinMinutes) const;
+    long long getEventCount() const;
+    void printReport() const;
+};
+
+#endif
@@ -0,0 +1,618 @@
+#include "StateLog.h"
+#include "Graph.h"
+#include "ResourceManager.h"
+#include "Incident.h"
+#include "Trace.h"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+enum RecordType {
+    INCIDENT_ADDED = 1,
+    INCIDENT_RESOLVED,
+    INCIDENTS_CLEARED,
+    UNIT_ADDED,
+    UNIT_REMOVED,
+    UNITS_CLEARED,
+    UNIT_DISPATCHED,
+    UNIT_FREED,
+    UNIT_MOVED,
+    ROAD_CHANGED
+};
+// Log record types, the numbers are part of the file format
+
+static const int GROUP_WINDOW_MS = 5;          // how long the flusher waits for more records to share one fsync
+static const size_t GROUP_BYTES = 64 * 1024;   // a batch this big is written at once
+static const int CHECKPOINT_RECORDS = 10000;   // log length that triggers a new checkpoint
+static const char CHECKPOINT_MAGIC[4] = {'E', 'R', 'S', 'C'};
+static const unsigned CHECKPOINT_FORMAT = 1;
+
+static unsigned checksum(const char* data, size_t size) {
+    unsigned h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < size; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void putU32(vector<char> &out, unsigned v) {
+    for (int i = 0; i < 4; i++)
+        out.push_back((char)(v >> (8 * i)));
+}
+
+static void putU64(vector<char> &out, unsigned long long v) {
+    for (int i = 0; i < 8; i++)
+        out.push_back((char)(v >> (8 * i)));
+}
+
+static void putInt(vector<char> &out, int v) {
+    putU32(out, (unsigned)v);
+}
+
+static void putString(vector<char> &out, const string &s) {
+    putU32(out, s.size());
+    out.insert(out.end(), s.begin(), s.end());
+}
+// Little endian fixed width fields, strings carry their length
+
+struct ByteReader {
+    const vector<char> &data;
+    size_t pos;
+    size_t end;
+    bool ok;
+
+    ByteReader(const vector<char> &d, size_t from, size_t to) : data(d), pos(from), end(to), ok(true) {}
+
+    unsigned long long get(int bytes) {
+        if (!ok || end - pos < (size_t)bytes) {
+            ok = false;
+            return 0;
+        }
+        unsigned long long v = 0;
+        for (int i = 0; i < bytes; i++)
+            v |= (unsigned long long)(unsigned char)data[pos + i] << (8 * i);
+        pos += bytes;
+        return v;
+    }
+
+    unsigned getU32() { return get(4); }
+    unsigned long long getU64() { return get(8); }
+    int getInt() { return (int)getU32(); }
+
+    string getString() {
+        unsigned size = getU32();
+        if (!ok || end - pos < size) {
+            ok = false;
+            return "";
+        }
+        string s(data.begin() + pos, data.begin() + pos + size);
+        pos += size;
+        return s;
+    }
+};
+// Reads the fields back, ok turns false instead of reading past the end
+
+static bool readWholeFile(const string &path, vector<char> &data) {
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+        return false;
+    data.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    return true;
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool replaceFileDurably(const string &path, const vector<char> &data) {
+    string temp = path + ".tmp";
+    int out = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0)
+        return false;
+
+    bool written = writeAll(out, data.data(), data.size()) && fsync(out) == 0;
+    close(out);
+    if (!written || rename(temp.c_str(), path.c_str()) != 0)
+        return false;
+
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : path.substr(0, slash + 1);
+    int dirFd = open(dir.c_str(), O_RDONLY);
+    if (dirFd >= 0) {
+        fsync(dirFd); // makes the rename itself survive a power cut
+        close(dirFd);
+    }
+    return true;
+}
+// Writes a temporary file, syncs it and renames it over the old one, so a crash leaves either version whole
+
+StateLog::StateLog(const string &logFile, const string &checkpointFile)
+    : logPath(logFile), checkpointPath(checkpointFile), graph(nullptr), rm(nullptr), incidents(nullptr),
+      listenerHandle(-1), nextLsn(1), durableLsn(0), checkpointLsn(0), writing(false), stopping(false), waiters(0),
+      seenVersion(-1), seenNodes(0), seenEdges(0), sinceCheckpoint(0), batches(0), records(0) {
+    fd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        cout << "Cannot open state log " << logPath << ", changes will not be kept\n";
+
+    flusher = thread(&StateLog::flusherLoop, this);
+}
+
+StateLog::~StateLog() {
+    commit();
+    detach();
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    flusher.join();
+
+    if (fd >= 0)
+        close(fd);
+}
+
+void StateLog::append(unsigned char type, const vector<char> &payload) {
+    bool due;
+    {
+        lock_guard<mutex> guard(lock);
+        unsigned long long lsn = nextLsn++;
+
+        size_t start = pending.size();
+        putU32(pending, 8 + 1 + payload.size());
+        putU64(pending, lsn);
+        pending.push_back((char)type);
+        pending.insert(pending.end(), payload.begin(), payload.end());
+        putU32(pending, checksum(pending.data() + start + 4, pending.size() - start - 4));
+
+        records++;
+        sinceCheckpoint++;
+        due = sinceCheckpoint >= CHECKPOINT_RECORDS;
+    }
+    wake.notify_one();
+
+    if (due || mapChanged())
+        checkpoint();
+}
+// Record layout: [length][sequence number][type][payload][checksum of everything after the length]
+
+void StateLog::flusherLoop() {
+    unique_lock<mutex> guard(lock);
+
+    while (true) {
+        wake.wait(guard, [this] { return stopping || !pending.empty(); });
+        if (pending.empty())
+            return; // stopping and nothing left to write
+
+        // Give other records a moment to join this batch, they then share one fsync
+        wake.wait_for(guard, chrono::milliseconds(GROUP_WINDOW_MS),
+                      [this] { return stopping || pending.size() >= GROUP_BYTES || waiters > 0; });
+
+        vector<char> batch;
+        batch.swap(pending);
+        unsigned long long last = nextLsn - 1;
+        writing = true;
+        guard.unlock();
+
+        {
+            TRACE_SPAN_ARG("state_log", "group_commit", batch.size());
+            if (fd >= 0 && writeAll(fd, batch.data(), batch.size()))
+                fdatasync(fd);
+        }
+
+        guard.lock();
+        writing = false;
+        durableLsn = max(durableLsn, last);
+        batches++;
+        flushed.notify_all();
+    }
+}
+// Group commit: one write and one fsync cover every record that arrived while the previous batch was on its way
+
+bool StateLog::mapChanged() const {
+    return graph && (graph->getVersion() != seenVersion || graph->getNodeCount() != seenNodes ||
+                     graph->getEdgeCount() != seenEdges);
+}
+// Loading or generating a map adds roads without telling listeners, only a checkpoint keeps those
+
+void StateLog::commit() {
+    TRACE_SPAN("state_log", "commit");
+    if (mapChanged()) {
+        checkpoint();
+        return;
+    }
+
+    unique_lock<mutex> guard(lock);
+    unsigned long long target = nextLsn - 1;
+    waiters++;
+    wake.notify_one();
+    flushed.wait(guard, [this, target] { return durableLsn >= target; });
+    waiters--;
+}
+// Returns once everything logged so far is on disk
+
+void StateLog::roadsChanged(const vector<int> &changedRoads) {
+    if (graph->getVersion() == seenVersion + 1)
+        seenVersion = graph->getVersion(); // only this batch happened since the last look
+
+    for (int id : changedRoads) {
+        Road road = graph->getRoad(id);
+        vector<char> payload;
+        putInt(payload, id);
+        putInt(payload, road.weight);
+        putInt(payload, graph->isRoadBlocked(road.src, road.dest));
+        append(ROAD_CHANGED, payload);
+    }
+}
+// Closures, openings and weight changes arrive through the graph's change listener
+
+void StateLog::incidentAdded(const Incident &inc) {
+    vector<char> payload;
+    putInt(payload, inc.getId());
+    putInt(payload, inc.getLocation());
+    putString(payload, inc.getPriority());
+    putString(payload, inc.getDescription());
+    append(INCIDENT_ADDED, payload);
+}
+
+void StateLog::incidentResolved(int incidentId) {
+    vector<char> payload;
+    putInt(payload, incidentId);
+    append(INCIDENT_RESOLVED, payload);
+}
+
+void StateLog::incidentsCleared() {
+    append(INCIDENTS_CLEARED, {});
+}
+
+void StateLog::unitAdded(int ambulanceId, int location) {
+    vector<char> payload;
+    putInt(payload, ambulanceId);
+    putInt(payload, location);
+    append(UNIT_ADDED, payload);
+}
+
+void StateLog::unitRemoved(int ambulanceId) {
+    vector<char> payload;
+    putInt(payload, ambulanceId);
+    append(UNIT_REMOVED, payload);
+}
+
+void StateLog::unitsCleared() {
+    append(UNITS_CLEARED, {});
+}
+
+void StateLog::unitDispatched(int ambulanceId, int incidentId) {
+    vector<char> payload;
+    putInt(payload, ambulanceId);
+    putInt(payload, incidentId);
+    append(UNIT_DISPATCHED, payload);
+}
+
+void StateLog::unitFreed(int ambulanceId) {
+    vector<char> payload;
+    putInt(payload, ambulanceId);
+    append(UNIT_FREED, payload);
+}
+
+void StateLog::unitMoved(int ambulanceId, int location) {
+    vector<char> payload;
+    putInt(payload, ambulanceId);
+    putInt(payload, location);
+    append(UNIT_MOVED, payload);
+}
+
+void StateLog::writeCheckpoint() {
+    vector<char> out(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 4);
+    putU32(out, CHECKPOINT_FORMAT);
+    putU64(out, checkpointLsn);
+
+    auto nodeIds = graph->getAllNodes();
+    putU32(out, nodeIds.size());
+    for (int id : nodeIds)
+        putInt(out, id);
+
+    putU32(out, graph->getEdgeCount());
+    for (int id = 0; id < graph->getEdgeCount(); id++) {
+        Road road = graph->getRoad(id);
+        putInt(out, road.src);
+        putInt(out, road.dest);
+        putInt(out, road.weight);
+        putInt(out, graph->isRoadBlocked(road.src, road.dest));
+    }
+
+    auto all = incidents->getAllIncidents();
+    putU32(out, all.size());
+    for (auto inc : all) {
+        putInt(out, inc->getId());
+        putInt(out, inc->getLocation());
+        putString(out, inc->getPriority());
+        putString(out, inc->getDescription());
+        putInt(out, inc->isResolved());
+    }
+
+    auto fleet = rm->getAllAmbulances();
+    putU32(out, fleet.size());
+    for (auto amb : fleet) {
+        putInt(out, amb->getId());
+        putInt(out, amb->getLocation());
+        putInt(out, amb->getStation());
+        putInt(out, amb->getAssignedIncident()); // -1 when available
+    }
+
+    putU32(out, checksum(out.data(), out.size()));
+
+    if (!replaceFileDurably(checkpointPath, out))
+        cout << "Checkpoint failed, the log keeps growing\n";
+    else if (fd >= 0 && ftruncate(fd, 0) == 0)
+        pending.clear(); // everything logged so far is inside the checkpoint
+}
+// Node order and edge IDs are kept as they are, so the restored map matches the logged road IDs
+
+void StateLog::checkpoint() {
+    if (!graph)
+        return;
+
+    TRACE_SPAN("state_log", "checkpoint");
+    unique_lock<mutex> guard(lock);
+    flushed.wait(guard, [this] { return !writing; }); // the flusher must not append while the log is cut
+
+    checkpointLsn = nextLsn - 1;
+    writeCheckpoint();
+    if (pending.empty())
+        durableLsn = checkpointLsn;
+
+    sinceCheckpoint = 0;
+    seenVersion = graph->getVersion();
+    seenNodes = graph->getNodeCount();
+    seenEdges = graph->getEdgeCount();
+    flushed.notify_all();
+}
+// Replaces the log with a compact snapshot of the whole state
+
+bool StateLog::restoreCheckpoint(const vector<char> &data, unordered_map<int, int> &incidentIds) {
+    if (data.size() < 20 || memcmp(data.data(), CHECKPOINT_MAGIC, 4) != 0)
+        return false;
+
+    ByteReader in(data, 0, data.size() - 4);
+    ByteReader tail(data, data.size() - 4, data.size());
+    if (tail.getU32() != checksum(data.data(), data.size() - 4))
+        return false;
+
+    in.get(4);
+    if (in.getU32() != CHECKPOINT_FORMAT)
+        return false;
+    checkpointLsn = in.getU64();
+    nextLsn = max(nextLsn, checkpointLsn + 1); // new records must sort after what the checkpoint holds
+
+    graph->clear();
+    unsigned nodeCount = in.getU32();
+    for (unsigned i = 0; i < nodeCount && in.ok; i++)
+        graph->addNode(in.getInt());
+
+    unsigned roadCount = in.getU32();
+    vector<pair<int, int>> blocked;
+    for (unsigned i = 0; i < roadCount && in.ok; i++) {
+        int src = in.getInt();
+        int dest = in.getInt();
+        int weight = in.getInt();
+        graph->addEdge(src, dest, weight);
+        if (in.getInt())
+            blocked.push_back({src, dest});
+    }
+    for (auto &b : blocked)
+        graph->markRoadBlocked(b.first, b.second);
+
+    incidents->clearAll();
+    unsigned incidentCount = in.getU32();
+    for (unsigned i = 0; i < incidentCount && in.ok; i++) {
+        int id = in.getInt();
+        int location = in.getInt();
+        string priority = in.getString();
+        string description = in.getString();
+        bool resolved = in.getInt();
+
+        Incident* inc = incidents->addIncident(location, priority, description);
+        incidentIds[id] = inc->getId();
+        if (resolved)
+            incidents->resolveIncident(inc->getId());
+    }
+
+    rm->clearAll();
+    unsigned unitCount = in.getU32();
+    for (unsigned i = 0; i < unitCount && in.ok; i++) {
+        int id = in.getInt();
+        int location = in.getInt();
+        int station = in.getInt();
+        int assigned = in.getInt();
+
+        rm->addAmbulance(id, station);
+        Ambulance* amb = rm->findAmbulanceById(id);
+        amb->setLocation(location);
+        if (assigned != -1)
+            amb->dispatchTo(incidentIds.count(assigned) ? incidentIds[assigned] : assigned);
+    }
+    return in.ok;
+}
+
+int StateLog::replayLog(const vector<char> &data, unordered_map<int, int> &incidentIds, long long &goodBytes) {
+    auto incidentId = [&incidentIds](int logged) {
+        auto it = incidentIds.find(logged);
+        return it == incidentIds.end() ? logged : it->second;
+    }; // incidents get fresh IDs when they are recreated
+
+    int replayed = 0;
+    size_t pos = 0;
+    goodBytes = 0;
+
+    while (data.size() - pos >= 4) {
+        ByteReader head(data, pos, data.size());
+        size_t length = head.getU32();
+        if (length < 9 || data.size() - head.pos < length + 4)
+            break; // torn write at the end of the log
+
+        ByteReader check(data, head.pos + length, head.pos + length + 4);
+        if (check.getU32() != checksum(data.data() + head.pos, length))
+            break;
+
+        ByteReader in(data, head.pos, head.pos + length);
+        unsigned long long lsn = in.getU64();
+        int type = (unsigned char)in.get(1);
+        pos = head.pos + length + 4;
+        goodBytes = pos;
+        nextLsn = max(nextLsn, lsn + 1);
+        if (lsn <= checkpointLsn)
+            continue; // already inside the checkpoint, the log was not cut before the crash
+
+        switch (type) {
+            case INCIDENT_ADDED: {
+                int id = in.getInt();
+                int location = in.getInt();
+                string priority = in.getString();
+                string description = in.getString();
+                incidentIds[id] = incidents->addIncident(location, priority, description)->getId();
+                break;
+            }
+            case INCIDENT_RESOLVED:
+                incidents->resolveIncident(incidentId(in.getInt()));
+                break;
+            case INCIDENTS_CLEARED:
+                incidents->clearAll();
+                incidentIds.clear();
+                break;
+            case UNIT_ADDED: {
+                int id = in.getInt();
+                rm->addAmbulance(id, in.getInt());
+                break;
+            }
+            case UNIT_REMOVED:
+                rm->removeAmbulance(in.getInt());
+                break;
+            case UNITS_CLEARED:
+                rm->clearAll();
+                break;
+            case UNIT_DISPATCHED: {
+                int id = in.getInt();
+                rm->dispatchAmbulance(id, incidentId(in.getInt()), -1);
+                break;
+            }
+            case UNIT_FREED:
+                rm->completeAssignment(in.getInt());
+                break;
+            case UNIT_MOVED: {
+                int id = in.getInt();
+                rm->moveAmbulance(id, in.getInt());
+                break;
+            }
+            case ROAD_CHANGED: {
+                int id = in.getInt();
+                int weight = in.getInt();
+                bool blocked = in.getInt();
+                if (id < 0 || id >= graph->getEdgeCount())
+                    break;
+                Road road = graph->getRoad(id);
+                if (road.weight != weight)
+                    graph->applyWeightUpdates({{id, weight}});
+                if (blocked != graph->isRoadBlocked(road.src, road.dest)) {
+                    if (blocked)
+                        graph->markRoadBlocked(road.src, road.dest);
+                    else
+                        graph->markRoadOpen(road.src, road.dest);
+                }
+                break;
+            }
+        }
+        replayed++;
+    }
+    return replayed;
+}
+// Applies every intact record after the checkpoint and stops at the first damaged one
+
+bool StateLog::recover(Graph &g, ResourceManager &r, IncidentQueue &q) {
+    vector<char> saved, log;
+    bool haveCheckpoint = readWholeFile(checkpointPath, saved) && !saved.empty();
+    readWholeFile(logPath, log);
+    if (!haveCheckpoint && log.empty())
+        return false;
+
+    auto start = chrono::steady_clock::now();
+    graph = &g;
+    rm = &r;
+    incidents = &q;
+    g.setVerbose(false);
+    r.setVerbose(false);
+    q.setVerbose(false);
+
+    unordered_map<int, int> incidentIds;
+    if (haveCheckpoint && !restoreCheckpoint(saved, incidentIds))
+        cout << "Checkpoint " << checkpointPath << " is damaged, replaying the log alone\n";
+
+    long long goodBytes = 0;
+    int replayed = replayLog(log, incidentIds, goodBytes);
+    if (goodBytes < (long long)log.size() && fd >= 0 && ftruncate(fd, goodBytes) == 0)
+        cout << "Dropped " << log.size() - goodBytes << " bytes of incomplete log records\n";
+
+    g.setVerbose(true);
+    r.setVerbose(true);
+    q.setVerbose(true);
+    graph = nullptr;
+    rm = nullptr;
+    incidents = nullptr;
+
+    // a session that never had a map, units or incidents is no session to go back to
+    if (g.getNodeCount() == 0 && r.getAllAmbulances().empty() && q.getAllIncidents().empty()) {
+        cout << "Previous session was empty" << endl;
+        return false;
+    }
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Recovered previous session: " << (haveCheckpoint ? "checkpoint + " : "") << replayed
+         << " log records in " << ms << " ms" << endl;
+    return true;
+}
+// Rebuilds the state of the last session before anything new is logged; false when there
+// was none or it held nothing, so the default files are loaded instead
+
+void StateLog::attach(Graph &g, ResourceManager &r, IncidentQueue &q) {
+    graph = &g;
+    rm = &r;
+    incidents = &q;
+    listenerHandle = g.addChangeListener([this](const vector<int> &changed) { roadsChanged(changed); });
+    r.setJournal(this);
+    q.setJournal(this);
+    checkpoint(); // starts the log afresh, recovered incidents keep their new IDs from here on
+}
+// Starts logging every change made to these three
+
+void StateLog::detach() {
+    if (!graph)
+        return;
+
+    graph->removeChangeListener(listenerHandle);
+    rm->setJournal(nullptr);
+    incidents->setJournal(nullptr);
+    graph = nullptr;
+    rm = nullptr;
+    incidents = nullptr;
+}
+
+void StateLog::displayStats() {
+    lock_guard<mutex> guard(lock);
+    cout << "\nState log: " << logPath << ", checkpoint: " << checkpointPath << endl;
+    cout << "Records logged: " << records << " in " << batches << " disk writes" << endl;
+    cout << "Records since the last checkpoint: " << sinceCheckpoint << endl;
+}
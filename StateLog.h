@@ -0,0 +1,76 @@
+#ifndef STATE_LOG_H
+#define STATE_LOG_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+class Graph;
+class ResourceManager;
+class IncidentQueue;
+class Incident;
+
+class StateLog {
+    string logPath;
+    string checkpointPath;
+    Graph* graph;
+    ResourceManager* rm;
+    IncidentQueue* incidents;
+    int listenerHandle;
+    int fd;                               // log file, opened for appending
+
+    mutex lock;
+    condition_variable wake;              // the flusher sleeps here until records arrive
+    condition_variable flushed;           // commit() sleeps here until its records are on disk
+    vector<char> pending;                 // encoded records not written yet
+    unsigned long long nextLsn;           // sequence number of the next record
+    unsigned long long durableLsn;        // every record up to this one is on disk
+    unsigned long long checkpointLsn;     // last record the checkpoint already contains
+    bool writing;                         // the flusher is writing a batch outside the lock
+    bool stopping;
+    int waiters;                          // commit() calls waiting, they skip the group window
+    thread flusher;
+
+    long long seenVersion;                // graph version after the last change we logged
+    int seenNodes;
+    int seenEdges;
+    int sinceCheckpoint;                  // records logged after the last checkpoint
+    long long batches;
+    long long records;
+
+    void append(unsigned char type, const vector<char> &payload);
+    void flusherLoop();
+    bool mapChanged() const;
+    void roadsChanged(const vector<int> &changedRoads);
+    void writeCheckpoint();
+    bool restoreCheckpoint(const vector<char> &data, unordered_map<int, int> &incidentIds);
+    int replayLog(const vector<char> &data, unordered_map<int, int> &incidentIds, long long &goodBytes);
+
+public:
+    StateLog(const string &logFile, const string &checkpointFile);
+    ~StateLog();
+
+    bool recover(Graph &g, ResourceManager &r, IncidentQueue &q);
+    void attach(Graph &g, ResourceManager &r, IncidentQueue &q);
+    void detach();
+
+    void incidentAdded(const Incident &inc);
+    void incidentResolved(int incidentId);
+    void incidentsCleared();
+    void unitAdded(int ambulanceId, int location);
+    void unitRemoved(int ambulanceId);
+    void unitsCleared();
+    void unitDispatched(int ambulanceId, int incidentId);
+    void unitFreed(int ambulanceId);
+    void unitMoved(int ambulanceId, int location);
+
+    void commit();
+    void checkpoint();
+    void displayStats();
+};
+
+#endif
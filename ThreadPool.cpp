@@ -0,0 +1,127 @@
+#include "ThreadPool.h"
+#include "Trace.h"
+
+using namespace std;
+
+static thread_local int currentWorker = -1; // queue owned by the calling thread, -1 outside the pool
+
+ThreadPool::ThreadPool(int threadCount) : queued(0), unfinished(0), nextQueue(0), stopping(false) {
+    if (threadCount <= 0)
+        threadCount = max(1u, thread::hardware_concurrency());
+
+    for (int i = 0; i < threadCount; i++)
+        queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+
+    for (int i = 0; i < threadCount; i++)
+        threads.push_back(thread(&ThreadPool::workerLoop, this, i));
+}
+// Starts one worker per core unless a count is given
+
+ThreadPool::~ThreadPool() {
+    waitAll();
+    {
+        lock_guard<mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &t : threads)
+        t.join();
+}
+
+void ThreadPool::submit(function<void()> task) {
+    int target = currentWorker;
+    if (target == -1)
+        target = nextQueue++ % queues.size();
+
+    unfinished++;
+    {
+        lock_guard<mutex> guard(queues[target]->lock);
+        if (currentWorker == -1)
+            queues[target]->tasks.push_front(move(task)); // the owner takes these oldest first, a steady stream can't starve one
+        else
+            queues[target]->tasks.push_back(move(task));
+    }
+    {
+        lock_guard<mutex> guard(sleepLock);
+        queued++;
+    }
+    wake.notify_one();
+}
+// Tasks submitted by a worker go to its own queue, others are spread round robin
+// Own tasks are taken newest first, outside ones in the order they came
+
+bool ThreadPool::takeTask(int self, function<void()> &task) {
+    {
+        WorkQueue &own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back()); // newest own task first, its data is still warm
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+
+    int n = queues.size();
+    for (int k = 1; k < n; k++) {
+        WorkQueue &victim = *queues[(self + k) % n];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front()); // steal the oldest task from another worker
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int self) {
+    currentWorker = self;
+
+    while (true) {
+        function<void()> task;
+        if (takeTask(self, task)) {
+            {
+                TRACE_SPAN_ARG("pool", "task", self);
+                task();
+            }
+            if (--unfinished == 0) {
+                lock_guard<mutex> guard(sleepLock);
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        unique_lock<mutex> guard(sleepLock);
+        wake.wait(guard, [this] { return queued > 0 || stopping; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
+
+void ThreadPool::waitAll() {
+    unique_lock<mutex> guard(sleepLock);
+    allDone.wait(guard, [this] { return unfinished == 0; });
+}
+// Blocks until every submitted task has finished
+
+int ThreadPool::size() const {
+    return threads.size();
+}
+
+Barrier::Barrier(int threadCount) : count(threadCount), waiting(0), phase(0) {}
+
+void Barrier::wait() {
+    int myPhase = phase.load();
+    if (waiting.fetch_add(1) + 1 == count) {
+        waiting = 0;
+        phase++; // last one in releases everybody
+        return;
+    }
+    while (phase.load() == myPhase)
+        this_thread::yield();
+}
+// Spins (yielding the core) until every thread of the group has arrived, steps are short
+// so this is much cheaper than sleeping on a condition variable
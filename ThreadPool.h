@@ -0,0 +1,53 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+using namespace std;
+
+class ThreadPool {
+    struct WorkQueue {
+        deque<function<void()>> tasks;
+        mutex lock;
+    };
+
+    vector<unique_ptr<WorkQueue>> queues; // one per worker
+    vector<thread> threads;
+    atomic<int> queued;                   // tasks waiting in any queue
+    atomic<int> unfinished;               // tasks submitted but not finished
+    atomic<unsigned> nextQueue;           // round robin target for outside submits
+    atomic<bool> stopping;
+    mutex sleepLock;
+    condition_variable wake;              // workers sleep here when there is nothing to steal
+    condition_variable allDone;           // waitAll sleeps here
+
+    bool takeTask(int self, function<void()> &task);
+    void workerLoop(int self);
+
+public:
+    ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    void submit(function<void()> task);
+    void waitAll();
+    int size() const;
+};
+
+class Barrier {
+    int count;
+    atomic<int> waiting;
+    atomic<int> phase;
+
+public:
+    Barrier(int threadCount);
+    void wait();
+};
+// Lets a fixed group of threads meet between the steps of a parallel algorithm
+
+#endif
@@ -0,0 +1,107 @@
+#include "Trace.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+using namespace std;
+
+atomic<bool> Tracer::enabled(false);
+chrono::steady_clock::time_point Tracer::epoch = chrono::steady_clock::now();
+static const thread::id startupThread = this_thread::get_id(); // statics are set up on the main thread
+mutex Tracer::buffersLock;
+vector<shared_ptr<Tracer::ThreadBuffer>> Tracer::buffers;
+
+Tracer::ThreadBuffer &Tracer::threadBuffer() {
+    static thread_local shared_ptr<ThreadBuffer> own;
+    if (!own) {
+        own = make_shared<ThreadBuffer>();
+        own->events.resize(TRACE_BUFFER_EVENTS);
+        own->written = 0;
+        own->mainThread = this_thread::get_id() == startupThread;
+
+        lock_guard<mutex> guard(buffersLock);
+        own->threadId = buffers.size() + 1;
+        buffers.push_back(own);
+    }
+    return *own;
+}
+// Each thread gets its buffer on its first span
+
+void Tracer::setEnabled(bool on) {
+    enabled.store(on, memory_order_relaxed);
+}
+
+long long Tracer::now() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+void Tracer::record(const char* category, const char* name, long long start, long long arg) {
+    long long end = now();
+    ThreadBuffer &buffer = threadBuffer();
+
+    lock_guard<mutex> guard(buffer.lock);
+    buffer.events[buffer.written % TRACE_BUFFER_EVENTS] = {category, name, start, end - start, arg};
+    buffer.written++;
+}
+
+void Tracer::clear() {
+    lock_guard<mutex> guard(buffersLock);
+    for (auto &b : buffers) {
+        lock_guard<mutex> bufferGuard(b->lock);
+        b->written = 0;
+    }
+}
+
+long long Tracer::getEventCount() {
+    lock_guard<mutex> guard(buffersLock);
+    long long total = 0;
+    for (auto &b : buffers) {
+        lock_guard<mutex> bufferGuard(b->lock);
+        total += min<long long>(b->written, TRACE_BUFFER_EVENTS);
+    }
+    return total;
+}
+// Spans still held, overwritten ones not counted
+
+bool Tracer::saveChromeTrace(const string &filename) {
+    string temp = filename + ".tmp";
+    ofstream file(temp);
+    if (!file.is_open())
+        return false;
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    char line[512];
+
+    lock_guard<mutex> guard(buffersLock);
+    for (auto &b : buffers) {
+        lock_guard<mutex> bufferGuard(b->lock);
+
+        snprintf(line, sizeof(line),
+                 "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+                 b->threadId, b->mainThread ? "main" : "worker", b->threadId);
+        file << (first ? "" : ",\n") << line;
+        first = false;
+
+        long long held = min<long long>(b->written, TRACE_BUFFER_EVENTS);
+        for (long long i = b->written - held; i < b->written; i++) { // oldest first
+            const TraceEvent &e = b->events[i % TRACE_BUFFER_EVENTS];
+            int n = snprintf(line, sizeof(line),
+                             "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                             "\"ts\": %.3f, \"dur\": %.3f",
+                             e.name, e.category, b->threadId, e.start / 1000.0, e.duration / 1000.0);
+            if (e.arg >= 0)
+                snprintf(line + n, sizeof(line) - n, ", \"args\": {\"id\": %lld}}", e.arg);
+            else
+                snprintf(line + n, sizeof(line) - n, "}");
+            file << ",\n" << line;
+        }
+    }
+    file << "\n]}\n";
+    file.close();
+
+    return rename(temp.c_str(), filename.c_str()) == 0;
+}
+// Complete ("X") events with microsecond timestamps, one track per thread
@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+using namespace std;
+
+const int TRACE_BUFFER_EVENTS = 1 << 16; // per thread, the oldest spans are overwritten first
+
+struct TraceEvent {
+    const char* category; // string literals only, nothing is copied while recording
+    const char* name;
+    long long start;      // nanoseconds since the tracer started
+    long long duration;
+    long long arg;        // e.g. an ambulance or incident ID, -1 when there is none
+};
+
+class Tracer {
+    struct ThreadBuffer {
+        mutex lock;       // only contended while an export reads the buffer
+        int threadId;
+        bool mainThread;
+        vector<TraceEvent> events;
+        long long written; // total events ever written, the ring position is written % size
+    };
+
+    static atomic<bool> enabled;
+    static chrono::steady_clock::time_point epoch;
+    static mutex buffersLock;
+    static vector<shared_ptr<ThreadBuffer>> buffers; // kept after their thread exits
+
+    static ThreadBuffer &threadBuffer();
+
+public:
+    static bool isEnabled() { return enabled.load(memory_order_relaxed); }
+    static void setEnabled(bool on);
+    static long long now();
+    static void record(const char* category, const char* name, long long start, long long arg);
+    static void clear();
+    static long long getEventCount();
+    static bool saveChromeTrace(const string &filename);
+};
+// Collects timed spans from every thread, written out in Chrome Trace Event format (open in Perfetto)
+
+class TraceSpan {
+    const char* category;
+    const char* name;
+    long long arg;
+    long long start; // -1 when tracing was off at the start of the span
+
+public:
+    TraceSpan(const char* cat, const char* spanName, long long spanArg = -1)
+        : category(cat), name(spanName), arg(spanArg), start(Tracer::isEnabled() ? Tracer::now() : -1) {}
+    ~TraceSpan() {
+        if (start >= 0)
+            Tracer::record(category, name, start, arg);
+    }
+};
+// Times the enclosing block, costs one flag check while tracing is off
+
+#ifdef ERS_NO_TRACING
+#define TRACE_SPAN(category, name)
+#define TRACE_SPAN_ARG(category, name, arg)
+#else
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(category, name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(category, name)
+#define TRACE_SPAN_ARG(category, name, arg) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(category, name, arg)
+#endif
+// Building with -DERS_NO_TRACING removes the spans altogether
+
+#endif
@@ -0,0 +1,136 @@
+#include "TrafficProfile.h"
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+
+ProfileStore::ProfileStore() {
+    highest = 100;
+}
+
+int ProfileStore::addProfile(const vector<unsigned short> &percent) {
+    if (percent.size() != PROFILE_BUCKETS)
+        return -1;
+    for (auto p : percent)
+        if (p < MIN_PROFILE_PERCENT || p > MAX_PROFILE_PERCENT)
+            return -1;
+
+    size_t h = 0;
+    for (auto p : percent)
+        h = h * 31 + p;
+
+    auto range = byHash.equal_range(h);
+    for (auto it = range.first; it != range.second; it++) {
+        const unsigned short *existing = &points[(size_t)it->second * PROFILE_BUCKETS];
+        if (equal(percent.begin(), percent.end(), existing))
+            return it->second; // identical profile already stored, share it
+    }
+
+    int id = size();
+    points.insert(points.end(), percent.begin(), percent.end());
+    lowest.push_back(*min_element(percent.begin(), percent.end()));
+    peak.push_back(*max_element(percent.begin(), percent.end()));
+    int fall = 0;
+    for (int i = 0; i < PROFILE_BUCKETS; i++)
+        fall = max(fall, percent[i] - percent[(i + 1) % PROFILE_BUCKETS]);
+    steepestFall.push_back(fall);
+    highest = max(highest, (int)*max_element(percent.begin(), percent.end()));
+    byHash.insert({h, id});
+    return id;
+}
+// Stores a daily profile (percent of free-flow time per bucket) and returns its ID, -1 if a
+// value is outside MIN_PROFILE_PERCENT..MAX_PROFILE_PERCENT
+// Roads with the same profile get the same ID so each shape is kept only once
+
+static int pointTime(const unsigned short *p, int baseWeight, int t) {
+    t %= MINUTES_PER_DAY;
+    if (t < 0)
+        t += MINUTES_PER_DAY;
+
+    int i = t / BUCKET_MINUTES;
+    int r = t % BUCKET_MINUTES;
+    int next = (i + 1) % PROFILE_BUCKETS; // the day wraps around
+
+    // straight line between the two bucket points around time t
+    long long pct = (long long)p[i] * (BUCKET_MINUTES - r) + (long long)p[next] * r;
+    return (int)(((long long)baseWeight * pct + 50 * BUCKET_MINUTES) / (100 * BUCKET_MINUTES));
+}
+// Profile time of a road entered at minute t, before the FIFO rule below
+
+int profileTravelTime(const unsigned short *p, int peak, int steepestFall, int baseWeight, int minuteOfDay) {
+    int time = pointTime(p, baseWeight, minuteOfDay);
+
+    // FIFO: the time-dependent searches never wait at a place, so they are only right if
+    // entering a road later never gets you off it earlier. Between two points the time falls
+    // by base * drop / (100 * BUCKET_MINUTES) per minute, more than one minute per minute only
+    // when base * steepestFall > 100 * BUCKET_MINUTES (e.g. 30 min going from 200% to 100%).
+    if ((long long)baseWeight * steepestFall <= 100 * BUCKET_MINUTES)
+        return time;
+
+    // Otherwise arrival times are clamped to never decrease: arriving no earlier than anyone
+    // who entered before. Arrival is piecewise linear, so only the bucket points count, and
+    // only those less than the longest travel time back.
+    long long arrive = (long long)minuteOfDay + time;
+    long long longest = (long long)baseWeight * peak / 100 + 1;
+    int r = ((minuteOfDay % BUCKET_MINUTES) + BUCKET_MINUTES) % BUCKET_MINUTES;
+    for (long long b = (long long)minuteOfDay - r; minuteOfDay - b < longest; b -= BUCKET_MINUTES)
+        arrive = max(arrive, b + pointTime(p, baseWeight, (int)(b % MINUTES_PER_DAY)));
+    return (int)(arrive - minuteOfDay);
+}
+// Travel time of a road entered at minuteOfDay, interpolated between profile points; never
+// less than lowerBound nor more than the profile's peak, so pruning and Dial sizing still hold.
+// Works on the raw points so a map published to shared memory gives the same times.
+
+int ProfileStore::travelTime(int profileId, int baseWeight, int minuteOfDay) const {
+    if (profileId < 0)
+        return baseWeight;
+    return profileTravelTime(&points[(size_t)profileId * PROFILE_BUCKETS], peak[profileId],
+                             steepestFall[profileId], baseWeight, minuteOfDay);
+}
+
+int ProfileStore::lowerBound(int profileId, int baseWeight) const {
+    if (profileId < 0)
+        return baseWeight;
+    return (int)((long long)baseWeight * lowest[profileId] / 100);
+}
+// Travel time the road can never beat at any time of day, used to prune searches
+
+int ProfileStore::maxPercent() const {
+    return highest;
+}
+// Worst slowdown of any stored profile (never below 100), bounds every road time
+
+const unsigned short* ProfileStore::getPoints(int profileId) const {
+    return &points[(size_t)profileId * PROFILE_BUCKETS];
+}
+
+int ProfileStore::getLowest(int profileId) const {
+    return lowest[profileId];
+}
+
+int ProfileStore::getPeak(int profileId) const {
+    return peak[profileId];
+}
+
+int ProfileStore::getSteepestFall(int profileId) const {
+    return steepestFall[profileId];
+}
+// Raw profile data, for copying a map into shared memory
+
+int ProfileStore::size() const {
+    return points.size() / PROFILE_BUCKETS;
+}
+
+size_t ProfileStore::memoryBytes() const {
+    return (points.capacity() + lowest.capacity() + peak.capacity() + steepestFall.capacity()) * sizeof(unsigned short)
+         + byHash.size() * (sizeof(size_t) + sizeof(int) + sizeof(void *));
+}
+
+void ProfileStore::clear() {
+    points.clear();
+    lowest.clear();
+    peak.clear();
+    steepestFall.clear();
+    byHash.clear();
+    highest = 100;
+}
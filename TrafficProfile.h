@@ -0,0 +1,41 @@
+#ifndef TRAFFIC_PROFILE_H
+#define TRAFFIC_PROFILE_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+const int MINUTES_PER_DAY = 1440;
+const int PROFILE_BUCKETS = 96;                                  // one point per 15 minutes
+const int BUCKET_MINUTES = MINUTES_PER_DAY / PROFILE_BUCKETS;
+const int MIN_PROFILE_PERCENT = 1;                               // a road never gets free
+const int MAX_PROFILE_PERCENT = 1000;                            // nor more than 10x slower
+
+class ProfileStore {
+    vector<unsigned short> points;                // PROFILE_BUCKETS values per profile, back to back
+    vector<unsigned short> lowest;                // smallest value of every profile
+    vector<unsigned short> peak;                  // largest value of every profile
+    vector<unsigned short> steepestFall;          // largest drop from one point to the next, 0 if none
+    unordered_multimap<size_t, int> byHash;       // profile hash -> profile ID, used to share duplicates
+    int highest;                                  // largest value of any profile
+
+public:
+    ProfileStore();
+
+    int addProfile(const vector<unsigned short> &percent);
+    int travelTime(int profileId, int baseWeight, int minuteOfDay) const;
+    int lowerBound(int profileId, int baseWeight) const;
+    int maxPercent() const;
+    const unsigned short* getPoints(int profileId) const;
+    int getLowest(int profileId) const;
+    int getPeak(int profileId) const;
+    int getSteepestFall(int profileId) const;
+    int size() const;
+    size_t memoryBytes() const;
+    void clear();
+};
+
+int profileTravelTime(const unsigned short *points, int peak, int steepestFall, int baseWeight, int minuteOfDay);
+
+#endif
@@ -0,0 +1,174 @@
+#include "WhatIf.h"
+#include "Graph.h"
+#include "ThreadPool.h"
+#include "utils.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <random>
+#include <unordered_set>
+
+using namespace std;
+
+WhatIfAnalyzer::WhatIfAnalyzer(Graph &g, const vector<int> &stationNodes, int limit)
+    : graph(g), stations(stationNodes), limitMinutes(limit) {
+    baseline = graph.distancesWithClosures(stations, {});
+    reachable = count_if(baseline.begin(), baseline.end(), [](int d) { return d != INT_MAX; });
+}
+// Response times with today's closures are worked out once, every scenario is compared to them
+
+void WhatIfAnalyzer::addScenario(const ClosureScenario &scenario) {
+    scenarios.push_back(scenario);
+}
+
+void WhatIfAnalyzer::loadScenariosFromFile(const string &filename) {
+    ifstream file(filename);
+
+    if (!file.is_open()) {
+        cout << "File error\n";
+        return;
+    }
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        auto parts = split(line, ' ');
+        if (parts.size() < 3 || parts[0] != "closure")
+            continue;
+
+        ClosureScenario scenario;
+        scenario.name = parts[1];
+        for (int i = 2; i < (int)parts.size(); i++) {
+            auto ends = split(parts[i], '-');
+            if (ends.size() != 2)
+                continue;
+            for (int id : graph.getEdgeIds(stoi(ends[0]), stoi(ends[1])))
+                scenario.roads.push_back(id); // duplicates too, the way a real closure would
+        }
+        if (!scenario.roads.empty())
+            addScenario(scenario);
+    }
+
+    file.close();
+    cout << scenarios.size() << " closure scenarios loaded\n";
+}
+// File format: "closure name a-b c-d ..." closes the roads a-b, c-d ... together
+
+void WhatIfAnalyzer::generateRandomScenarios(int count, int roadsEach, unsigned seed) {
+    auto nodes = graph.getAllNodes();
+    if (nodes.empty() || roadsEach <= 0)
+        return;
+
+    mt19937 rng(seed);
+    for (int k = 0; k < count; k++) {
+        // roads spreading out from one place, the way a flood or a works area closes them
+        ClosureScenario scenario;
+        scenario.name = "area-" + to_string(k + 1);
+        unordered_set<int> taken;
+        vector<int> frontier = {nodes[rng() % nodes.size()]};
+        unordered_set<int> visited(frontier.begin(), frontier.end());
+
+        for (size_t i = 0; i < frontier.size() && (int)scenario.roads.size() < roadsEach; i++) {
+            for (auto &nb : graph.getNeighbors(frontier[i])) {
+                bool added = false;
+                for (int id : graph.getEdgeIds(frontier[i], nb.first))
+                    if (taken.insert(id).second) {
+                        scenario.roads.push_back(id); // a closure takes every road between the two places
+                        added = true;
+                    }
+                if (added && (int)scenario.roads.size() >= roadsEach)
+                    break;
+                if (visited.insert(nb.first).second)
+                    frontier.push_back(nb.first);
+            }
+        }
+        addScenario(scenario);
+    }
+}
+
+int WhatIfAnalyzer::getScenarioCount() const {
+    return scenarios.size();
+}
+
+ClosureImpact WhatIfAnalyzer::evaluate(const ClosureScenario &scenario) const {
+    ClosureImpact impact = {scenario.name, (int)scenario.roads.size(), 0, 0, 0, 0, 0, false};
+
+    // only the places whose fastest route used a closed road are searched again
+    auto changes = graph.distanceChangesWithClosures(stations, baseline, scenario.roads);
+    impact.changedAny = !changes.empty();
+
+    long long extra = 0;
+    for (auto &change : changes) {
+        int before = baseline[change.first];
+        int after = change.second;
+
+        if (after == INT_MAX) {
+            impact.cutOff++;
+            if (before <= limitMinutes)
+                impact.pushedOverLimit++;
+            continue;
+        }
+
+        impact.slowerPlaces++;
+        extra += after - before;
+        impact.worstIncrease = max(impact.worstIncrease, after - before);
+        if (before <= limitMinutes && after > limitMinutes)
+            impact.pushedOverLimit++;
+    }
+
+    impact.meanIncrease = reachable > 0 ? (double)extra / reachable : 0;
+    return impact;
+}
+
+vector<ClosureImpact> WhatIfAnalyzer::run(int threads) {
+    vector<ClosureImpact> results(scenarios.size()); // each task writes only its own slot
+
+    auto start = chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (int i = 0; i < (int)scenarios.size(); i++)
+            pool.submit([this, i, &results] { results[i] = evaluate(scenarios[i]); });
+        pool.waitAll();
+
+        int changed = count_if(results.begin(), results.end(), [](const ClosureImpact &r) { return r.changedAny; });
+        cout << scenarios.size() << " scenarios (" << changed << " change a response time) on " << pool.size()
+             << " threads in " << fixed << setprecision(2)
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms\n";
+        cout.unsetf(ios::fixed);
+    }
+
+    sort(results.begin(), results.end(), [](const ClosureImpact &a, const ClosureImpact &b) {
+        if (a.cutOff != b.cutOff)
+            return a.cutOff > b.cutOff;
+        if (a.pushedOverLimit != b.pushedOverLimit)
+            return a.pushedOverLimit > b.pushedOverLimit;
+        return a.meanIncrease > b.meanIncrease;
+    });
+    return results;
+}
+// Evaluates every scenario in parallel against the live map without changing it
+// Returns them most harmful first: places cut off, then places pushed past the limit, then average delay
+
+void WhatIfAnalyzer::printResults(const vector<ClosureImpact> &results, int top) const {
+    cout << "\nMost harmful closures (limit " << limitMinutes << " min from the nearest of "
+         << stations.size() << " stations)\n";
+    cout << "Scenario        Roads  CutOff  OverLimit  Slower  MeanExtra  WorstExtra\n";
+    cout << fixed << setprecision(3);
+    for (int i = 0; i < (int)results.size() && i < top; i++) {
+        auto &r = results[i];
+        cout << left << setw(16) << r.name << right
+             << setw(5) << r.roads
+             << setw(8) << r.cutOff
+             << setw(11) << r.pushedOverLimit
+             << setw(8) << r.slowerPlaces
+             << setw(11) << r.meanIncrease
+             << setw(12) << r.worstIncrease << endl;
+    }
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
@@ -0,0 +1,48 @@
+#ifndef WHAT_IF_H
+#define WHAT_IF_H
+
+#include <vector>
+#include <string>
+using namespace std;
+
+class Graph;
+
+struct ClosureScenario {
+    string name;
+    vector<int> roads; // edge IDs closed together, e.g. one road works project or one flooded area
+};
+
+struct ClosureImpact {
+    string name;
+    int roads;
+    double meanIncrease;  // extra minutes from the nearest station, averaged over every place
+    int worstIncrease;    // largest extra time at any place still reachable
+    int slowerPlaces;     // places whose time got longer
+    int pushedOverLimit;  // places that were within the limit and no longer are
+    int cutOff;           // places no station can reach any more
+    bool changedAny;      // false when no closed road was on a fastest route
+};
+
+class WhatIfAnalyzer {
+    Graph &graph;
+    vector<int> stations;
+    int limitMinutes;
+    vector<ClosureScenario> scenarios;
+
+    vector<int> baseline; // fastest time from any station, getAllNodes order
+    int reachable;        // places some station can reach today
+
+    ClosureImpact evaluate(const ClosureScenario &scenario) const;
+
+public:
+    WhatIfAnalyzer(Graph &g, const vector<int> &stationNodes, int limit);
+
+    void addScenario(const ClosureScenario &scenario);
+    void loadScenariosFromFile(const string &filename);
+    void generateRandomScenarios(int count, int roadsEach, unsigned seed);
+    int getScenarioCount() const;
+    vector<ClosureImpact> run(int threads = 0);
+    void printResults(const vector<ClosureImpact> &results, int top) const;
+};
+
+#endif
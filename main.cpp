@@ -1,6 +1,23 @@
 #include "Graph.h"
 #include "Incident.h"
 #include "ResourceManager.h"
+#include "Hospital.h"
+#include "Simulator.h"
+#include "ScenarioRunner.h"
+#include "LoadGenerator.h"
+#include "WhatIf.h"
+#include "Coverage.h"
+#include "Repositioner.h"
+#include "Reassigner.h"
+#include "RouteTracker.h"
+#include "Benchmark.h"
+#include "HubLabels.h"
+#include "StateLog.h"
+#include "DispatchServer.h"
+#include "ShardedRouter.h"
+#include "SharedMap.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include "utils.h"
 #include <iostream>
 #include <fstream>
@@ -11,6 +28,8 @@
 #include <ctime>
 #include <limits>
 #include <sstream>
+#include <map>
+#include <algorithm>
 
 using namespace std;
 
@@ -71,12 +90,17 @@ void runDemo() {
     cout << "\n1. LOADING CITY MAP..." << endl;
     Graph cityGraph;
     cityGraph.loadFromFile("map_small.txt");
+    cityGraph.loadProfilesFromFile("traffic_profiles.txt");
     cityGraph.display();
     
     cout << "\n2. LOADING AMBULANCES..." << endl;
     ResourceManager rm;
     rm.loadFromFile("ambulances.txt");
     rm.displayAll();
+    HospitalDirectory hospitals;
+    hospitals.setVerbose(false);
+    hospitals.loadFromFile("hospitals.txt");
+    hospitals.display();
     
     cout << "\n3. LOADING INCIDENTS..." << endl;
     IncidentQueue incidents;
@@ -86,6 +110,8 @@ void runDemo() {
     cout << "Calculating shortest path from Node 0 to Node 3..." << endl;
     int distance = cityGraph.dijkstra(0, 3);
     cout << "Shortest distance: " << distance << " units" << endl;
+    cout << "Same trip leaving at 03:00: " << cityGraph.dijkstraAt(0, 3, 3 * 60) << " units" << endl;
+    cout << "Same trip leaving at 08:00: " << cityGraph.dijkstraAt(0, 3, 8 * 60) << " units" << endl;
     
     cout << "\n5. DEMO: BLOCKED ROAD SCENARIO" << endl;
     cout << "Blocking road between Node 0 and Node 1..." << endl;
@@ -102,19 +128,21 @@ void runDemo() {
 
     cout << "\n6. DEMO: NEAREST AMBULANCE LOOKUP" << endl;
     cout << "Looking for nearest ambulance to Node 2..." << endl;
-    Ambulance* nearest = rm.findNearestAmbulance(2, cityGraph);
-    if (nearest) {
+    auto nearest = rm.findKNearest(2, 3, cityGraph);
+    if (!nearest.empty()) {
         cout << "Found: ";
-        nearest->display();
-        int distToIncident = cityGraph.dijkstra(nearest->getLocation(), 2);
-        cout << "Distance to incident: " << distToIncident << " units" << endl;
+        nearest[0].amb->display();
+        cout << "Distance to incident: " << nearest[0].eta << " units" << endl;
+        for (int i = 1; i < (int)nearest.size(); i++)
+            cout << "Backup #" << i << ": Ambulance #" << nearest[i].amb->getId()
+                 << " (" << nearest[i].eta << " units)" << endl;
     } else {
         cout << "No available ambulances found!" << endl;
     }
     
     cout << "\n7. DEMO: DYNAMIC REASSIGNMENT" << endl;
     cout << "Reassigning ambulances based on current incidents..." << endl;
-    rm.reassignAmbulances(incidents, cityGraph);
+    rm.reassignAmbulances(incidents, cityGraph, &hospitals);
     
     cout << "\n8. DEMO: PROCESSING INCIDENT QUEUE" << endl;
     int processed = 0;
@@ -128,10 +156,11 @@ void runDemo() {
             cout << "\nProcessing ";
             nextIncident->display();
             
-            Ambulance* assigned = rm.findNearestAmbulance(nextIncident->getLocation(), cityGraph);
-            if (assigned) {
+            auto best = rm.findKNearest(nextIncident->getLocation(), 1, cityGraph);
+            if (!best.empty()) {
+                Ambulance* assigned = best[0].amb;
                 assigned->dispatchTo(nextIncident->getId());
-                int dist = cityGraph.dijkstra(assigned->getLocation(), nextIncident->getLocation());
+                int dist = best[0].eta;
                 cout << "Assigned Ambulance #" << assigned->getId() 
                      << " (distance: " << dist << " units)" << endl;
                 assigned->setLocation(nextIncident->getLocation());
@@ -160,7 +189,30 @@ void runDemo() {
     cout << "Updating road conditions..." << endl;
     cityGraph.updateEdgeWeight(2, 3, 15);
     
-    cout << "\n11. FINAL SYSTEM STATUS" << endl;
+    cout << "\n11. DEMO: REPOSITIONING ACROSS A CLOSED ROAD" << endl;
+    Graph split; // 0-1-2 and 3-4, joined only by the road 2-3
+    split.setVerbose(false);
+    split.addEdge(0, 1, 2);
+    split.addEdge(1, 2, 2);
+    split.addEdge(2, 3, 2);
+    split.addEdge(3, 4, 2);
+    split.markRoadBlocked(2, 3);
+    ResourceManager fleet;
+    fleet.setVerbose(false);
+    fleet.addAmbulance(1, 0);
+    fleet.addAmbulance(2, 0);
+    Repositioner planner(split, fleet, 2);
+    planner.setCandidateStations({1, 4}); // station 4 is on the other side of the closure
+    double before, after;
+    bool reachable = true;
+    for (auto &m : planner.computeMoves(before, after)) {
+        cout << "Ambulance #" << m.amb->getId() << ": " << m.from << " -> " << m.to
+             << " (" << m.minutes << " min)" << endl;
+        reachable = reachable && m.minutes != INT_MAX && split.dijkstraWithBlocked(m.from, m.to) == m.minutes;
+    }
+    cout << "Every move drivable: " << (reachable ? "yes" : "NO") << endl;
+    
+    cout << "\n12. FINAL SYSTEM STATUS" << endl;
     cityGraph.display();
     rm.displayAll();
     rm.displayReassignmentLog();
@@ -171,8 +223,9 @@ void runDemo() {
     cout << "DEMO COMPLETE!" << endl;
 }
 
-void adminMenu(ResourceManager &rm, Graph &cityGraph, IncidentQueue &incidents) {
+void adminMenu(ResourceManager &rm, Graph &cityGraph, IncidentQueue &incidents, HospitalDirectory &hospitals) {
     int choice;
+    HubLabels oracle(cityGraph); // built or loaded on request, saved with the map
     
     do {
         cout << "\nADMINISTRATOR MENU" << endl;
@@ -185,11 +238,24 @@ void adminMenu(ResourceManager &rm, Graph &cityGraph, IncidentQueue &incidents)
         cout << "7. Reassign All Ambulances" << endl;
         cout << "8. View Reassignment Log" << endl;
         cout << "9. Clear All Incidents" << endl;
-        cout << "10. Back to Main Menu" << endl;
+        cout << "10. Generate Test City" << endl;
+        cout << "11. Run Fleet Simulation" << endl;
+        cout << "12. Run Fleet Planning Study" << endl;
+        cout << "13. Reposition Idle Ambulances" << endl;
+        cout << "14. Benchmark Searches" << endl;
+        cout << "15. Build Distance Oracle" << endl;
+        cout << "16. Export Metrics" << endl;
+        cout << "17. " << (Tracer::isEnabled() ? "Stop and Save Trace" : "Start Trace Recording") << endl;
+        cout << "18. Run Load Test" << endl;
+        cout << "19. What-If Road Closures" << endl;
+        cout << "20. Sharded Routing Test" << endl;
+        cout << "21. Shared Map Test" << endl;
+        cout << "22. Publish Map for Consoles" << endl;
+        cout << "23. Back to Main Menu" << endl;
         cout << "Choice: ";
         
         if (!(cin >> choice)) {
-            cout << "Invalid input! Please enter a number between 1 and 10.\n";
+            cout << "Invalid input! Please enter a number between 1 and 23.\n";
             clearInputBuffer();
             continue;
         }
@@ -248,11 +314,14 @@ void adminMenu(ResourceManager &rm, Graph &cityGraph, IncidentQueue &incidents)
                 cityGraph.saveToFile("map_saved.txt");
                 rm.saveToFile("ambulances_saved.txt");
                 incidents.saveToFile("incidents_saved.txt");
+                hospitals.saveToFile("hospitals_saved.txt");
+                if (!oracle.isStale())
+                    oracle.saveToFile("hub_labels_saved.bin");
                 cout << "All configurations saved!" << endl;
                 break;
                 
             case 7:
-                rm.reassignAmbulances(incidents, cityGraph);
+                rm.reassignAmbulances(incidents, cityGraph, &hospitals);
                 break;
                 
             case 8:
@@ -263,19 +332,249 @@ void adminMenu(ResourceManager &rm, Graph &cityGraph, IncidentQueue &incidents)
                 incidents.clearAll();
                 break;
                 
-            case 10:
+            case 10: {
+                int rows = getIntegerInput("Enter grid rows: ");
+                int cols = getIntegerInput("Enter grid columns: ");
+                int count = getIntegerInput("Enter number of ambulances: ");
+                int hospitalCount = getIntegerInput("Enter number of hospitals: ");
+                cityGraph.generateTestMap(rows, cols);
+                incidents.clearAll();
+                rm.clearAll();
+                rm.generateTestAmbulances(count, cityGraph);
+                hospitals.clearAll();
+                hospitals.generateTestHospitals(hospitalCount, cityGraph);
+                break;
+            }
+                
+            case 11: {
+                SimulationConfig config;
+                config.days = getIntegerInput("Enter days to simulate: ");
+                config.incidentsPerHour = getIntegerInput("Enter incidents per hour: ");
+                config.seed = time(0);
+                
+                // the simulation drives its own map, fleet and queue so live state is untouched:
+                // its road closures never reach the state log or the live listeners
+                Graph simMap(cityGraph);
+                ResourceManager simFleet;
+                IncidentQueue simQueue;
+                simMap.setVerbose(false);
+                simFleet.setVerbose(false);
+                simQueue.setVerbose(false);
+                for (auto amb : rm.getAllAmbulances())
+                    simFleet.addAmbulance(amb->getId(), amb->getStation());
+                
+                Simulator sim(simMap, simFleet, simQueue, config);
+                cout << "Simulating..." << endl;
+                sim.run();
+                sim.printReport();
+                break;
+            }
+                
+            case 12: {
+                SimulationConfig config;
+                config.days = getIntegerInput("Enter days per run: ");
+                config.incidentsPerHour = getIntegerInput("Enter incidents per hour: ");
+                config.seed = time(0);
+                
+                // incidents on record set where new ones are likely to happen
+                auto nodes = cityGraph.getAllNodes();
+                map<int, double> seen;
+                for (auto inc : incidents.getAllIncidents())
+                    seen[inc->getLocation()]++;
+                for (int n : nodes)
+                    config.nodeWeights.push_back(1 + seen[n]);
+                
+                int runs = getIntegerInput("Enter runs per plan: ");
+                ScenarioRunner study(cityGraph, config, runs, 8);
+                study.loadPlansFromFile("fleet_plans.txt");
+                if (study.getPlanCount() > 0)
+                    study.printResults(study.run());
+                break;
+            }
+                
+            case 13: {
+                Repositioner planner(cityGraph, rm, 8);
+                vector<int> stations;
+                for (auto amb : rm.getAllAmbulances())
+                    stations.push_back(amb->getStation());
+                planner.setCandidateStations(stations);
+                planner.setDemandFromIncidents(incidents);
+                
+                double before, after;
+                auto moves = planner.computeMoves(before, after);
+                cout << "Expected coverage: " << before * 100 << "% -> " << after * 100 << "%" << endl;
+                if (moves.empty()) {
+                    cout << "No moves needed" << endl;
+                    break;
+                }
+                for (auto &m : moves)
+                    cout << "Ambulance #" << m.amb->getId() << ": " << m.from << " -> " << m.to
+                         << " (" << m.minutes << " min)" << endl;
+                cout << planner.applyMoves(moves) << " ambulances repositioned" << endl;
+                break;
+            }
+                
+            case 14: {
+                int queries = getIntegerInput("Enter number of queries: ");
+                cout << "Benchmarking on " << cityGraph.getNodeCount() << " locations..." << endl;
+                printQueueTimings(benchmarkQueues(cityGraph, queries, time(0)));
+                
+                double sequentialMs;
+                auto parallel = benchmarkParallelOneToAll(cityGraph, queries, time(0), sequentialMs);
+                printParallelTimings(parallel, sequentialMs);
+                
+                int stations = getIntegerInput("Enter number of stations for the table benchmark: ");
+                printTableTiming(benchmarkStationTables(cityGraph, stations, time(0)));
+                
+                int changes = getIntegerInput("Enter number of road changes for the overlay benchmark: ");
+                printOverlayTiming(benchmarkOverlay(cityGraph, queries, changes, time(0)));
+                printLayoutTiming(benchmarkNodeOrder(cityGraph, queries, time(0)));
+                printCompressionTiming(benchmarkCompressed(cityGraph, queries, time(0)));
+                break;
+            }
+                
+            case 15: {
+                if (oracle.isStale() && !oracle.loadFromFile("hub_labels_saved.bin")) {
+                    cout << "Building hub labels for " << cityGraph.getNodeCount() << " locations..." << endl;
+                    oracle.build();
+                }
+                oracle.display();
+                
+                int queries = getIntegerInput("Enter number of queries: ");
+                printOracleTiming(benchmarkHubLabels(cityGraph, oracle, queries, time(0)));
+                break;
+            }
+                
+            case 16: {
+                MetricsRegistry &metrics = MetricsRegistry::instance();
+                metrics.display();
+                
+                int seconds = getIntegerInput("Enter export interval in seconds (0 = export once): ");
+                if (seconds > 0) {
+                    metrics.startPeriodicDump(seconds, "metrics.prom", "metrics.json");
+                    cout << "Writing metrics.prom and metrics.json every " << seconds << " s" << endl;
+                } else {
+                    metrics.stopPeriodicDump();
+                    if (metrics.saveToFiles("metrics.prom", "metrics.json"))
+                        cout << "Metrics saved to metrics.prom and metrics.json" << endl;
+                    else
+                        cout << "Save failed" << endl;
+                }
+                break;
+            }
+                
+            case 17:
+                if (!Tracer::isEnabled()) {
+                    Tracer::clear();
+                    Tracer::setEnabled(true);
+                    cout << "Recording trace, dispatch as usual and choose this option again to save it" << endl;
+                } else {
+                    Tracer::setEnabled(false);
+                    if (Tracer::saveChromeTrace("trace.json"))
+                        cout << Tracer::getEventCount() << " spans saved to trace.json (open in ui.perfetto.dev)" << endl;
+                    else
+                        cout << "Save failed" << endl;
+                }
+                break;
+                
+            case 18: {
+                LoadTestConfig config;
+                config.arrivalsPerSecond = getIntegerInput("Enter target incidents per second: ");
+                config.seconds = getIntegerInput("Enter seconds per run: ");
+                config.highShare = getIntegerInput("Enter percent HIGH priority: ") / 100.0;
+                config.mediumShare = getIntegerInput("Enter percent MEDIUM priority: ") / 100.0;
+                config.hotspots = getIntegerInput("Enter number of hotspots (0 = uniform): ");
+                config.seed = time(0);
+                int targetMs = getIntegerInput("Enter p99 latency target in ms (0 = single run): ");
+                
+                // like the simulation, the load test works on its own fleet and queue
+                ResourceManager testFleet;
+                IncidentQueue testQueue;
+                testFleet.setVerbose(false);
+                testQueue.setVerbose(false);
+                for (auto amb : rm.getAllAmbulances())
+                    testFleet.addAmbulance(amb->getId(), amb->getLocation());
+                
+                LoadGenerator load(cityGraph, testFleet, testQueue, config);
+                if (targetMs <= 0) {
+                    LoadGenerator::printReport(load.run(config.arrivalsPerSecond));
+                    break;
+                }
+                
+                vector<LoadTestReport> steps;
+                double best = load.findMaxRate(targetMs, steps);
+                for (auto &step : steps)
+                    LoadGenerator::printReport(step);
+                cout << "Max sustainable throughput (p99 <= " << targetMs << " ms): ";
+                if (best > 0)
+                    cout << (int)best << " incidents/s" << endl;
+                else
+                    cout << "none of the rates tried" << endl;
+                break;
+            }
+                
+            case 19: {
+                // the stations the fleet is based at, each counted once
+                vector<int> stations;
+                for (auto amb : rm.getAllAmbulances())
+                    if (find(stations.begin(), stations.end(), amb->getStation()) == stations.end())
+                        stations.push_back(amb->getStation());
+                if (stations.empty()) {
+                    cout << "No ambulances available" << endl;
+                    break;
+                }
+                
+                WhatIfAnalyzer whatIf(cityGraph, stations, 8);
+                int count = getIntegerInput("Enter number of random closure scenarios (0 = read closure_scenarios.txt): ");
+                if (count > 0)
+                    whatIf.generateRandomScenarios(count, getIntegerInput("Enter roads per scenario: "), time(0));
+                else
+                    whatIf.loadScenariosFromFile("closure_scenarios.txt");
+                if (whatIf.getScenarioCount() > 0)
+                    whatIf.printResults(whatIf.run(), 10);
+                break;
+            }
+                
+            case 20: {
+                int regions = getIntegerInput("Enter number of regions (one worker process each): ");
+                if (regions < 1) {
+                    cout << "Need at least one region" << endl;
+                    break;
+                }
+                int queries = getIntegerInput("Enter number of queries: ");
+                int changes = getIntegerInput("Enter number of road changes: ");
+                printShardTiming(benchmarkSharded(cityGraph, regions, queries, changes, time(0)));
+                break;
+            }
+                
+            case 21: {
+                int readers = getIntegerInput("Enter number of reader processes: ");
+                int queries = getIntegerInput("Enter number of queries per reader: ");
+                int closures = getIntegerInput("Enter roads each reader closes for itself: ");
+                printSharedMapTiming(benchmarkSharedMap(cityGraph, readers, queries, closures, time(0)));
+                break;
+            }
+                
+            case 22:
+                if (SharedMap::publish(cityGraph, SHARED_MAP_NAME))
+                    cout << "Map published as " << SHARED_MAP_NAME << ", consoles started from now on attach to it" << endl;
+                break;
+                
+            case 23:
                 cout << "Returning to main menu..." << endl;
                 break;
                 
             default:
-                cout << "Invalid choice! Please enter a number between 1 and 10.\n";
+                cout << "Invalid choice! Please enter a number between 1 and 23.\n";
         }
         
-    } while (choice != 10);
+    } while (choice != 23);
 }
 
-void dispatcherMenu(Graph &cityGraph, ResourceManager &rm, IncidentQueue &incidents) {
+void dispatcherMenu(Graph &cityGraph, ResourceManager &rm, IncidentQueue &incidents, HospitalDirectory &hospitals) {
     int choice;
+    CoverageMap coverage(cityGraph, rm, 8); // follows every dispatch and completion from here on
+    Reassigner assignments(cityGraph, rm, incidents); // proposed unit for every pending incident
     
     do {
         cout << "\nDISPATCHER MENU" << endl;
@@ -286,11 +585,15 @@ void dispatcherMenu(Graph &cityGraph, ResourceManager &rm, IncidentQueue &incide
         cout << "5. Check Road Conditions" << endl;
         cout << "6. View System Status" << endl;
         cout << "7. Save Current State" << endl;
-        cout << "8. Back to Main Menu" << endl;
+        cout << "8. Show Ambulance Reach" << endl;
+        cout << "9. Coverage Summary" << endl;
+        cout << "10. Update Assignment Plan" << endl;
+        cout << "11. Plan Transport to Hospital" << endl;
+        cout << "12. Back to Main Menu" << endl;
         cout << "Choice: ";
         
         if (!(cin >> choice)) {
-            cout << "Invalid input! Please enter a number between 1 and 8.\n";
+            cout << "Invalid input! Please enter a number between 1 and 12.\n";
             clearInputBuffer();
             continue;
         }
@@ -301,18 +604,19 @@ void dispatcherMenu(Graph &cityGraph, ResourceManager &rm, IncidentQueue &incide
                 int loc = getIntegerInput("Enter location (node): ");
                 string pri = getPriorityInput();
                 string desc = getStringInput("Enter description: ");
-                incidents.addIncident(loc, pri, desc);
+                assignments.incidentAdded(incidents.addIncident(loc, pri, desc));
                 break;
             }
                 
             case 2: {
                 int location = getIntegerInput("Enter incident location (node): ");
-                Ambulance* nearest = rm.findNearestAmbulance(location, cityGraph);
-                if (nearest) {
-                    cout << "Nearest available ambulance: ";
-                    nearest->display();
-                    int dist = cityGraph.dijkstra(nearest->getLocation(), location);
-                    cout << "Estimated travel time: " << dist << " units" << endl;
+                auto nearest = rm.findKNearest(location, 3, cityGraph);
+                if (!nearest.empty()) {
+                    cout << "Nearest available ambulances:" << endl;
+                    for (auto &unit : nearest) {
+                        unit.amb->display();
+                        cout << "  Estimated travel time: " << unit.eta << " units" << endl;
+                    }
                 } else {
                     cout << "No available ambulances!" << endl;
                 }
@@ -326,13 +630,19 @@ void dispatcherMenu(Graph &cityGraph, ResourceManager &rm, IncidentQueue &incide
                 
                 if (rm.dispatchAmbulance(ambId, incId, loc)) {
                     cout << "Dispatch confirmed!" << endl;
+                    assignments.unitTaken(rm.findAmbulanceById(ambId));
+                    assignments.incidentServed(incId);
                 }
                 break;
             }
                 
             case 4: {
                 int ambId = getIntegerInput("Enter ambulance ID to mark complete: ");
+                Ambulance* amb = rm.findAmbulanceById(ambId);
+                int incId = amb ? amb->getAssignedIncident() : -1;
                 rm.completeAssignment(ambId);
+                incidents.resolveIncident(incId); // the call is over, the incident no longer counts as active
+                assignments.unitFreed(amb);
                 break;
             }
                 
@@ -343,6 +653,7 @@ void dispatcherMenu(Graph &cityGraph, ResourceManager &rm, IncidentQueue &incide
             case 6:
                 cityGraph.display();
                 rm.displayAll();
+                hospitals.display();
                 incidents.displayAll();
                 cout << "Active incidents: " << incidents.getActiveCount() << endl;
                 break;
@@ -352,21 +663,79 @@ void dispatcherMenu(Graph &cityGraph, ResourceManager &rm, IncidentQueue &incide
                 cout << "Current incidents saved to file." << endl;
                 break;
                 
-            case 8:
+            case 8: {
+                int ambId = getIntegerInput("Enter ambulance ID: ");
+                int minutes = getIntegerInput("Enter time budget (minutes): ");
+                Ambulance* amb = rm.findAmbulanceById(ambId);
+                if (!amb) {
+                    cout << "Ambulance not found\n";
+                    break;
+                }
+                auto reach = cityGraph.isochrone(amb->getLocation(), minutes);
+                cout << "Ambulance #" << ambId << " reaches " << reach.size()
+                     << " locations within " << minutes << " min:" << endl;
+                printVector(reach);
+                break;
+            }
+                
+            case 9:
+                coverage.display();
+                break;
+                
+            case 10:
+                assignments.update();
+                cout << assignments.getEvaluatedCount() << " pairings re-evaluated, "
+                     << assignments.getChangedCount() << " changed" << endl;
+                assignments.display();
+                break;
+                
+            case 11: {
+                int location = getIntegerInput("Enter incident location (node): ");
+                string pri = getPriorityInput();
+                TransportPlan plan = hospitals.planTransport(location, pri, rm, cityGraph);
+                if (!plan.amb) {
+                    cout << "No available ambulances!" << endl;
+                    break;
+                }
+                cout << "Ambulance #" << plan.amb->getId() << ": " << plan.toIncident << " min to the incident" << endl;
+                if (!plan.hospital) {
+                    cout << "No suitable hospital can be reached from there!" << endl;
+                    break;
+                }
+                cout << "Hospital #" << plan.hospital->getId() << " at " << plan.hospital->getLocation()
+                     << (plan.hospital->isTraumaCentre() ? " (trauma centre)" : "") << ": "
+                     << plan.toHospital << " min from the incident" << endl;
+                cout << "Total to hospital: " << plan.total << " min" << endl;
+                break;
+            }
+                
+            case 12:
                 cout << "Returning to main menu..." << endl;
                 break;
                 
             default:
-                cout << "Invalid choice! Please enter a number between 1 and 8.\n";
+                cout << "Invalid choice! Please enter a number between 1 and 12.\n";
         }
         
-    } while (choice != 8);
+    } while (choice != 12);
 }
 
 void interactiveMenu() {
     Graph cityGraph;
+    RouteTracker routes(cityGraph, true); // before the fleet, which still uses it while it goes
     ResourceManager rm;
     IncidentQueue incidents;
+    HospitalDirectory hospitals;
+    hospitals.setVerbose(false);
+    hospitals.loadFromFile("hospitals.txt"); // hospitals are read from their file, not logged
+    hospitals.setVerbose(true);
+    
+    StateLog journal("state_log.bin", "state_checkpoint.bin"); // every change is kept across crashes
+    bool restored = journal.recover(cityGraph, rm, incidents);
+    if (restored)
+        cityGraph.loadProfilesFromFile("traffic_profiles.txt"); // profiles are read from their file, not logged
+    journal.attach(cityGraph, rm, incidents);
+    rm.setRouteTracker(&routes); // units dispatched from here on are rerouted around closures
     
     int roleChoice;
     
@@ -389,33 +758,46 @@ void interactiveMenu() {
         switch(roleChoice) {
             case 1: {
                 cout << "\nDISPATCHER MODE" << endl;
-                cout << "Loading default configurations..." << endl;
-                cityGraph.loadFromFile("map_small.txt");
-                rm.loadFromFile("ambulances.txt");
-                incidents.loadFromFile("incidents.txt", cityGraph);
-                dispatcherMenu(cityGraph, rm, incidents);
+                if (!restored) {
+                    cout << "Loading default configurations..." << endl;
+                    cityGraph.loadFromFile("map_small.txt");
+                    cityGraph.loadProfilesFromFile("traffic_profiles.txt");
+                    rm.loadFromFile("ambulances.txt");
+                    incidents.loadFromFile("incidents.txt", cityGraph);
+                }
+                dispatcherMenu(cityGraph, rm, incidents, hospitals);
+                journal.commit();
                 break;
             }
                 
             case 2: {
                 cout << "\nADMINISTRATOR MODE" << endl;
-                cout << "Loading default configurations..." << endl;
-                cityGraph.loadFromFile("map_small.txt");
-                rm.loadFromFile("ambulances.txt");
-                adminMenu(rm, cityGraph, incidents);
+                if (!restored) {
+                    cout << "Loading default configurations..." << endl;
+                    cityGraph.loadFromFile("map_small.txt");
+                    cityGraph.loadProfilesFromFile("traffic_profiles.txt");
+                    rm.loadFromFile("ambulances.txt");
+                }
+                adminMenu(rm, cityGraph, incidents, hospitals);
+                journal.commit();
                 break;
             }
                 
             case 3: {
                 cout << "\nSYSTEM STATUS" << endl;
-                cityGraph.loadFromFile("map_small.txt");
-                rm.loadFromFile("ambulances.txt");
-                incidents.loadFromFile("incidents.txt", cityGraph);
+                if (!restored) {
+                    cityGraph.loadFromFile("map_small.txt");
+                    cityGraph.loadProfilesFromFile("traffic_profiles.txt");
+                    rm.loadFromFile("ambulances.txt");
+                    incidents.loadFromFile("incidents.txt", cityGraph);
+                }
                 
                 cityGraph.display();
                 rm.displayAll();
+                hospitals.display();
                 incidents.displayAll();
                 cout << "Active incidents: " << incidents.getActiveCount() << endl;
+                journal.displayStats();
                 
                 cout << "\nPress Enter to continue...";
                 cin.get();
@@ -433,7 +815,216 @@ void interactiveMenu() {
     } while (roleChoice != 0);
 }
 
-int main() {
+void runServer() {
+    Graph cityGraph;
+    RouteTracker routes(cityGraph, true);
+    ResourceManager rm;
+    IncidentQueue incidents;
+    
+    StateLog journal("state_log.bin", "state_checkpoint.bin"); // same session state as the menus
+    bool restored = journal.recover(cityGraph, rm, incidents);
+    if (!restored) {
+        cout << "Loading default configurations..." << endl;
+        cityGraph.loadFromFile("map_small.txt");
+        rm.loadFromFile("ambulances.txt");
+        incidents.loadFromFile("incidents.txt", cityGraph);
+    }
+    cityGraph.loadProfilesFromFile("traffic_profiles.txt");
+    journal.attach(cityGraph, rm, incidents);
+    rm.setRouteTracker(&routes); // DISPATCH follows the unit, ROAD ... BLOCK reroutes it
+    
+    // one line per request would drown the console
+    cityGraph.setVerbose(false);
+    rm.setVerbose(false);
+    incidents.setVerbose(false);
+    
+    string where = getStringInput("Enter socket path, or a port for localhost TCP: ");
+    int threads = getIntegerInput("Enter query threads (0 = one per core): ");
+    
+    DispatchServer server(cityGraph, rm, incidents, &journal, threads);
+    bool numeric = !where.empty() && where.find_first_not_of("0123456789") == string::npos;
+    if (numeric ? server.listenTcp(stoi(where)) : server.listenUnix(where)) {
+        cout << "Listening on " << (numeric ? "127.0.0.1:" : "") << where << endl;
+        server.run();
+    }
+    journal.commit();
+}
+
+void sharedDispatcherMenu(SharedMap &map, ResourceManager &rm, IncidentQueue &incidents) {
+    int choice;
+    
+    do {
+        cout << "\nSHARED MAP DISPATCHER MENU" << endl;
+        cout << "(road closures made here apply to this console only; coverage, the assignment plan," << endl;
+        cout << " rerouting and the state log need the full console)" << endl;
+        cout << "1. Report New Incident" << endl;
+        cout << "2. Find Nearest Ambulance" << endl;
+        cout << "3. Dispatch Ambulance to Incident" << endl;
+        cout << "4. Mark Assignment Complete" << endl;
+        cout << "5. Check Road Conditions" << endl;
+        cout << "6. Close/Open Road for This Console" << endl;
+        cout << "7. Show Ambulance Reach" << endl;
+        cout << "8. Route Time Between Locations" << endl;
+        cout << "9. View System Status" << endl;
+        cout << "10. Back to Main Menu" << endl;
+        cout << "Choice: ";
+        
+        if (!(cin >> choice)) {
+            cout << "Invalid input! Please enter a number between 1 and 10.\n";
+            clearInputBuffer();
+            continue;
+        }
+        clearInputBuffer();
+        
+        switch(choice) {
+            case 1: {
+                int loc = getIntegerInput("Enter location (node): ");
+                if (!map.hasNode(loc)) {
+                    cout << "Location not on the map\n";
+                    break;
+                }
+                string pri = getPriorityInput();
+                string desc = getStringInput("Enter description: ");
+                incidents.addIncident(loc, pri, desc);
+                break;
+            }
+                
+            case 2: {
+                int location = getIntegerInput("Enter incident location (node): ");
+                auto nearest = rm.findKNearest(location, 3, map);
+                if (!nearest.empty()) {
+                    cout << "Nearest available ambulances:" << endl;
+                    for (auto &unit : nearest) {
+                        unit.amb->display();
+                        cout << "  Estimated travel time: " << unit.eta << " units" << endl;
+                    }
+                } else {
+                    cout << "No available ambulances!" << endl;
+                }
+                break;
+            }
+                
+            case 3: {
+                int ambId = getIntegerInput("Enter ambulance ID: ");
+                int incId = getIntegerInput("Enter incident ID: ");
+                int loc = getIntegerInput("Enter incident location (node): ");
+                
+                if (rm.dispatchAmbulance(ambId, incId, loc))
+                    cout << "Dispatch confirmed!" << endl;
+                break;
+            }
+                
+            case 4: {
+                int ambId = getIntegerInput("Enter ambulance ID to mark complete: ");
+                Ambulance* amb = rm.findAmbulanceById(ambId);
+                int incId = amb ? amb->getAssignedIncident() : -1;
+                rm.completeAssignment(ambId);
+                incidents.resolveIncident(incId);
+                break;
+            }
+                
+            case 5:
+                map.displayClosedRoads();
+                break;
+                
+            case 6: {
+                int src = getIntegerInput("Enter source node: ");
+                int dest = getIntegerInput("Enter destination node: ");
+                int action = getIntegerInput("1. Close  2. Open: ");
+                bool done = action == 1 ? map.closeRoad(src, dest) : map.openRoad(src, dest);
+                if (done)
+                    cout << "Road " << src << "-" << dest << (action == 1 ? " closed" : " opened")
+                         << " for this console" << endl;
+                else
+                    cout << "Road not found\n";
+                break;
+            }
+                
+            case 7: {
+                int ambId = getIntegerInput("Enter ambulance ID: ");
+                int minutes = getIntegerInput("Enter time budget (minutes): ");
+                Ambulance* amb = rm.findAmbulanceById(ambId);
+                if (!amb) {
+                    cout << "Ambulance not found\n";
+                    break;
+                }
+                auto reach = map.isochrone(amb->getLocation(), minutes, currentMinuteOfDay());
+                cout << "Ambulance #" << ambId << " reaches " << reach.size()
+                     << " locations within " << minutes << " min:" << endl;
+                printVector(reach);
+                break;
+            }
+                
+            case 8: {
+                int start = getIntegerInput("Enter start node: ");
+                int end = getIntegerInput("Enter end node: ");
+                int time = map.shortestTimeAt(start, end, currentMinuteOfDay());
+                if (time == INT_MAX)
+                    cout << "No route" << endl;
+                else
+                    cout << "Travel time leaving now: " << time << " min" << endl;
+                break;
+            }
+                
+            case 9:
+                cout << "Shared map: " << map.getNodeCount() << " locations, " << map.getRoadCount()
+                     << " roads, " << (map.hasProfiles() ? "traffic profiles published" : "static travel times")
+                     << ", " << map.getClosureCount() << " closed here" << endl;
+                rm.displayAll();
+                incidents.displayAll();
+                cout << "Active incidents: " << incidents.getActiveCount() << endl;
+                break;
+                
+            case 10:
+                cout << "Returning to main menu..." << endl;
+                break;
+                
+            default:
+                cout << "Invalid choice! Please enter a number between 1 and 10.\n";
+        }
+        
+    } while (choice != 10);
+}
+
+void runSharedConsole() {
+    SharedMap map;
+    if (!map.attach(SHARED_MAP_NAME)) {
+        cout << "No map published yet, publishing map_small.txt..." << endl;
+        {
+            Graph cityGraph; // only needed to publish, the console routes on the shared copy
+            cityGraph.loadFromFile("map_small.txt");
+            cityGraph.loadProfilesFromFile("traffic_profiles.txt");
+            SharedMap::publish(cityGraph, SHARED_MAP_NAME);
+        }
+        if (!map.attach(SHARED_MAP_NAME)) {
+            cout << "Could not attach the shared map" << endl;
+            return;
+        }
+    }
+    cout << "Attached to " << SHARED_MAP_NAME << " (" << map.getBytes() << " bytes shared) in "
+         << map.getAttachMs() << " ms" << endl;
+    
+    ResourceManager rm;
+    IncidentQueue incidents;
+    rm.loadFromFile("ambulances.txt");
+    incidents.loadFromFile("incidents.txt", map);
+    sharedDispatcherMenu(map, rm, incidents);
+}
+// A dispatcher console that keeps no map of its own: every console attaches the one published map
+// (ETAs follow its traffic profiles) and only its own closures cost it memory
+
+int main(int argc, char** argv) {
+    // started by a ShardedRouter to serve one region of the map
+    if (argc == 3 && string(argv[1]) == "--region-worker") {
+        runRegionWorker(atoi(argv[2]));
+        return 0;
+    }
+    // started by runMapReaders to route on a map published in shared memory
+    if (argc == 7 && string(argv[1]) == "--map-reader") {
+        runMapReader(argv[2], atoi(argv[3]), atoi(argv[4]), strtoul(argv[5], nullptr, 10), atoi(argv[6]));
+        return 0;
+    }
+    
     srand(time(0));
     
     cout << "  EMERGENCY ROUTING & RESOURCE SYSTEM   " << endl;
@@ -445,24 +1036,30 @@ int main() {
         cout << "\nChoose mode:" << endl;
         cout << "1. Role-Based Interactive Menu" << endl;
         cout << "2. Automated Demo (Presentation)" << endl;
+        cout << "3. Dispatch Server" << endl;
+        cout << "4. Dispatcher on Shared Map" << endl;
         cout << "Choice: ";
         
         if (!(cin >> choice)) {
-            cout << "Invalid input! Please enter 1 or 2.\n";
+            cout << "Invalid input! Please enter 1, 2, 3 or 4.\n";
             clearInputBuffer();
             continue;
         }
         clearInputBuffer();
         
-        if (choice == 1 || choice == 2) {
+        if (choice >= 1 && choice <= 4) {
             break;
         } else {
-            cout << "Invalid choice! Please enter 1 or 2.\n";
+            cout << "Invalid choice! Please enter 1, 2, 3 or 4.\n";
         }
     }
     
     if (choice == 1) {
         interactiveMenu();
+    } else if (choice == 3) {
+        runServer();
+    } else if (choice == 4) {
+        runSharedConsole();
     } else {
         runDemo();
     }
@@ -1,4 +1,5 @@
 #include "utils.h"
+#include <ctime>
 
 vector<string> split(const string &str, char delimiter) {
     vector<string> tokens;
@@ -9,4 +10,12 @@ vector<string> split(const string &str, char delimiter) {
         tokens.push_back(token);
     }
     return tokens;
-}
\ No newline at end of file
+}
+
+int currentMinuteOfDay() {
+    time_t now = time(0);
+    tm local;
+    localtime_r(&now, &local); // callable from several threads at once
+    return local.tm_hour * 60 + local.tm_min;
+}
+// Minutes since local midnight, used as departure time for traffic profiles
@@ -9,6 +9,7 @@
 using namespace std;
 
 vector<string> split(const string &str, char delimiter);
+int currentMinuteOfDay();
 
 template<typename T>
 void printVector(const vector<T> &vec, const string &name = "") {